@@ -7,6 +7,7 @@
 #include <QScrollArea>
 #include <QScrollBar>
 #include "model/datacenter.h"
+#include "avatarcache.h"
 
 #include "debug.h"
 
@@ -32,7 +33,7 @@ FriendResultItem::FriendResultItem(const UserInfo &userInfo) : userInfo(userInfo
     QPushButton* avatarBtn = new QPushButton();
     avatarBtn->setFixedSize(50, 50);
     avatarBtn->setIconSize(QSize(50, 50));
-    avatarBtn->setIcon(userInfo.avatar);
+    avatarBtn->setIcon(AvatarCache::getInstance()->icon(AvatarCache::userKey(userInfo.userId), userInfo.avatar, 50));
 
     // 4. 创建昵称
     QLabel* nameLabel = new QLabel();
@@ -0,0 +1,95 @@
+#include "avatarcache.h"
+
+#include <QApplication>
+#include <QPainterPath>
+
+#include "model/datacenter.h"
+
+// 缓存的总大小. 按照 pixmap 的字节数计算.
+static const int AVATAR_CACHE_BYTES = 16 * 1024 * 1024;
+// 圆角半径占头像尺寸的比例
+static const qreal CORNER_RATIO = 0.1;
+
+AvatarCache* AvatarCache::instance = nullptr;
+
+AvatarCache *AvatarCache::getInstance()
+{
+    if (instance == nullptr) {
+        instance = new AvatarCache();
+    }
+    return instance;
+}
+
+AvatarCache::AvatarCache(QObject *parent)
+    : QObject{parent}
+{
+    cache.setMaxCost(AVATAR_CACHE_BYTES);
+
+    // 头像可能变化的时机, 清除缓存. 这几种情况都不频繁, 直接整体清除即可.
+    model::DataCenter* dataCenter = model::DataCenter::getInstance();
+    connect(dataCenter, &model::DataCenter::getMyselfDone, this, &AvatarCache::clear);
+    connect(dataCenter, &model::DataCenter::changeAvatarDone, this, &AvatarCache::clear);
+    connect(dataCenter, &model::DataCenter::getFriendListDone, this, &AvatarCache::clear);
+    connect(dataCenter, &model::DataCenter::getChatSessionListDone, this, &AvatarCache::clear);
+}
+
+QString AvatarCache::cacheKey(const QString &key, int size, qreal dpr)
+{
+    return QString("%1|%2|%3").arg(key).arg(size).arg(dpr);
+}
+
+QPixmap AvatarCache::pixmap(const QString &key, const QIcon &avatar, int size, qreal dpr)
+{
+    QString k = cacheKey(key, size, dpr);
+    QPixmap* cached = cache.object(k);
+    if (cached != nullptr) {
+        return *cached;
+    }
+
+    // 1. 缩放到实际的像素尺寸, 只做这一次
+    int pixelSize = qRound(size * dpr);
+    QPixmap source = avatar.pixmap(QSize(size, size), dpr);
+    if (source.isNull()) {
+        return QPixmap();
+    }
+
+    // 2. 裁剪圆角
+    QPixmap result(pixelSize, pixelSize);
+    result.fill(Qt::transparent);
+    QPainter painter(&result);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    QPainterPath path;
+    qreal radius = pixelSize * CORNER_RATIO;
+    path.addRoundedRect(QRectF(0, 0, pixelSize, pixelSize), radius, radius);
+    painter.setClipPath(path);
+    source.setDevicePixelRatio(1.0);
+    painter.drawPixmap(QRect(0, 0, pixelSize, pixelSize), source);
+    painter.end();
+    result.setDevicePixelRatio(dpr);
+
+    // 3. 放入缓存
+    cache.insert(k, new QPixmap(result), pixelSize * pixelSize * 4);
+    return result;
+}
+
+void AvatarCache::paint(QPainter *painter, const QRect &rect, const QString &key, const QIcon &avatar)
+{
+    qreal dpr = painter->device()->devicePixelRatioF();
+    QPixmap p = pixmap(key, avatar, rect.width(), dpr);
+    if (p.isNull()) {
+        return;
+    }
+    // 尺寸和设备像素比都是匹配的, 这里不会发生缩放
+    painter->drawPixmap(rect.topLeft(), p);
+}
+
+QIcon AvatarCache::icon(const QString &key, const QIcon &avatar, int size)
+{
+    return QIcon(pixmap(key, avatar, size, qApp->devicePixelRatio()));
+}
+
+void AvatarCache::clear()
+{
+    cache.clear();
+}
@@ -0,0 +1,48 @@
+#ifndef AVATARCACHE_H
+#define AVATARCACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QPixmap>
+#include <QIcon>
+#include <QPainter>
+
+////////////////////////////////////////////////////////
+/// 头像缓存
+/// 按照 (头像的 key, 显示尺寸, 设备像素比) 缓存已经缩放好并且裁剪了圆角的 pixmap.
+/// 会话列表, 消息列表, 好友列表等所有地方共用. 绘制头像时直接 drawPixmap, 不再每次缩放.
+/// key 由调用者通过 userKey / sessionKey 生成, 同一个用户在不同消息中的头像 (不同的 QIcon 对象) 也能命中缓存.
+////////////////////////////////////////////////////////
+class AvatarCache : public QObject
+{
+    Q_OBJECT
+public:
+    static AvatarCache* getInstance();
+
+    static QString userKey(const QString& userId) {
+        return "user:" + userId;
+    }
+    static QString sessionKey(const QString& chatSessionId) {
+        return "session:" + chatSessionId;
+    }
+
+    // 获取 size 尺寸 (逻辑像素) 的头像. 返回的 pixmap 已经设置好了 devicePixelRatio
+    QPixmap pixmap(const QString& key, const QIcon& avatar, int size, qreal dpr);
+    // 在 rect 中绘制头像. rect 为正方形.
+    void paint(QPainter* painter, const QRect& rect, const QString& key, const QIcon& avatar);
+    // 给按钮使用的图标. 只包含 size 尺寸的一张图片, 按钮绘制时不需要再缩放.
+    QIcon icon(const QString& key, const QIcon& avatar, int size);
+
+    // 头像可能变化之后 (获取个人信息, 修改头像, 刷新好友列表和会话列表), 清除缓存
+    void clear();
+
+private:
+    static AvatarCache* instance;
+    explicit AvatarCache(QObject* parent = nullptr);
+
+    static QString cacheKey(const QString& key, int size, qreal dpr);
+
+    QCache<QString, QPixmap> cache;
+};
+
+#endif // AVATARCACHE_H
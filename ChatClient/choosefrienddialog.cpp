@@ -1,100 +1,181 @@
 #include "choosefrienddialog.h"
 
 #include <QHBoxLayout>
-#include <QScrollArea>
 #include <QScrollBar>
 #include <QPushButton>
 #include <QPainter>
+#include <QLabel>
 
 #include "model/datacenter.h"
 
 #include "toast.h"
+#include "theme.h"
+#include "avatarcache.h"
 #include "debug.h"
 
 using namespace model;
 
+// 好友项的尺寸
+static const int ITEM_HEIGHT = 50;
+static const int MARGIN_LEFT = 20;
+static const int MARGIN_RIGHT = 20;
+static const int SPACING = 10;
+static const int CHECK_BOX_SIZE = 25;
+static const int CHECK_IMAGE_SIZE = 20;
+static const int AVATAR_SIZE = 40;
+
+// 输入停顿这么久之后, 才按照关键词过滤
+static const int SEARCH_DELAY_MS = 150;
+
 ////////////////////////////////////////////////
-/// 选择好友窗口中的一个 元素/好友项
+/// 选择好友窗口的数据模型
 ////////////////////////////////////////////////
 
-ChooseFriendItem::ChooseFriendItem(ChooseFriendDialog* owner, const QString& userId, const QIcon &avatar, const QString &name, bool checked)
-    : userId(userId)
+ChooseFriendModel::ChooseFriendModel(QObject *parent)
+    : QAbstractListModel(parent)
 {
-    // 1. 设置控件的基本属性
-    this->setFixedHeight(50);
-    this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
 
-    // 2. 设置布局管理器
-    QHBoxLayout* layout = new QHBoxLayout();
-    layout->setSpacing(10);
-    layout->setContentsMargins(20, 0, 20, 0);
-    this->setLayout(layout);
+}
 
-    // 3. 创建复选框
-    checkBox = new QCheckBox();
-    checkBox->setChecked(checked);
-    checkBox->setFixedSize(25, 25);
-    QString style = "QCheckBox { background-color: transparent; } QCheckBox::indicator { width: 20px; height: 20px; image: url(:/resource/image/unchecked.png);}";
-    style += "QCheckBox::indicator:checked { image: url(:/resource/image/checked.png);}";
-    checkBox->setStyleSheet(style);
-
-    // 4. 创建头像
-    avatarBtn = new QPushButton();
-    avatarBtn->setFixedSize(40, 40);
-    avatarBtn->setIconSize(QSize(40, 40));
-    avatarBtn->setIcon(avatar);
-
-    // 5. 创建名字
-    nameLabel = new QLabel();
-    nameLabel->setText(name);
-    nameLabel->setStyleSheet("QLabel {background-color: transparent;}");
-
-    // 6. 添加上述内容到布局管理器中
-    layout->addWidget(checkBox);
-    layout->addWidget(avatarBtn);
-    layout->addWidget(nameLabel);
-
-    // 7. 连接信号槽
-    connect(checkBox, &QCheckBox::toggled, this, [=](bool checked) {
-        if (checked) {
-            // 勾选了复选框, 把当前这个 Item, 添加到右侧的已选择区域
-            owner->addSelectedFriend(userId, avatar, name);
-        } else {
-            // 取消勾选
-            owner->deleteSelectedFriend(userId);
+int ChooseFriendModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return rows.size();
+}
+
+QVariant ChooseFriendModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QVariant();
+    }
+    const FriendRow& row = rows[index.row()];
+    switch (role) {
+    case Qt::DisplayRole:
+        return row.name;
+    case Qt::DecorationRole:
+        return row.avatar;
+    case Qt::CheckStateRole:
+        return checkedIds.contains(row.userId) ? Qt::Checked : Qt::Unchecked;
+    case IdRole:
+        return row.userId;
+    default:
+        return QVariant();
+    }
+}
+
+void ChooseFriendModel::resetFriends(const QList<UserInfo> &friendList, const QString &checkedUserId)
+{
+    // 一次性替换, 只通知一次 view. 好友很多时, 不会逐个插入.
+    beginResetModel();
+    rows.clear();
+    rowIndex.clear();
+    checkedIds.clear();
+    rows.reserve(friendList.size());
+    for (const auto& f : friendList) {
+        rowIndex.insert(f.userId, rows.size());
+        rows.push_back(FriendRow{f.userId, f.avatar, f.nickname});
+        if (f.userId == checkedUserId) {
+            checkedIds.insert(f.userId);
         }
-    });
+    }
+    endResetModel();
 }
 
-void ChooseFriendItem::paintEvent(QPaintEvent *event)
+void ChooseFriendModel::toggle(int row)
 {
-    (void) event;
-    // 根据鼠标的进入状态, 来决定绘制成不同的颜色
-    QPainter painter(this);
-    if (isHover) {
-        // 绘制成深色
-        painter.fillRect(this->rect(), QColor(230, 230, 230));
+    if (row < 0 || row >= rows.size()) {
+        return;
+    }
+    const QString& userId = rows[row].userId;
+    if (checkedIds.contains(userId)) {
+        checkedIds.remove(userId);
     } else {
-        // 绘制成浅色
-        painter.fillRect(this->rect(), QColor(255, 255, 255));
+        checkedIds.insert(userId);
     }
+    QModelIndex idx = this->index(row);
+    emit dataChanged(idx, idx, {Qt::CheckStateRole});
 }
 
-void ChooseFriendItem::enterEvent(QEnterEvent *event)
+QList<QString> ChooseFriendModel::checkedUserIds() const
 {
-    (void) event;
-    isHover = true;
-    // update 相当于 "更新界面"
-    this->update();
-    // 或者使用下列代码
-    // this->repaint();
+    QList<QString> result;
+    result.reserve(checkedIds.size());
+    for (const auto& row : rows) {
+        if (checkedIds.contains(row.userId)) {
+            result.push_back(row.userId);
+        }
+    }
+    return result;
 }
 
-void ChooseFriendItem::leaveEvent(QEvent *event)
+////////////////////////////////////////////////
+/// 右侧只显示勾选了的好友
+////////////////////////////////////////////////
+
+CheckedFriendFilter::CheckedFriendFilter(QObject *parent)
+    : QSortFilterProxyModel(parent)
+{
+    // 勾选状态变化时, 只重新判定变化的那一行
+    this->setDynamicSortFilter(true);
+}
+
+bool CheckedFriendFilter::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
+    return index.data(Qt::CheckStateRole).toInt() == Qt::Checked;
+}
+
+////////////////////////////////////////////////
+/// 绘制一个好友项
+////////////////////////////////////////////////
+
+ChooseFriendDelegate::ChooseFriendDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+    checkedImage = QPixmap(":/resource/image/checked.png");
+    uncheckedImage = QPixmap(":/resource/image/unchecked.png");
+}
+
+void ChooseFriendDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const QRect& rect = option.rect;
+    painter->save();
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+
+    // 1. 根据鼠标的进入状态, 来决定绘制成不同的颜色
+    painter->fillRect(rect, (option.state & QStyle::State_MouseOver) ? theme::CHOOSE_ITEM_HOVER : theme::CHOOSE_ITEM_BACKGROUND);
+
+    // 2. 复选框
+    bool checked = index.data(Qt::CheckStateRole).toInt() == Qt::Checked;
+    int checkLeft = rect.left() + MARGIN_LEFT + (CHECK_BOX_SIZE - CHECK_IMAGE_SIZE) / 2;
+    QRect checkRect(checkLeft, rect.top() + (ITEM_HEIGHT - CHECK_IMAGE_SIZE) / 2, CHECK_IMAGE_SIZE, CHECK_IMAGE_SIZE);
+    painter->drawPixmap(checkRect, checked ? checkedImage : uncheckedImage);
+
+    // 3. 头像
+    QIcon avatar = index.data(Qt::DecorationRole).value<QIcon>();
+    QRect avatarRect(rect.left() + MARGIN_LEFT + CHECK_BOX_SIZE + SPACING, rect.top() + (ITEM_HEIGHT - AVATAR_SIZE) / 2,
+                     AVATAR_SIZE, AVATAR_SIZE);
+    QString avatarKey = AvatarCache::userKey(index.data(ChooseFriendModel::IdRole).toString());
+    AvatarCache::getInstance()->paint(painter, avatarRect, avatarKey, avatar);
+
+    // 4. 名字
+    int textLeft = avatarRect.right() + 1 + SPACING;
+    int textWidth = rect.right() + 1 - MARGIN_RIGHT - textLeft;
+    QRect nameRect(textLeft, rect.top(), textWidth, ITEM_HEIGHT);
+    painter->setFont(option.font);
+    painter->setPen(option.palette.color(QPalette::WindowText));
+    painter->drawText(nameRect, Qt::AlignLeft | Qt::AlignVCenter,
+                      option.fontMetrics.elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideRight, textWidth));
+
+    painter->restore();
+}
+
+QSize ChooseFriendDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
 {
-    (void) event;
-    isHover =  false;
-    this->update();
+    (void) index;
+    return QSize(option.rect.width(), ITEM_HEIGHT);
 }
 
 ////////////////////////////////////////////////
@@ -109,54 +190,87 @@ ChooseFriendDialog::ChooseFriendDialog(QWidget* parent, const QString& userId) :
     this->setStyleSheet("QDialog { background-color: rgb(255, 255, 255);}");
     this->setAttribute(Qt::WA_DeleteOnClose);
 
-    // 2. 创建布局管理器
+    // 2. 创建 model. 两侧共用同一个 model, 各自通过 proxy 过滤.
+    friendModel = new ChooseFriendModel(this);
+    searchFilter = new QSortFilterProxyModel(this);
+    searchFilter->setSourceModel(friendModel);
+    searchFilter->setFilterRole(Qt::DisplayRole);
+    searchFilter->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    checkedFilter = new CheckedFriendFilter(this);
+    checkedFilter->setSourceModel(friendModel);
+
+    // 3. 创建布局管理器
     QHBoxLayout* layout = new QHBoxLayout();
     layout->setContentsMargins(0, 0, 0, 0);
     layout->setSpacing(0);
     this->setLayout(layout);
 
-    // 3. 针对左侧窗口进行初始化
+    // 4. 针对左侧窗口进行初始化
     initLeft(layout);
 
-    // 4. 针对右侧窗口进行初始化
+    // 5. 针对右侧窗口进行初始化
     initRight(layout);
 
-    // 5. 加载数据到窗口中
+    // 6. 加载数据到窗口中
     initData();
 }
 
+QListView *ChooseFriendDialog::createListView()
+{
+    QListView* listView = new QListView();
+    listView->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    listView->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    listView->setSelectionMode(QAbstractItemView::NoSelection);
+    listView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    listView->setFocusPolicy(Qt::NoFocus);
+    listView->setMouseTracking(true);
+    // 每一项的高度都相同, 布局时不需要逐个计算尺寸, 好友很多时也只处理可见的行
+    listView->setUniformItemSizes(true);
+    listView->setItemDelegate(new ChooseFriendDelegate(listView));
+    listView->verticalScrollBar()->setStyleSheet("QScrollBar:vertical { width: 2px; background-color: rgb(255, 255, 255) }");
+    listView->setStyleSheet("QListView { border:none; background-color: rgb(255, 255, 255); }");
+    return listView;
+}
+
+void ChooseFriendDialog::clickFriend(const QSortFilterProxyModel *proxy, const QModelIndex &index)
+{
+    if (!index.isValid()) {
+        return;
+    }
+    friendModel->toggle(proxy->mapToSource(index).row());
+}
+
 void ChooseFriendDialog::initLeft(QHBoxLayout *layout)
 {
-    // 1. 创建滚动区域
-    QScrollArea* scrollArea = new QScrollArea();
-    scrollArea->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-    scrollArea->setWidgetResizable(true);
-    scrollArea->horizontalScrollBar()->setStyleSheet("QScrollBar:horizontal { height: 0px;}");
-    scrollArea->verticalScrollBar()->setStyleSheet("QScrollBar:vertical { width: 2px; background-color: rgb(255, 255, 255) }");
-    scrollArea->setStyleSheet("QScrollArea { border:none; }");
-    layout->addWidget(scrollArea, 1);
-
-    // 2. 创建 QWidget 设置到滚动区域中.
-    totalContainer = new QWidget();
-    totalContainer->setObjectName("totalContainer");
-    totalContainer->setStyleSheet("#totalContainer { background-color: rgb(255, 255, 255); }");
-    scrollArea->setWidget(totalContainer);
-
-    // 3. 创建左侧子窗口内部的 垂直布局管理器
+    // 1. 左侧整体是一个垂直布局: 上方是搜索框, 下方是全部好友列表
     QVBoxLayout* vlayout = new QVBoxLayout();
-    vlayout->setSpacing(0);
-    vlayout->setContentsMargins(0, 0, 0, 0);
-    vlayout->setAlignment(Qt::AlignTop);
-    totalContainer->setLayout(vlayout);
+    vlayout->setSpacing(10);
+    vlayout->setContentsMargins(0, 20, 0, 0);
+    layout->addLayout(vlayout, 1);
+
+    // 2. 创建搜索框
+    searchEdit = new QLineEdit();
+    searchEdit->setFixedHeight(30);
+    searchEdit->setPlaceholderText("搜索");
+    searchEdit->setStyleSheet("QLineEdit { border: none; border-radius: 5px; background-color: rgb(240, 240, 240); padding-left: 5px; margin-left: 20px; margin-right: 20px; }");
+    vlayout->addWidget(searchEdit);
+
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    connect(searchEdit, &QLineEdit::textChanged, this, [=]() {
+        searchTimer->start(SEARCH_DELAY_MS);
+    });
+    connect(searchTimer, &QTimer::timeout, this, [=]() {
+        searchFilter->setFilterFixedString(searchEdit->text().trimmed());
+    });
 
-    // 还需要进一步的添加 vlayout 内部的元素, 才能看到效果!
-    // 此处也是先构造测试数据, 后续接入服务器之后, 从服务器拿到真实的好友列表, 再添加真实的数据
-#if TEST_UI
-    QIcon defaultAvatar(":/resource/image/defaultAvatar.png");
-    for (int i = 0; i < 30; ++i) {
-        this->addFriend(QString::number(1000 + i), defaultAvatar, "张三" + QString::number(i), false);
-    }
-#endif
+    // 3. 创建全部好友列表
+    QListView* listView = createListView();
+    listView->setModel(searchFilter);
+    vlayout->addWidget(listView);
+    connect(listView, &QListView::clicked, this, [=](const QModelIndex& index) {
+        clickFriend(searchFilter, index);
+    });
 }
 
 void ChooseFriendDialog::initRight(QHBoxLayout *layout)
@@ -175,28 +289,14 @@ void ChooseFriendDialog::initRight(QHBoxLayout *layout)
     tipLabel->setAlignment(Qt::AlignLeft | Qt::AlignVCenter);
     tipLabel->setStyleSheet("QLabel { font-size: 16px; font-weight: 700}");
 
-    // 3. 创建滚动区域
-    QScrollArea* scrollArea = new QScrollArea();
-    scrollArea->setWidgetResizable(true);
-    scrollArea->verticalScrollBar()->setStyleSheet("QScrollBar:vertical { width: 2px; background-color: rgb(255, 255, 255);}");
-    scrollArea->horizontalScrollBar()->setStyleSheet("QScrollBar:horizontal {height: 0px;}");
-    scrollArea->setStyleSheet("QScrollArea {border: none;}");
-    scrollArea->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-
-    // 4. 创建滚动区域中的 QWidget
-    selectedContainer = new QWidget();
-    selectedContainer->setObjectName("selectedContainer");
-    selectedContainer->setStyleSheet("#selectedContainer { background-color: rgb(255, 255, 255); }");
-    scrollArea->setWidget(selectedContainer);
-
-    // 5. 创建 selectedContainer 中的 "垂直布局"
-    QVBoxLayout* vlayout = new QVBoxLayout();
-    vlayout->setSpacing(0);
-    vlayout->setContentsMargins(0, 0, 0, 0);
-    vlayout->setAlignment(Qt::AlignTop);
-    selectedContainer->setLayout(vlayout);
+    // 3. 创建已选好友列表. 点击其中的好友, 取消勾选.
+    QListView* listView = createListView();
+    listView->setModel(checkedFilter);
+    connect(listView, &QListView::clicked, this, [=](const QModelIndex& index) {
+        clickFriend(checkedFilter, index);
+    });
 
-    // 6. 创建底部按钮
+    // 4. 创建底部按钮
     QString style = "QPushButton { color: rgb(7, 191, 96); background-color: rgb(240, 240, 240); border: none; border-radius: 5px;}";
     style += "QPushButton:hover { background-color: rgb(220, 220, 220); } QPushButton:pressed { background-color: rgb(200, 200, 200); }";
 
@@ -212,22 +312,13 @@ void ChooseFriendDialog::initRight(QHBoxLayout *layout)
     cancelBtn->setText("取消");
     cancelBtn->setStyleSheet(style);
 
-    // 7. 把上述控件添加到布局中
+    // 5. 把上述控件添加到布局中
     gridLayout->addWidget(tipLabel, 0, 0, 1, 9);
-    gridLayout->addWidget(scrollArea, 1, 0, 1, 9);
+    gridLayout->addWidget(listView, 1, 0, 1, 9);
     gridLayout->addWidget(okBtn, 2, 1, 1, 3);
     gridLayout->addWidget(cancelBtn, 2, 5, 1, 3);
 
-    // 构造一些数据用来进行测试界面
-#if 0
-    // 此处的数据通过勾选左侧列表来生成.
-    QIcon defaultAvatar(":/resource/image/defaultAvatar.png");
-    for (int i = 0; i < 10; ++i) {
-        this->addSelectedFriend(QString::number(1000 + i), defaultAvatar, "张三" + QString::number(i));
-    }
-#endif
-
-    // 8. 添加信号槽, 处理 ok 和 cancel 的点击
+    // 6. 添加信号槽, 处理 ok 和 cancel 的点击
     connect(okBtn, &QPushButton::clicked, this, &ChooseFriendDialog::clickOkBtn);
     connect(cancelBtn, &QPushButton::clicked, this, [=]() {
         this->close();
@@ -263,93 +354,33 @@ QList<QString> ChooseFriendDialog::generateMemberList()
     }
     result.push_back(dataCenter->getMyself()->userId);
 
-    // 2. 遍历选中的列表
-    QVBoxLayout* layout = dynamic_cast<QVBoxLayout*>(selectedContainer->layout());
-    for (int i = 0; i < layout->count(); ++i) {
-        auto* item = layout->itemAt(i);
-        if (item == nullptr || item->widget() == nullptr) {
-            continue;
-        }
-        auto* chooseFriendItem = dynamic_cast<ChooseFriendItem*>(item->widget());
-        result.push_back(chooseFriendItem->getUserId());
-    }
+    // 2. 所有勾选的好友
+    result.append(friendModel->checkedUserIds());
     return result;
 }
 
 void ChooseFriendDialog::initData()
 {
-    // 遍历 好友列表, 把好友列表中的所有的元素, 添加到这个窗口界面上.
+    // 此处也是先构造测试数据, 后续接入服务器之后, 从服务器拿到真实的好友列表, 再添加真实的数据
+#if TEST_UI
+    QList<UserInfo> testList;
+    for (int i = 0; i < 30; ++i) {
+        UserInfo userInfo;
+        userInfo.userId = QString::number(1000 + i);
+        userInfo.nickname = "张三" + QString::number(i);
+        userInfo.avatar = QIcon(":/resource/image/defaultAvatar.png");
+        testList.push_back(userInfo);
+    }
+    friendModel->resetFriends(testList, this->userId);
+    return;
+#endif
+
+    // 把好友列表中的所有的元素, 一次性设置到 model 中. 弹出窗口的这个好友, 初始就是勾选的.
     DataCenter* dataCenter = DataCenter::getInstance();
     QList<UserInfo>* friendList = dataCenter->getFriendList();
     if (friendList == nullptr) {
         LOG() << "加载数据时发现好友列表为空!";
         return;
     }
-    for (auto it = friendList->begin(); it != friendList->end(); ++it) {
-        if (it->userId == this->userId) {
-            this->addSelectedFriend(it->userId, it->avatar, it->nickname);
-            this->addFriend(it->userId, it->avatar, it->nickname, true);
-        } else {
-            this->addFriend(it->userId, it->avatar, it->nickname, false);
-        }
-    }
+    friendModel->resetFriends(*friendList, this->userId);
 }
-
-void ChooseFriendDialog::addFriend(const QString& userId, const QIcon &avatar, const QString &name, bool checked)
-{
-    ChooseFriendItem* item = new ChooseFriendItem(this, userId, avatar, name, checked);
-    totalContainer->layout()->addWidget(item);
-}
-
-void ChooseFriendDialog::addSelectedFriend(const QString& userId, const QIcon &avatar, const QString &name)
-{
-    ChooseFriendItem* item = new ChooseFriendItem(this, userId, avatar, name, true);
-    selectedContainer->layout()->addWidget(item);
-}
-
-void ChooseFriendDialog::deleteSelectedFriend(const QString &userId)
-{
-    // 遍历 selectedContainer 中的每个 Item, 对比每个 Item 里的 userId , 是否是要删除的 userId.
-    QVBoxLayout* vlayout = dynamic_cast<QVBoxLayout*>(selectedContainer->layout());
-    // 由于是要 "遍历" + "删除" 需要从后往前进行
-    for (int i = vlayout->count() - 1; i >= 0; --i) {
-        auto* item = vlayout->itemAt(i);
-        if (item == nullptr || item->widget() == nullptr) {
-            continue;
-        }
-        ChooseFriendItem* chooseFriendItem = dynamic_cast<ChooseFriendItem*>(item->widget());
-        // 判定当前的 Item 的 userId 是否是要删除的 userId
-        if (chooseFriendItem->getUserId() != userId) {
-            continue;
-        }
-        vlayout->removeWidget(chooseFriendItem);
-        // 此处直接使用 delete 可能导致程序直接崩溃. 因为 delete 该对象的时候, 该对象内部的 QCheckBox 还在使用中 (触发着信号槽呢)
-        // 改成 deleteLater, 就相当于把 delete 操作委托给 Qt 自身来完成了. 告诉 Qt 框架说, 你要删除这个对象. 至于啥时候删除 Qt
-        // 会确保在 Qt 自身用完了之后, 去真正删除.
-        // delete chooseFriendItem;
-        chooseFriendItem->deleteLater();
-    }
-
-    // 再遍历一下左侧列表, 把左侧列表中对应 item 的 checkBox 勾选状态取消掉.
-    QVBoxLayout* vlayoutLeft = dynamic_cast<QVBoxLayout*>(totalContainer->layout());
-    for (int i = 0; i < vlayoutLeft->count(); ++i) {
-        auto* item = vlayoutLeft->itemAt(i);
-        if (item == nullptr || item->widget() == nullptr) {
-            continue;
-        }
-        ChooseFriendItem* chooseFriendItem = dynamic_cast<ChooseFriendItem*>(item->widget());
-        if (chooseFriendItem->getUserId() != userId) {
-            continue;
-        }
-        // 取消 checkBox 选中状态
-        chooseFriendItem->getCheckBox()->setChecked(false);
-    }
-}
-
-
-
-
-
-
-
-
@@ -4,41 +4,83 @@
 #include <QDialog>
 #include <QWidget>
 #include <QHBoxLayout>
-#include <QCheckBox>
-#include <QLabel>
+#include <QListView>
+#include <QLineEdit>
+#include <QTimer>
+#include <QAbstractListModel>
+#include <QSortFilterProxyModel>
+#include <QStyledItemDelegate>
+#include <QIcon>
+#include <QHash>
+#include <QSet>
+
+#include "model/data.h"
 
 ////////////////////////////////////////////////
-/// 选择好友窗口中的一个 元素/好友项
+/// 选择好友窗口的数据模型
+/// 左侧的全部好友和右侧的已选好友, 使用同一个 model, 勾选状态保存在 QSet 中.
+/// 勾选/取消勾选只修改一行, 不需要遍历任何一侧的列表.
 ////////////////////////////////////////////////
 
-class ChooseFriendDialog;
-
-class ChooseFriendItem : public QWidget {
-Q_OBJECT
+class ChooseFriendModel : public QAbstractListModel {
+    Q_OBJECT
 public:
-    ChooseFriendItem(ChooseFriendDialog* owner, const QString& userId, const QIcon& avatar, const QString& name, bool checked);
+    enum Role {
+        IdRole = Qt::UserRole + 1,
+    };
 
-    void paintEvent(QPaintEvent* event) override;
-    void enterEvent(QEnterEvent* event) override;
-    void leaveEvent(QEvent* event) override;
+    explicit ChooseFriendModel(QObject* parent = nullptr);
 
-    const QString& getUserId() const {
-        return userId;
-    }
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
 
-    QCheckBox* getCheckBox() {
-        return checkBox;
-    }
+    // 整体替换好友列表. checkedUserId 对应的好友初始就是勾选的.
+    void resetFriends(const QList<model::UserInfo>& friendList, const QString& checkedUserId);
+    // 切换某一行的勾选状态
+    void toggle(int row);
+    // 所有勾选的好友, 按照好友列表的顺序
+    QList<QString> checkedUserIds() const;
 
 private:
-    bool isHover = false;
+    struct FriendRow {
+        QString userId;
+        QIcon avatar;
+        QString name;
+    };
+    QList<FriendRow> rows;
+    // key 为 userId, value 为所在的行
+    QHash<QString, int> rowIndex;
+    QSet<QString> checkedIds;
+};
+
+////////////////////////////////////////////////
+/// 右侧只显示勾选了的好友
+////////////////////////////////////////////////
+
+class CheckedFriendFilter : public QSortFilterProxyModel {
+    Q_OBJECT
+public:
+    explicit CheckedFriendFilter(QObject* parent = nullptr);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
+};
+
+////////////////////////////////////////////////
+/// 绘制一个好友项: 复选框, 头像, 名字
+////////////////////////////////////////////////
+
+class ChooseFriendDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    explicit ChooseFriendDelegate(QObject* parent = nullptr);
 
-    QCheckBox* checkBox;
-    QPushButton* avatarBtn;
-    QLabel* nameLabel;
-    ChooseFriendDialog* owner;			// 记录了哪个 QWidget 持有了这个 Item. 此处的 QWidget 应该是一个 ChooseFriendDialog
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
 
-    QString userId;   					// 记录了当前 Item 对应的 userId 是啥.
+private:
+    QPixmap checkedImage;
+    QPixmap uncheckedImage;
 };
 
 ////////////////////////////////////////////////
@@ -58,16 +100,21 @@ public:
 
     void initData();
 
-    void addFriend(const QString& userId, const QIcon& avatar, const QString& name, bool checked);
-    void addSelectedFriend(const QString& userId, const QIcon& avatar, const QString& name);
-    void deleteSelectedFriend(const QString& userId);
-
-
 private:
-    // 保存左侧全部好友列表的 QWidget
-    QWidget* totalContainer;
-    // 保存右侧选中好友列表的 QWidget
-    QWidget* selectedContainer;
+    // 创建一个好友列表. 两侧的列表样式相同.
+    QListView* createListView();
+    // 点击某一行, 切换勾选状态. index 是 view 中 (过滤之后) 的下标
+    void clickFriend(const QSortFilterProxyModel* proxy, const QModelIndex& index);
+
+    ChooseFriendModel* friendModel;
+    // 左侧按照搜索框中的关键词过滤
+    QSortFilterProxyModel* searchFilter;
+    // 右侧只显示勾选的好友
+    CheckedFriendFilter* checkedFilter;
+
+    QLineEdit* searchEdit;
+    // 输入停顿之后再过滤, 连续输入时不会每个字符都过滤一遍
+    QTimer* searchTimer;
 
     // 当前选择窗口是点击哪个用户来弹出的.
     QString userId;
@@ -14,4 +14,17 @@
 // 是否部署
 #define DEPOLY 0
 
+// 启动时是否使用聚合接口 /service/sync/bootstrap 一次性获取初始数据.
+// 为 0 时, 个人信息 / 好友列表 / 会话列表 / 好友申请列表 四个请求并发发出.
+#define BOOTSTRAP_AGGREGATE 0
+
+// 是否启动性能监控 (卡顿检测和绘制耗时统计). Ctrl+Shift+P 显示浮层, Ctrl+Shift+D 写入 perf.json
+#define PERF_MONITOR 0
+
+// 启动时测量列表行控件的创建耗时 (每个控件单独设置样式表 vs 全局主题), 结果输出到日志
+#define TEST_THEME_BENCH 0
+
+// 启动时测量语音活动检测 (去掉录音中的静音) 在 10 分钟录音上的耗时, 结果输出到日志
+#define TEST_VAD_BENCH 0
+
 #endif // DEBUG_H
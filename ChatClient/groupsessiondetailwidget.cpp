@@ -129,7 +129,7 @@ void GroupSessionDetailWidget::initMembers(const QString& chatSessionId)
     }
     // 遍历成员列表
     for (const auto& u : *memberList) {
-        AvatarItem* avatarItem = new AvatarItem(u.avatar, u.nickname);
+        AvatarItem* avatarItem = new AvatarItem(u.avatar, u.nickname, u.userId);
         this->addMember(avatarItem);
     }
 
@@ -6,78 +6,101 @@
 #include <QPushButton>
 #include <QLabel>
 #include <QDateTimeEdit>
-#include <QScrollArea>
 #include <QScrollBar>
 #include <QFileDialog>
+#include <QMouseEvent>
+#include <QTimer>
 
 #include "model/datacenter.h"
 #include "soundrecorder.h"
+#include "imagepreviewdialog.h"
 #include "toast.h"
 #include "debug.h"
 
 using namespace model;
 
+// 距离底部不超过这么多像素时, 开始加载下一页
+static const int LOAD_MORE_DISTANCE = 200;
+
 ////////////////////////////////////////////////////////////////////
-/// 表示一个历史消息元素
+/// 历史消息结果列表
 ////////////////////////////////////////////////////////////////////
 
-HistoryItem *HistoryItem::makeHistoryItem(const Message &message)
+HistoryListView::HistoryListView()
 {
-    // 1. 创建出对象
-    HistoryItem* item = new HistoryItem();
-    item->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+    // 1. 初始化基本属性
+    this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    this->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    this->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    this->setSelectionMode(QAbstractItemView::NoSelection);
+    this->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    this->setFocusPolicy(Qt::NoFocus);
+    this->setUniformItemSizes(false);
+    this->setResizeMode(QListView::Adjust);
+    this->verticalScrollBar()->setStyleSheet("QScrollBar:vertical { width: 2px; background-color: rgb(255, 255, 255); }");
+    this->horizontalScrollBar()->setStyleSheet("QScrollBar:horizontal { height: 0; }");
+    this->setStyleSheet("QListView { border: none; }");
+
+    // 2. 创建 model 和 delegate
+    messageModel = new MessageListModel(this);
+    messageDelegate = new MessageItemDelegate(this);
+    this->setModel(messageModel);
+    this->setItemDelegate(messageDelegate);
+
+    // 图片下载完成之后, 这一行的高度会变化, 需要重新布局. 高度没有变化时只重绘, 不重新布局.
+    connect(messageModel, &QAbstractItemModel::dataChanged, this, [=](const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+        if (messageDelegate->updateSizeHints(topLeft.row(), bottomRight.row())) {
+            this->scheduleDelayedItemsLayout();
+        }
+    });
+    connect(messageModel, &QAbstractItemModel::modelReset, messageDelegate, &MessageItemDelegate::clearLayoutCache);
+}
 
-    // 2. 创建布局
-    QGridLayout* layout = new QGridLayout();
-    layout->setVerticalSpacing(0);
-    layout->setHorizontalSpacing(10);
-    layout->setContentsMargins(0, 0, 0, 0);
-    item->setLayout(layout);
-
-    // 3. 创建头像
-    QPushButton* avatarBtn = new QPushButton();
-    avatarBtn->setFixedSize(40, 40);
-    avatarBtn->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
-    avatarBtn->setIconSize(QSize(40, 40));
-    // 当前消息发送者的头像
-    avatarBtn->setIcon(message.sender.avatar);
-    avatarBtn->setStyleSheet("QPushButton { border: none; }");
-
-    // 4. 创建昵称和时间
-    QLabel* nameLabel = new QLabel();
-    nameLabel->setText(message.sender.nickname + " | " + message.time);
-    nameLabel->setFixedHeight(20);   // 高度设置为头像高度的一半
-    nameLabel->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
-
-    // 5. 消息内容部分
-    QWidget* contentWidget = nullptr;
+void HistoryListView::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) {
+        QListView::mousePressEvent(event);
+        return;
+    }
+    QModelIndex index = this->indexAt(event->pos());
+    if (!index.isValid()) {
+        return;
+    }
+    if (messageDelegate->contentRect(this->visualRect(index), index).contains(event->pos())) {
+        clickContent(index.row());
+    }
+}
+
+void HistoryListView::clickContent(int row)
+{
+    const Message& message = messageModel->messageAt(row);
     if (message.messageType == TEXT_TYPE) {
-        // 文本消息
-        QLabel* label = new QLabel();
-        label->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-        label->setWordWrap(true);
-        label->setText(QString(message.content));
-        label->adjustSize();	// 设置让 label 能够自动调整大小
-        contentWidget = label;
-    } else if (message.messageType == IMAGE_TYPE) {
-        // 图片消息
-        contentWidget = new ImageButton(message.fileId, message.content);
+        return;
+    }
+    if (message.messageType == SPEECH_TYPE) {
+        // 语音只有在播放的时候才下载, 下载完成之后直接播放
+        messageModel->fetchContent(row, [](const QByteArray& content) {
+            SoundRecorder::getInstance()->startPlay(content);
+        });
+        return;
+    }
+    if (message.content.isEmpty()) {
+        Toast::showMessage("数据尚未加载成功, 请稍后重试");
+        return;
+    }
+    if (message.messageType == IMAGE_TYPE) {
+        // 打开原图. 只有这个时候才会完整解码原图.
+        ImagePreviewDialog* dialog = new ImagePreviewDialog(message.content, this->window());
+        dialog->show();
     } else if (message.messageType == FILE_TYPE) {
-        // 文件消息
-        contentWidget = new FileLabel(message.fileId, message.fileName);
-    } else if (message.messageType == SPEECH_TYPE) {
-        // 语音消息
-        contentWidget = new SpeechLabel(message.fileId);
-    } else {
-        LOG() << "错误的消息类型! messageType=" << message.messageType;
+        // 弹出一个对话框, 让用户来选择当前要保存的位置
+        QString filePath = QFileDialog::getSaveFileName(this, "另存为", QDir::homePath(), "*");
+        if (filePath.isEmpty()) {
+            LOG() << "用户取消了保存";
+            return;
+        }
+        writeByteArrayToFile(filePath, message.content);
     }
-
-    // 6. 把上述控件添加到布局中
-    layout->addWidget(avatarBtn, 0, 0, 2, 1);
-    layout->addWidget(nameLabel, 0, 1, 1, 1);
-    layout->addWidget(contentWidget, 1, 1, 5, 1);
-
-    return item;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -144,8 +167,8 @@ HistoryMessageWidget::HistoryMessageWidget(QWidget* parent) : QDialog(parent) {
     begTimeEdit->hide();
     endTimeEdit->hide();
 
-    // 7. 创建滚动区域
-    initScrollArea(layout);
+    // 7. 创建结果列表
+    initListView(layout);
 
     // 8. 设置槽函数
     connect(keyRadioBtn, &QRadioButton::clicked, this, [=]() {
@@ -203,28 +226,20 @@ HistoryMessageWidget::HistoryMessageWidget(QWidget* parent) : QDialog(parent) {
 
 void HistoryMessageWidget::addHistoryMessage(const Message &message)
 {
-    HistoryItem* item = HistoryItem::makeHistoryItem(message);
-    container->layout()->addWidget(item);
+    // 历史消息统一显示在左侧
+    listView->getModel()->appendMessage(true, message);
 }
 
 void HistoryMessageWidget::clear()
 {
-    QVBoxLayout* layout = dynamic_cast<QVBoxLayout*>(container->layout());
-    for (int i = layout->count() - 1; i >= 0; --i) {
-        // 之前使用的是 takeAt. 效果和这个是一样的.
-        QWidget* w = layout->itemAt(i)->widget();
-        if (w == nullptr) {
-            continue;
-        }
-        layout->removeWidget(w);
-        w->deleteLater();
-    }
+    listView->getModel()->clear();
 }
 
 void HistoryMessageWidget::clickSearchBtn()
 {
     DataCenter* dataCenter = DataCenter::getInstance();
     connect(dataCenter, &DataCenter::searchMessageDone, this, &HistoryMessageWidget::clickSearchBtnDone, Qt::UniqueConnection);
+    connect(dataCenter, &DataCenter::searchMessageFailed, this, &HistoryMessageWidget::clickSearchBtnFailed, Qt::UniqueConnection);
 
     // 此处需要根据单选框的选中情况, 执行不同的逻辑.
     if (keyRadioBtn->isChecked()) {
@@ -235,6 +250,7 @@ void HistoryMessageWidget::clickSearchBtn()
             return;
         }
         dataCenter->searchMessageAsync(searchKey);
+        loadingPage = true;
     } else {
         // 按照时间搜索
         auto begTime = begTimeEdit->dateTime();
@@ -244,11 +260,14 @@ void HistoryMessageWidget::clickSearchBtn()
             return;
         }
         dataCenter->searchMessageByTimeAsync(begTime, endTime);
+        loadingPage = true;
     }
 }
 
-void HistoryMessageWidget::clickSearchBtnDone()
+void HistoryMessageWidget::clickSearchBtnDone(int pageOffset)
 {
+    loadingPage = false;
+
     // 1. 从 DataCenter 中拿到消息搜索的结果列表
     DataCenter* dataCenter = DataCenter::getInstance();
     QList<Message>* messageResult = dataCenter->getSearchMessageResult();
@@ -256,183 +275,52 @@ void HistoryMessageWidget::clickSearchBtnDone()
         return;
     }
 
-    // 2. 把结果列表的数据, 显示到界面上
-    this->clear();
-
-    for (const Message& m : *messageResult) {
-        this->addHistoryMessage(m);
+    // 2. 新的搜索替换之前的结果, 后续的页追加到末尾. 历史消息统一显示在左侧.
+    if (pageOffset == 0) {
+        this->clear();
     }
-}
+    //    一页只插入一次, 只触发一次插入通知. myselfUserId 传空, 所有消息都显示在左侧.
+    MessageListModel* model = listView->getModel();
+    model->insertMessages(model->rowCount(), messageResult->mid(model->rowCount()), "");
 
-void HistoryMessageWidget::initScrollArea(QGridLayout *layout)
-{
-    // 1. 创建滚动区域对象
-    QScrollArea* scrollArea = new QScrollArea();
-    scrollArea->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-    scrollArea->setWidgetResizable(true);
-    scrollArea->verticalScrollBar()->setStyleSheet("QScrollBar:vertical { width: 2px; background-color: rgb(255, 255, 255); }");
-    scrollArea->horizontalScrollBar()->setStyleSheet("QScrollBar:horizontal { height: 0; }");
-    scrollArea->setStyleSheet("QScrollArea { border: none; }");
-
-    // 2. 创建 QWidget, 持有要加入的新的内容
-    container = new QWidget();
-    scrollArea->setWidget(container);
-
-    // 3. 创建 container 中的布局管理器.
-    QVBoxLayout* vlayout = new QVBoxLayout();
-    vlayout->setSpacing(10);
-    vlayout->setContentsMargins(0, 0, 0, 0);
-    vlayout->setAlignment(Qt::AlignTop);
-    container->setLayout(vlayout);
-
-    // 4. 把滚动区加入到整个 layout 中
-    layout->addWidget(scrollArea, 2, 0, 1, 9);
-}
-
-////////////////////////////////////////////////////////////////////
-/// 展示图片历史消息
-////////////////////////////////////////////////////////////////////
-
-ImageButton::ImageButton(const QString &fileId, const QByteArray &content) : fileId(fileId)
-{
-    this->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
-    this->setStyleSheet("QPushButton { border: none; }");
+    LOG() << "历史消息加载完成 pageOffset=" << pageOffset << ", 当前数目=" << model->rowCount();
 
-    if (!content.isEmpty()) {
-        // 直接显示到界面上
-        this->updateUI(fileId, content);
-    } else {
-        // 通过网络来获取
-        DataCenter* dataCenter = DataCenter::getInstance();
-        connect(dataCenter, &DataCenter::getSingleFileDone, this, &ImageButton::updateUI);
-        dataCenter->getSingleFileAsync(fileId);
-    }
+    // 3. 结果不足一屏时, 滚动范围不会变化, 也不会有滚动, 需要主动检查一次是否加载下一页
+    QTimer::singleShot(0, this, &HistoryMessageWidget::loadMoreIfNeeded);
 }
 
-// 真实的绘制界面
-void ImageButton::updateUI(const QString &fileId, const QByteArray &content)
+void HistoryMessageWidget::clickSearchBtnFailed(int pageOffset, const QString& reason)
 {
-    if (this->fileId != fileId) {
-        return;
-    }
-    // 如果图片尺寸太大, 需要进行缩放.
-    QImage image;
-    image.loadFromData(content);
-
-    int width = image.width();
-    int height = image.height();
-    if (image.width() >= 300) {
-        // 进行缩放, 缩放之后, 宽度就是固定的 300
-        width = 300;
-        height = ((double)image.height() / image.width()) * width;
-    }
-    this->resize(width, height);
-    this->setIconSize(QSize(width, height));
-    QPixmap pixmap = QPixmap::fromImage(image);
-    this->setIcon(QIcon(pixmap));
+    // 这一页加载失败, 允许再次加载 (重新搜索, 或者再次滚动到底部)
+    loadingPage = false;
+    LOG() << "历史消息加载失败 pageOffset=" << pageOffset << ", reason=" << reason;
+    Toast::showMessage("历史消息加载失败, 请稍后重试");
 }
 
-////////////////////////////////////////////////////////////////////
-/// 展示文件历史消息
-////////////////////////////////////////////////////////////////////
-
-FileLabel::FileLabel(const QString &fileId, const QString &fileName)
-    : fileId(fileId), fileName(fileName)
+void HistoryMessageWidget::loadMoreIfNeeded()
 {
-    this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-    this->setText("[文件] " + fileName);
-    this->setWordWrap(true);
-    // 自动调整尺寸让能够显示下文字内容
-    this->adjustSize();
-    this->setAlignment(Qt::AlignTop | Qt::AlignLeft);
-
-    // if (!content.isEmpty()) {
-    //     // 原则上来说, 这个条件不会触发. 因为这里的 content 是来自于请求服务器的 历史消息列表的 接口.
-    //     // 请求这个接口的过程中, 拿到的 Message 对象(不是文本), content 必然为 空, 通过 fileId 做二次请求.
-    //     return;
-    // }
-
-    // 需要从网络加载数据了
     DataCenter* dataCenter = DataCenter::getInstance();
-    connect(dataCenter, &DataCenter::getSingleFileDone, this, &FileLabel::getContentDone);
-    dataCenter->getSingleFileAsync(this->fileId);
-}
-
-void FileLabel::getContentDone(const QString &fileId, const QByteArray &fileContent)
-{
-    if (fileId != this->fileId) {
+    if (loadingPage || !dataCenter->hasMoreSearchMessage() || listView->getModel()->rowCount() == 0) {
         return;
     }
-
-    this->content = fileContent;
-    this->loadDone = true;
-}
-
-void FileLabel::mousePressEvent(QMouseEvent *event)
-{
-    (void) event;
-    if (!this->loadDone) {
-        // 说明数据还没准备好.
-        Toast::showMessage("文件内容加载中, 请稍后尝试!");
+    QScrollBar* scrollBar = listView->verticalScrollBar();
+    if (scrollBar->maximum() - scrollBar->value() > LOAD_MORE_DISTANCE) {
         return;
     }
-
-    // 弹出一个对话框, 让用户来选择当前要保存的位置
-    QString filePath = QFileDialog::getSaveFileName(this, "另存为", QDir::homePath(), "*");
-    if (filePath.isEmpty()) {
-        // 用户取消了保存
-        LOG() << "用户取消了保存";
-        return;
-    }
-
-    writeByteArrayToFile(filePath, content);
+    loadingPage = true;
+    dataCenter->searchMessageMoreAsync();
 }
 
-////////////////////////////////////////////////////////////////////
-/// 展示语音历史消息
-////////////////////////////////////////////////////////////////////
-
-SpeechLabel::SpeechLabel(const QString &fileId) : fileId(fileId)
+void HistoryMessageWidget::initListView(QGridLayout *layout)
 {
-    this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-    this->setText("[语音]");
-    this->setAlignment(Qt::AlignLeft | Qt::AlignTop);
-    // 这两个操作不太需要了. 此处只有 语音 两个字
-    this->setWordWrap(true);
-    this->adjustSize();
+    // 1. 创建结果列表
+    listView = new HistoryListView();
 
-    DataCenter* dataCenter = DataCenter::getInstance();
-    connect(dataCenter, &DataCenter::getSingleFileDone, this, &SpeechLabel::getContentDone);
-    dataCenter->getSingleFileAsync(fileId);
-}
-
-void SpeechLabel::getContentDone(const QString &fileId, const QByteArray &content)
-{
-    if (fileId != this->fileId) {
-        return;
-    }
-    this->content = content;
-    this->loadDone = true;
-}
+    // 2. 滚动到接近底部, 或者结果不足一屏时, 加载下一页
+    QScrollBar* scrollBar = listView->verticalScrollBar();
+    connect(scrollBar, &QScrollBar::valueChanged, this, &HistoryMessageWidget::loadMoreIfNeeded);
+    connect(scrollBar, &QScrollBar::rangeChanged, this, &HistoryMessageWidget::loadMoreIfNeeded);
 
-void SpeechLabel::mousePressEvent(QMouseEvent *event)
-{
-    (void) event;
-    if (!this->loadDone) {
-        Toast::showMessage("文件内容加载中, 稍后重试");
-        return;
-    }
-    SoundRecorder* soundRecorder = SoundRecorder::getInstance();
-    soundRecorder->startPlay(this->content);
+    // 3. 把结果列表加入到整个 layout 中
+    layout->addWidget(listView, 2, 0, 1, 9);
 }
-
-
-
-
-
-
-
-
-
-
-
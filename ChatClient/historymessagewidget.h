@@ -8,25 +8,41 @@
 #include <QLineEdit>
 #include <QPushButton>
 #include <QLabel>
+#include <QListView>
 
 #include "model/data.h"
+#include "messageshowarea.h"
 
 using model::Message;
 
 ////////////////////////////////////////////////////////////////////
-/// 表示一个历史消息元素
+/// 历史消息结果列表
+/// 复用消息展示区的 model 和 delegate, 只绘制可见的行.
+/// 图片, 文件, 语音消息的正文, 在这一行第一次被绘制的时候才去下载.
 ////////////////////////////////////////////////////////////////////
-
-class HistoryItem : public QWidget {
+class HistoryListView : public QListView {
     Q_OBJECT
 public:
-    HistoryItem() {}
+    HistoryListView();
+
+    MessageListModel* getModel() {
+        return messageModel;
+    }
+
+protected:
+    void mousePressEvent(QMouseEvent* event) override;
+
+private:
+    // 点击消息正文. 图片查看原图, 文件另存为, 语音播放.
+    void clickContent(int row);
 
-    static HistoryItem* makeHistoryItem(const Message& message);
+    MessageListModel* messageModel;
+    MessageItemDelegate* messageDelegate;
 };
 
 ////////////////////////////////////////////////////////////////////
 /// 展示历史消息窗口
+/// 搜索结果分页加载, 滚动到接近底部时再请求下一页.
 ////////////////////////////////////////////////////////////////////
 class HistoryMessageWidget : public QDialog
 {
@@ -41,11 +57,16 @@ public:
     void clear();
 
     void clickSearchBtn();
-    void clickSearchBtnDone();
+    void clickSearchBtnDone(int pageOffset);
+    void clickSearchBtnFailed(int pageOffset, const QString& reason);
 
 private:
-    // 持有所有的历史消息结果的容器对象
-    QWidget* container;
+    // 滚动到接近底部, 并且服务器上还有更多结果时, 请求下一页
+    void loadMoreIfNeeded();
+
+    HistoryListView* listView;
+    // 是否有正在请求中的页
+    bool loadingPage = false;
 
     QLineEdit* searchEdit;
     QRadioButton* keyRadioBtn;
@@ -53,59 +74,7 @@ private:
     QDateTimeEdit* begTimeEdit;
     QDateTimeEdit* endTimeEdit;
 
-    void initScrollArea(QGridLayout* layout);
-};
-
-////////////////////////////////////////////////////////////////////
-/// 展示图片历史消息
-////////////////////////////////////////////////////////////////////
-
-class ImageButton : public QPushButton {
-public:
-    ImageButton(const QString& fileId, const QByteArray& content);
-    void updateUI(const QString& fileId, const QByteArray& content);
-
-private:
-    QString fileId;
-};
-
-////////////////////////////////////////////////////////////////////
-/// 展示文件历史消息
-////////////////////////////////////////////////////////////////////
-
-class FileLabel : public QLabel {
-public:
-    FileLabel(const QString& fileId, const QString& fileName);
-
-    void getContentDone(const QString& fileId, const QByteArray& fileContent);
-
-    // 通过这个函数, 来处理鼠标点击操作.
-    void mousePressEvent(QMouseEvent* event) override;
-
-private:
-    QString fileId;
-    QByteArray content;
-    QString fileName;
-    bool loadDone = false;
-};
-
-////////////////////////////////////////////////////////////////////
-/// 展示语音历史消息
-////////////////////////////////////////////////////////////////////
-
-class SpeechLabel : public QLabel {
-public:
-    SpeechLabel(const QString& fileId);
-
-    void getContentDone(const QString& fileId, const QByteArray& content);
-
-    // 通过这个函数处理鼠标点击
-    void mousePressEvent(QMouseEvent* event) override;
-
-private:
-    QString fileId;
-    QByteArray content;
-    bool loadDone = false;
+    void initListView(QGridLayout* layout);
 };
 
 #endif // HISTORYMESSAGEWIDGET_H
@@ -0,0 +1,44 @@
+#include "imagepreviewdialog.h"
+
+#include <QVBoxLayout>
+#include <QScrollArea>
+#include <QLabel>
+#include <QImage>
+#include <QScreen>
+
+#include "model/data.h"
+
+ImagePreviewDialog::ImagePreviewDialog(const QByteArray &content, QWidget *parent)
+    : QDialog(parent)
+{
+    // 1. 设置基本属性
+    this->setWindowTitle("查看图片");
+    this->setWindowIcon(QIcon(":/resource/image/logo.png"));
+    this->setAttribute(Qt::WA_DeleteOnClose);
+    this->setStyleSheet("QWidget { background-color: rgb(30, 30, 30); border: none; }");
+
+    QVBoxLayout* layout = new QVBoxLayout();
+    layout->setContentsMargins(0, 0, 0, 0);
+    this->setLayout(layout);
+
+    // 2. 解码原图
+    QImage image;
+    image.loadFromData(content);
+    if (image.isNull()) {
+        LOG() << "图片解码失败!";
+    }
+
+    QLabel* imageLabel = new QLabel();
+    imageLabel->setAlignment(Qt::AlignCenter);
+    imageLabel->setPixmap(QPixmap::fromImage(image));
+
+    // 图片比屏幕大的时候, 可以滚动查看
+    QScrollArea* scrollArea = new QScrollArea();
+    scrollArea->setWidget(imageLabel);
+    scrollArea->setAlignment(Qt::AlignCenter);
+    layout->addWidget(scrollArea);
+
+    // 3. 窗口的尺寸不超过屏幕的 80%
+    QSize maxSize = this->screen()->availableSize() * 0.8;
+    this->resize(qMin(image.width() + 2, maxSize.width()), qMin(image.height() + 2, maxSize.height()));
+}
@@ -0,0 +1,18 @@
+#ifndef IMAGEPREVIEWDIALOG_H
+#define IMAGEPREVIEWDIALOG_H
+
+#include <QDialog>
+#include <QWidget>
+
+////////////////////////////////////////////////////////
+/// 查看原图的窗口
+/// 消息列表中显示的都是缩略图, 只有打开这个窗口时, 才会完整解码原图.
+////////////////////////////////////////////////////////
+class ImagePreviewDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    ImagePreviewDialog(const QByteArray& content, QWidget* parent);
+};
+
+#endif // IMAGEPREVIEWDIALOG_H
@@ -8,6 +8,9 @@
 #include "loginwidget.h"
 
 #include "model/datacenter.h"
+#include "perfmonitor.h"
+#include "theme.h"
+#include "voiceactivity.h"
 
 FILE* output = nullptr;
 
@@ -28,12 +31,33 @@ int main(int argc, char *argv[])
     qInstallMessageHandler(msgHandler);
 #endif
 
+    theme::apply();
+
+#if PERF_MONITOR
+    PerfMonitor::getInstance()->start();
+#endif
+
+#if TEST_THEME_BENCH
+    theme::runRowBenchmark();
+#endif
+
+#if TEST_VAD_BENCH
+    VoiceActivityDetector::runBenchmark();
+#endif
+
 #if TEST_SKIP_LOGIN
     MainWidget* w = MainWidget::getInstance();
     w->show();
 #else
-    LoginWidget* loginWidget = new LoginWidget(nullptr);
-    loginWidget->show();
+    if (!model::DataCenter::getInstance()->getLoginSessionId().isEmpty()) {
+        // 本地保存了登录会话, 直接进入主窗口, 不必再走一遍登录界面.
+        // 会话是否仍然有效, 由主窗口启动阶段获取个人信息的请求在后台验证. 服务器拒绝了再回到登录界面.
+        MainWidget* w = MainWidget::getInstance();
+        w->show();
+    } else {
+        LoginWidget* loginWidget = new LoginWidget(nullptr);
+        loginWidget->show();
+    }
 #endif
 
 #if TEST_NETWORK
@@ -4,6 +4,7 @@
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QCloseEvent>
+#include <QTimer>
 
 #include "sessionfriendarea.h"
 #include "selfinfowidget.h"
@@ -12,8 +13,12 @@
 #include "addfrienddialog.h"
 #include "model/datacenter.h"
 #include "toast.h"
+#include "notificationcenter.h"
+#include "loginwidget.h"
 #include "debug.h"
 
+static const int BOOTSTRAP_RETRY_INTERVAL_MS = 3000;	// 启动数据获取失败之后, 重试的间隔
+
 using namespace model;
 
 MainWidget* MainWidget::instance = nullptr;
@@ -300,7 +305,7 @@ void MainWidget::initSignalSlot()
     });
 
     /////////////////////////////////////////////
-    /// 获取个人信息
+    /// 启动阶段: 个人信息 / 会话列表 / 好友列表 / 好友申请列表 一次性全部获取
     /////////////////////////////////////////////
     // 提供一个具体的方法, 来获取到网络数据
     connect(dataCenter, &DataCenter::getMyselfDone, this, [=]() {
@@ -308,22 +313,69 @@ void MainWidget::initSignalSlot()
         auto myself = dataCenter->getMyself();
         userAvatar->setIcon(myself->avatar);
     });
-    dataCenter->getMyselfAsync();
+    // 几个列表谁先回来, 就先渲染谁. 三种列表各自有 model, 不是当前标签页的列表也会更新, 切换标签页时直接显示.
+    connect(dataCenter, &DataCenter::getChatSessionListDone, this, &MainWidget::updateChatSessionList, Qt::UniqueConnection);
+    connect(dataCenter, &DataCenter::getFriendListDone, this, &MainWidget::updateFriendList, Qt::UniqueConnection);
+    connect(dataCenter, &DataCenter::getApplyListDone, this, &MainWidget::updateApplyList, Qt::UniqueConnection);
+    // 收到新消息的提示, 一段时间内的消息合并成一条
+    connect(dataCenter, &DataCenter::messageArrived, NotificationCenter::getInstance(), &NotificationCenter::addMessages, Qt::UniqueConnection);
+    connect(dataCenter, &DataCenter::bootstrapDone, this, [=](qint64 elapsedMs, bool ok) {
+        if (ok) {
+            LOG() << "主窗口可交互, 启动耗时 " << elapsedMs << "ms";
+            return;
+        }
+        if (sessionExpired) {
+            // 登录会话失效, 重新登录之后会再次获取
+            return;
+        }
+        // 网络或者服务器暂时出错, 过一会重新获取. 等待个人信息的逻辑 (比如显示消息) 在获取成功之后继续.
+        Toast::showMessage("获取个人信息失败, 稍后自动重试");
+        QTimer::singleShot(BOOTSTRAP_RETRY_INTERVAL_MS, this, [=]() {
+            if (!sessionExpired) {
+                dataCenter->bootstrapAsync();
+            }
+        });
+    });
+    dataCenter->bootstrapAsync();
 
     /////////////////////////////////////////////
-    /// 获取好友列表
+    /// 处理登录会话失效. 直接进入主窗口的情况下, 本地保存的会话可能已经过期
     /////////////////////////////////////////////
-    loadFriendList();
+    connect(dataCenter, &DataCenter::loginSessionExpired, this, [=]() {
+        if (sessionExpired) {
+            return;
+        }
+        sessionExpired = true;
+        dataCenter->closeWebsocket();
+
+        // 重新登录的可能是另一个账号, 上一个账号的数据和界面上显示的内容都要清空
+        dataCenter->clearUserData();
+        pendingChatSessionId = "";
+        sessionFriendArea->resetItems(SessionItemType, {});
+        sessionFriendArea->resetItems(FriendItemType, {});
+        sessionFriendArea->resetItems(ApplyItemType, {});
+        sessionTitleLabel->setText("");
+        messageShowArea->clear();
 
-    /////////////////////////////////////////////
-    /// 获取会话列表
-    /////////////////////////////////////////////
-    loadSessionList();
+        // 先显示登录窗口, 再隐藏主窗口, 避免中间没有可见窗口
+        LoginWidget* loginWidget = new LoginWidget(nullptr);
+        loginWidget->show();
+        this->hide();
+        Toast::showMessage("登录已过期, 请重新登录");
+    });
 
-    /////////////////////////////////////////////
-    /// 获取好友申请列表
-    /////////////////////////////////////////////
-    loadApplyList();
+    // 重新登录成功之后, 登录窗口会再次显示主窗口. 这里重新建立 websocket 连接, 并重新获取初始数据.
+    auto reloadAfterLogin = [=](bool ok, const QString& reason) {
+        (void) reason;
+        if (!ok || !sessionExpired) {
+            return;
+        }
+        sessionExpired = false;
+        this->initWebsocket();
+        dataCenter->bootstrapAsync();
+    };
+    connect(dataCenter, &DataCenter::userLoginDone, this, reloadAfterLogin);
+    connect(dataCenter, &DataCenter::phoneLoginDone, this, reloadAfterLogin);
 
     /////////////////////////////////////////////
     /// 处理修改头像
@@ -424,11 +476,12 @@ void MainWidget::switchTabToSession()
 {
     // 1. 记录当前切换到了哪个标签页
     activeTab = SESSION_LIST;
+    sessionFriendArea->switchTo(SessionItemType);
     // 2. 调整图标显示情况, 把会话的按钮图标设为 active, 另外两个图标设为 inactive.
     sessionTabBtn->setIcon(QIcon(":/resource/image/session_active.png"));
     friendTabBtn->setIcon(QIcon(":/resource/image/friend_inactive.png"));
     applyTabBtn->setIcon(QIcon(":/resource/image/apply_inactive.png"));
-    // 3. 在主窗口的中间部分, 加载出会话列表数据
+    // 3. 会话列表的 model 一直保持最新, 切换过来直接显示. 本地还没有数据时才从网络获取.
     this->loadSessionList();
 }
 
@@ -436,11 +489,12 @@ void MainWidget::switchTabToFriend()
 {
     // 1. 记录当前切换到了哪个标签页
     activeTab = FRIEND_LIST;
+    sessionFriendArea->switchTo(FriendItemType);
     // 2. 调整图标显示情况, 把会话的按钮图标设为 active, 另外两个图标设为 inactive.
     friendTabBtn->setIcon(QIcon(":/resource/image/friend_active.png"));
     sessionTabBtn->setIcon(QIcon(":/resource/image/session_inactive.png"));
     applyTabBtn->setIcon(QIcon(":/resource/image/apply_inactive.png"));
-    // 3. 在主窗口的中间部分, 加载出会话列表数据
+    // 3. 好友列表的 model 一直保持最新, 切换过来直接显示. 本地还没有数据时才从网络获取.
     this->loadFriendList();
 }
 
@@ -448,25 +502,22 @@ void MainWidget::switchTabToApply()
 {
     // 1. 记录当前切换到了哪个标签页
     activeTab = APPLY_LIST;
+    sessionFriendArea->switchTo(ApplyItemType);
     // 2. 调整图标显示情况, 把会话的按钮图标设为 active, 另外两个图标设为 inactive.
     applyTabBtn->setIcon(QIcon(":/resource/image/apply_active.png"));
     sessionTabBtn->setIcon(QIcon(":/resource/image/session_inactive.png"));
     friendTabBtn->setIcon(QIcon(":/resource/image/friend_inactive.png"));
-    // 3. 在主窗口的中间部分, 加载出会话列表数据
+    // 3. 好友申请列表的 model 一直保持最新, 切换过来直接显示. 本地还没有数据时才从网络获取.
     this->loadApplyList();
 }
 
 // 加载会话列表
 void MainWidget::loadSessionList()
 {
-    // 先判定会话列表数据是否在本地 (DataCenter) 中存在. 如果本地存在, 直接构造界面内容.
+    // 本地 (DataCenter) 已经有数据时, model 在数据变化时已经由 updateChatSessionList 更新过了, 不需要重新构造.
     // 如果本地不存在, 则从服务器获取数据.
     DataCenter* dataCenter = DataCenter::getInstance();
-    if (dataCenter->getChatSessionList() != nullptr) {
-        // 从内存加载数据显示
-        updateChatSessionList();
-    } else {
-        // 从网络加载数据
+    if (dataCenter->getChatSessionList() == nullptr) {
         connect(dataCenter, &DataCenter::getChatSessionListDone, this, &MainWidget::updateChatSessionList, Qt::UniqueConnection);
         dataCenter->getChatSessionListAsync();
     }
@@ -476,14 +527,9 @@ void MainWidget::loadSessionList()
 void MainWidget::loadFriendList()
 {
     // 好友列表数据是在 DataCenter 中存储的
-    // 首先需要判定 DataCenter 中是否已经有数据了. 如果有数据, 直接加载本地的数据.
-    // 如果没有数据, 从服务器获取
+    // DataCenter 中已经有数据时, model 已经是最新的, 不需要重新构造. 如果没有数据, 从服务器获取
     DataCenter* dataCenter = DataCenter::getInstance();
-    if (dataCenter->getFriendList() != nullptr) {
-        // 从内存这个列表中加载数据
-        updateFriendList();
-    } else {
-        // 通过网络来加载数据
+    if (dataCenter->getFriendList() == nullptr) {
         connect(dataCenter, &DataCenter::getFriendListDone, this, &MainWidget::updateFriendList, Qt::UniqueConnection);
         dataCenter->getFriendListAsync();
     }
@@ -493,14 +539,9 @@ void MainWidget::loadFriendList()
 void MainWidget::loadApplyList()
 {
     // 好友申请列表在 DataCenter 中存储的
-    // 首先判定 DataCenter 本地是否已经有数据了. 如果有, 直接加载到界面上.
-    // 如果没有则需要从服务器获取
+    // DataCenter 本地已经有数据时, model 已经是最新的, 不需要重新构造. 如果没有则需要从服务器获取
     DataCenter* dataCenter = DataCenter::getInstance();
-    if (dataCenter->getApplyList() != nullptr) {
-        // 本地有数据, 直接加载
-        updateApplyList();
-    } else {
-        // 本地没有数据, 通过网络加载
+    if (dataCenter->getApplyList() == nullptr) {
         connect(dataCenter, &DataCenter::getApplyListDone, this, &MainWidget::updateApplyList, Qt::UniqueConnection);
         dataCenter->getApplyListAsync();
     }
@@ -508,64 +549,65 @@ void MainWidget::loadApplyList()
 
 void MainWidget::updateFriendList()
 {
-    if (activeTab != FRIEND_LIST) {
-        // 当前的标签页不是好友列表, 就不渲染任何数据到界面上
-        return;
-    }
     DataCenter* dataCenter = DataCenter::getInstance();
     QList<UserInfo>* friendList = dataCenter->getFriendList();
+    if (friendList == nullptr) {
+        return;
+    }
 
-    // 清空一下之前界面上的数据.
-    sessionFriendArea->clear();
-
-    // 遍历好友列表, 添加到界面上
+    // 遍历好友列表, 整体替换掉界面上之前的数据. 这里只是更新 model, 只有可见的 Item 才会被绘制.
+    QList<SessionFriendItemData> items;
+    items.reserve(friendList->size());
     for (const auto& f : *friendList) {
-        sessionFriendArea->addItem(FriendItemType, f.userId, f.avatar, f.nickname, f.description);
+        items.push_back(SessionFriendItemData{f.userId, f.avatar, f.nickname, f.description});
     }
+    sessionFriendArea->resetItems(FriendItemType, items);
 }
 
 void MainWidget::updateChatSessionList()
 {
-    if (activeTab != SESSION_LIST) {
-        // 当前标签页不是会话列表, 不渲染任何数据到界面上
-        return;
-    }
     DataCenter* dataCenter = DataCenter::getInstance();
     QList<ChatSessionInfo>* chatSessionList = dataCenter->getChatSessionList();
+    if (chatSessionList == nullptr) {
+        return;
+    }
 
-    sessionFriendArea->clear();
-
+    QList<SessionFriendItemData> items;
+    items.reserve(chatSessionList->size());
     for (const auto& c : *chatSessionList) {
+        QString text;
         if (c.lastMessage.messageType == TEXT_TYPE) {
-            sessionFriendArea->addItem(SessionItemType, c.chatSessionId, c.avatar, c.chatSessionName, c.lastMessage.content);
+            text = c.lastMessage.content;
         } else if (c.lastMessage.messageType == IMAGE_TYPE) {
-            sessionFriendArea->addItem(SessionItemType, c.chatSessionId, c.avatar, c.chatSessionName, "[图片]");
+            text = "[图片]";
         } else if (c.lastMessage.messageType == FILE_TYPE) {
-            sessionFriendArea->addItem(SessionItemType, c.chatSessionId, c.avatar, c.chatSessionName, "[文件]");
+            text = "[文件]";
         } else if (c.lastMessage.messageType == SPEECH_TYPE) {
-            sessionFriendArea->addItem(SessionItemType, c.chatSessionId, c.avatar, c.chatSessionName, "[语音]");
+            text = "[语音]";
         } else {
             LOG() << "错误的消息类型! messageType=" << c.lastMessage.messageType;
+            continue;
         }
+        items.push_back(SessionFriendItemData{c.chatSessionId, c.avatar, c.chatSessionName, text});
     }
+    sessionFriendArea->resetItems(SessionItemType, items);
 }
 
 void MainWidget::updateApplyList()
 {
-    if (activeTab != APPLY_LIST) {
-        // 当前标签页不是 "好友申请列表", 界面上不做任何渲染
-        return;
-    }
     DataCenter* dataCenter = DataCenter::getInstance();
     QList<UserInfo>* applyList = dataCenter->getApplyList();
+    if (applyList == nullptr) {
+        return;
+    }
 
-    sessionFriendArea->clear();
-
+    QList<SessionFriendItemData> items;
+    items.reserve(applyList->size());
     for (const auto& u : *applyList) {
-        // 直接把这个 UserInfo 对象添加到界面上即可, 不涉及到 PB 和 自己的结构之间的转换.
         // 此处 UserInfo 的 description 不需要填写进来. 好友申请列表中, 不显示用户的签名的 (这个位置被替换成了两个按钮)
-        sessionFriendArea->addItem(ApplyItemType, u.userId, u.avatar, u.nickname, "");
+        items.push_back(SessionFriendItemData{u.userId, u.avatar, u.nickname, ""});
     }
+    sessionFriendArea->resetItems(ApplyItemType, items);
 }
 
 void MainWidget::loadRecentMessage(const QString &chatSessionId)
@@ -588,33 +630,41 @@ void MainWidget::updateRecentMessage(const QString &chatSessionId)
 {
     // 1. 拿到该会话的最近消息列表
     DataCenter* dataCenter = DataCenter::getInstance();
+    if (dataCenter->getMyself() == nullptr) {
+        // 区分消息左右需要用到个人信息. 启动阶段个人信息可能还没有返回, 等它返回之后再显示.
+        // 期间用户可能连续点了好几个会话, 只需要显示最后点开的那一个, 信号也只需要连接一次.
+        if (pendingChatSessionId.isEmpty()) {
+            connect(dataCenter, &DataCenter::getMyselfDone, this, [=]() {
+                QString pending = this->pendingChatSessionId;
+                this->pendingChatSessionId = "";
+                if (!pending.isEmpty()) {
+                    this->updateRecentMessage(pending);
+                }
+            }, Qt::SingleShotConnection);
+        }
+        pendingChatSessionId = chatSessionId;
+        return;
+    }
     auto* recentMessageList = dataCenter->getRecentMessageList(chatSessionId);
-
-    // 2. 清空原有界面上显示的消息列表
-    messageShowArea->clear();
-
-    // 3. 根据当前拿到的消息列表, 显示到界面上
-    //    此处把数据显示到界面上, 可以使用头插, 也可以使用尾插.
-    //    这里打算使用头插的方式来进行实现.
-    //    主要因为消息列表来说, 用户首先看到的, 应该是 "最近" 的消息, 也就是 "末尾" 的消息.
-    for (int i = recentMessageList->size() - 1; i >= 0; --i) {
-        const Message& message = recentMessageList->at(i);
-        bool isLeft = message.sender.userId != dataCenter->getMyself()->userId;
-        messageShowArea->addFrontMessage(isLeft, message);
+    if (recentMessageList == nullptr) {
+        LOG() << "会话的最近消息列表不存在! chatSessionId=" << chatSessionId;
+        return;
     }
 
-    // 4. 设置会话标题
+    // 2. 根据当前拿到的消息列表, 显示到界面上. 会清空原有界面上显示的消息列表.
+    //    用户首先看到的, 应该是 "最近" 的消息, 也就是 "末尾" 的消息. 所以第一帧先显示末尾的一屏,
+    //    更早的消息在后续的帧中逐步头插进来, 消息很多的时候也不会卡住界面.
+    messageShowArea->loadMessages(*recentMessageList, dataCenter->getMyself()->userId);
+
+    // 3. 设置会话标题
     ChatSessionInfo* chatSessionInfo = dataCenter->findChatSessionById(chatSessionId);
     if (chatSessionInfo != nullptr) {
         // 把会话名称显示到界面上.
         sessionTitleLabel->setText(chatSessionInfo->chatSessionName);
     }
 
-    // 5. 保存当前选中的会话是哪个.
+    // 4. 保存当前选中的会话是哪个.
     dataCenter->setCurrentChatSessionId(chatSessionId);
-
-    // 6. 自动把滚动条, 滚动到末尾
-    messageShowArea->scrollToEnd();
 }
 
 void MainWidget::switchSession(const QString &userId)
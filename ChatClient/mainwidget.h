@@ -77,6 +77,12 @@ private:
 
     ActiveTab activeTab = SESSION_LIST;
 
+    // 本地保存的登录会话被服务器拒绝, 需要重新登录. 登录成功后要重新走一遍启动流程.
+    bool sessionExpired = false;
+
+    // 个人信息返回之前点开的会话. 只记录最后点开的那一个, 个人信息返回之后再显示它.
+    QString pendingChatSessionId;
+
 public:
     void initMainWindow();
     void initLeftWindow();
@@ -6,6 +6,7 @@
 
 #include "historymessagewidget.h"
 #include "soundrecorder.h"
+#include "speechwaveform.h"
 #include "mainwidget.h"
 #include "model/datacenter.h"
 #include "toast.h"
@@ -112,7 +113,7 @@ void MessageEditArea::initSignalSlot()
     connect(dataCenter, &DataCenter::sendMessageDone, this, &MessageEditArea::addSelfMessage);
 
     // 3. 关联 "收到消息" 信号槽
-    connect(dataCenter, &DataCenter::receiveMessageDone, this, &MessageEditArea::addOtherMessage);
+    connect(dataCenter, &DataCenter::receiveMessageDone, this, &MessageEditArea::addOtherMessages);
 
     // 4. 关联 "发送图片" 信号槽
     connect(sendImageBtn, &QPushButton::clicked, this, &MessageEditArea::clickSendImageBtn);
@@ -124,6 +125,7 @@ void MessageEditArea::initSignalSlot()
     connect(sendSpeechBtn, &QPushButton::pressed, this, &MessageEditArea::soundRecordPressed);
     connect(sendSpeechBtn, &QPushButton::released, this, &MessageEditArea::soundRecordReleased);
     SoundRecorder* soundRecorder = SoundRecorder::getInstance();
+    connect(soundRecorder, &SoundRecorder::soundRecordChunk, dataCenter, &DataCenter::putSpeechChunkAsync);
     connect(soundRecorder, &SoundRecorder::soundRecordDone, this, &MessageEditArea::sendSpeech);
 }
 
@@ -154,13 +156,14 @@ void MessageEditArea::sendTextMessage()
 }
 
 // 针对自己发送消息的操作, 做处理. 把自己发的消息, 显示到界面上
-void MessageEditArea::addSelfMessage(MessageType messageType, const QByteArray &content, const QString &extraInfo)
+void MessageEditArea::addSelfMessage(MessageType messageType, const QByteArray &content, const QString &extraInfo,
+                                     const SpeechMeta &speechMeta)
 {
     DataCenter* dataCenter = DataCenter::getInstance();
     const QString& currentChatSessionId = dataCenter->getCurrentChatSessionId();
 
     // 1. 构造出一个消息对象
-    Message message = Message::makeMessage(messageType, currentChatSessionId, *dataCenter->getMyself(), content, extraInfo);
+    Message message = Message::makeMessage(messageType, currentChatSessionId, *dataCenter->getMyself(), content, extraInfo, speechMeta);
     dataCenter->addMessage(message);
 
     // 2. 把这个新的消息, 显示到消息展示区
@@ -175,20 +178,17 @@ void MessageEditArea::addSelfMessage(MessageType messageType, const QByteArray &
     emit dataCenter->updateLastMessage(currentChatSessionId);
 }
 
-void MessageEditArea::addOtherMessage(const model::Message &message)
+void MessageEditArea::addOtherMessages(const QList<model::Message> &messages)
 {
     // 1. 通过主界面, 拿到消息展示区.
     MainWidget* mainWidget = MainWidget::getInstance();
     MessageShowArea* messageShowArea = mainWidget->getMessageShowArea();
 
-    // 2. 把收到的新的消息, 添加到消息展示区
-    messageShowArea->addMessage(true, message);
+    // 2. 把收到的新的消息, 一次性添加到消息展示区.
+    //    用户停留在底部时, 会自动滚动到新消息; 用户正在查看之前的消息时, 不打断用户.
+    messageShowArea->addMessages(messages, DataCenter::getInstance()->getMyself()->userId);
 
-    // 3. 控制消息展示区的滚动条, 把窗口滚动到末尾
-    messageShowArea->scrollToEnd();
-
-    // 4. 提示一个收到消息
-    Toast::showMessage("收到新消息!");
+    // 新消息的通知由 NotificationCenter 统一合并之后弹出
 }
 
 void MessageEditArea::clickSendImageBtn()
@@ -261,7 +261,8 @@ void MessageEditArea::soundRecordPressed()
     // 切换语音按钮的图标
     sendSpeechBtn->setIcon(QIcon(":/resource/image/sound_active.png"));
 
-    // 开始录音
+    // 开始录音. 录制的同时就开始上传
+    dataCenter->beginSpeechUpload();
     SoundRecorder* soundRecorder = SoundRecorder::getInstance();
     soundRecorder->startRecord();
 
@@ -289,16 +290,19 @@ void MessageEditArea::soundRecordReleased()
     textEdit->show();
 }
 
-void MessageEditArea::sendSpeech(const QString &path)
+void MessageEditArea::sendSpeech(const QByteArray &content)
 {
     DataCenter* dataCenter = DataCenter::getInstance();
-    // 1. 读取到语音文件的内容
-    QByteArray content = loadFileToByteArray(path);
     if (content.isEmpty()) {
-        LOG() << "语音文件加载失败";
+        dataCenter->cancelSpeechUpload();
+        Toast::showMessage("没有检测到声音, 语音未发送");
         return;
     }
-    dataCenter->sendSpeechMessageAsync(dataCenter->getCurrentChatSessionId(), content);
+    // 时长和波形只计算一次, 发送的消息和本地显示的消息都使用这一份
+    SpeechMeta speechMeta;
+    SpeechWaveform::analyze(content, &speechMeta.durationMs, &speechMeta.waveform);
+    // 录制过程中大部分数据已经上传了, 这里只需要上传剩下的部分, 然后发送消息
+    dataCenter->finishSpeechMessageAsync(dataCenter->getCurrentChatSessionId(), content, speechMeta);
 }
 
 
@@ -16,15 +16,16 @@ public:
 
     void initSignalSlot();
     void sendTextMessage();
-    void addSelfMessage(model::MessageType messageType, const QByteArray& content, const QString& extraInfo);
-    void addOtherMessage(const model::Message& message);
+    void addSelfMessage(model::MessageType messageType, const QByteArray& content, const QString& extraInfo,
+                        const model::SpeechMeta& speechMeta);
+    void addOtherMessages(const QList<model::Message>& messages);
 
     void clickSendImageBtn();
     void clickSendFileBtn();
 
     void soundRecordPressed();
     void soundRecordReleased();
-    void sendSpeech(const QString& path);
+    void sendSpeech(const QByteArray& content);
 
 private:
     QPushButton* sendImageBtn;
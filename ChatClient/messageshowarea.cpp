@@ -1,46 +1,165 @@
 #include "messageshowarea.h"
 
 #include <QScrollBar>
-#include <QVBoxLayout>
-#include <QPushButton>
-#include <QLabel>
-#include <QFontMetrics>
 #include <QPainter>
 #include <QPainterPath>
 #include <QFileDialog>
 #include <QTimer>
 #include <QMenu>
+#include <QMouseEvent>
+#include <QContextMenuEvent>
+#include <QImageReader>
+#include <QBuffer>
+#include <QtMath>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
 
 #include "mainwidget.h"
 #include "soundrecorder.h"
 #include "userinfowidget.h"
+#include "imagepreviewdialog.h"
+#include "theme.h"
+#include "avatarcache.h"
+#include "thumbnailloader.h"
 #include "toast.h"
+#include "perfmonitor.h"
 #include "model/datacenter.h"
 #include "debug.h"
 
 using namespace model;
 
+// 一条消息的布局参数. 和之前 MessageItem 中 QGridLayout 的设置保持一致.
+static const int ITEM_MIN_HEIGHT = 100;		// 每条消息最低不能低于 100
+static const int MARGIN_LEFT = 30;
+static const int MARGIN_TOP = 10;
+static const int MARGIN_RIGHT = 40;
+static const int SPACING = 10;
+static const int AVATAR_SIZE = 40;
+static const int NAME_HEIGHT = 20;			// 名字和时间这一行的高度
+static const int ARROW_WIDTH = 10;			// 气泡上箭头的宽度
+static const int BUBBLE_PADDING_H = 10;		// 气泡中文字距离左右两侧的边距
+static const int BUBBLE_PADDING_V = 10;		// 气泡中文字距离上下两侧的边距
+static const int FRAME_BUDGET_MS = 8;		// 分批加载消息时, 每一帧最多占用的时间
+static const int LOAD_CHUNK_SIZE = 20;		// 分批加载消息时, 每次插入的消息条数
+static const int TEXT_LAYOUT_CACHE_SIZE = 200;	// 保留排版结果的消息条数, 大于一屏能显示的消息数即可
+static const int STICK_TO_BOTTOM_DISTANCE = 10;	// 距离底部在这个范围之内, 就认为用户停留在底部
+static const int SPEECH_MIN_WIDTH = 100;		// 语音气泡的最小宽度, 时长越长气泡越宽
+static const int SPEECH_WIDTH_PER_SECOND = 6;
+static const int WAVEFORM_BAR_WIDTH = 2;		// 波形中每一条的宽度和间隔
+static const int WAVEFORM_BAR_SPACING = 2;
+
+// 消息正文这一列的左右边界. 左侧消息头像在左, 右侧消息头像在右.
+static void contentColumn(const QRect& itemRect, bool isLeft, int* left, int* right)
+{
+    if (isLeft) {
+        *left = itemRect.left() + MARGIN_LEFT + AVATAR_SIZE + SPACING;
+        *right = itemRect.left() + itemRect.width() - MARGIN_RIGHT;
+    } else {
+        *left = itemRect.left() + MARGIN_LEFT;
+        *right = itemRect.left() + itemRect.width() - MARGIN_RIGHT - AVATAR_SIZE - SPACING;
+    }
+}
+
+// 图片还没有加载回来的时候, 使用的默认图片. 只加载一次.
+static const QImage& placeholderImage()
+{
+    static QImage image(":/resource/image/image.png");
+    return image;
+}
+
 ////////////////////////////////////////////////////////
 /// 表示消息展示区
 ////////////////////////////////////////////////////////
 MessageShowArea::MessageShowArea() {
     // 1. 初始化基本属性
     this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-    this->setWidgetResizable(true);
+    this->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    this->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    this->setSelectionMode(QAbstractItemView::NoSelection);
+    this->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    this->setFocusPolicy(Qt::NoFocus);
+    // 每条消息的高度不同. 宽度变化时重新布局, 并且分批布局, 避免消息很多时一次性卡住界面.
+    this->setUniformItemSizes(false);
+    this->setResizeMode(QListView::Adjust);
+    this->setLayoutMode(QListView::Batched);
+    this->setBatchSize(100);
     // 设置滚动条的样式
     this->verticalScrollBar()->setStyleSheet("QScrollBar:vertical { width: 2px; background-color: rgb(240, 240, 240); }");
     this->horizontalScrollBar()->setStyleSheet("QScrollBar:horizontal { height: 0;}");
-    this->setStyleSheet("QScrollArea { border: none; }");
-
-    // 2. 创建 Container 这样的 widget, 作为包含内部元素的容器
-    container = new QWidget();
-    this->setWidget(container);
+    this->setStyleSheet("QListView { border: none; background-color: transparent; }");
+
+    // 2. 创建 model 和 delegate
+    messageModel = new MessageListModel(this);
+    messageDelegate = new MessageItemDelegate(this);
+    this->setModel(messageModel);
+    this->setItemDelegate(messageDelegate);
+
+    // 消息内容变化 (图片加载完成, 语音转文字等) 可能改变这一条消息的高度, 高度确实变化时才重新布局.
+    // 文件下载完成, 语音识别的中间结果没有换行等情况, 只重绘这几行.
+    // 宽度变化时, 排版结果按照消息的可用宽度缓存, 配合 Batched 布局模式分批重新排版, 不会在一次布局中处理所有消息.
+    connect(messageModel, &QAbstractItemModel::dataChanged, this, [=](const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+        if (messageDelegate->updateSizeHints(topLeft.row(), bottomRight.row())) {
+            this->scheduleDelayedItemsLayout();
+        }
+    });
+    connect(messageModel, &QAbstractItemModel::modelReset, messageDelegate, &MessageItemDelegate::clearLayoutCache);
+
+    // 滚动锚点. 每次布局完成 (滚动范围变化) 之后恢复锚点, 不依赖定时器.
+    QScrollBar* scrollBar = this->verticalScrollBar();
+    connect(scrollBar, &QScrollBar::rangeChanged, this, &MessageShowArea::restoreAnchor);
+    // 用户自己滚动之后, 以新的位置作为锚点. actionTriggered 发出时滚动条的值还没有变化, 等 valueChanged 再记录.
+    connect(scrollBar, &QScrollBar::actionTriggered, this, [=]() {
+        userScrolling = true;
+    });
+    connect(scrollBar, &QScrollBar::valueChanged, this, [=]() {
+        if (userScrolling) {
+            userScrolling = false;
+            saveAnchor();
+        }
+    });
 
-    // 3. 给 container 添加布局管理器
-    QVBoxLayout* layout = new QVBoxLayout();
-    layout->setSpacing(0);
-    layout->setContentsMargins(0, 0, 0, 0);
-    container->setLayout(layout);
+    // 3. 整个展示区只连接一次 DataCenter 的信号, 不再每条消息都连接一次.
+    DataCenter* dataCenter = DataCenter::getInstance();
+    connect(dataCenter, &DataCenter::speechConvertTextDone, this, [=](const QString& key, const QString& text) {
+        // 结果只显示到发起转换的语音消息上
+        const QSet<QString> messageIds = convertingSpeech.take(key);
+        for (const QString& messageId : messageIds) {
+            messageModel->setSpeechText(messageId, text);
+        }
+    });
+    // 识别过程中的中间结果, 边识别边显示
+    connect(dataCenter, &DataCenter::speechConvertTextPartial, this, [=](const QString& key, const QString& text) {
+        const QSet<QString> messageIds = convertingSpeech.value(key);
+        for (const QString& messageId : messageIds) {
+            messageModel->setSpeechText(messageId, text + "...");
+        }
+    });
+    // 识别失败, 去掉中间结果, 恢复成识别之前的样子
+    connect(dataCenter, &DataCenter::speechConvertTextFailed, this, [=](const QString& key, const QString& reason) {
+        const QSet<QString> messageIds = convertingSpeech.take(key);
+        if (messageIds.isEmpty()) {
+            return;
+        }
+        for (const QString& messageId : messageIds) {
+            LOG() << "语音转文字失败 messageId=" << messageId << ", reason=" << reason;
+            messageModel->clearSpeechText(messageId);
+        }
+        Toast::showMessage("语音转文字失败, 请稍后重试");
+    });
+    // 自己的昵称和头像, 绘制的时候直接从 DataCenter 中获取, 修改之后重绘即可.
+    connect(dataCenter, &DataCenter::changeNicknameDone, this, [=]() {
+        this->viewport()->update();
+    });
+    connect(dataCenter, &DataCenter::changeAvatarDone, this, [=]() {
+        this->viewport()->update();
+    });
+    connect(SoundRecorder::getInstance(), &SoundRecorder::soundPlayDone, this, [=]() {
+        messageModel->setPlayingMessage("");
+    });
+    // 缩略图在线程池中生成完毕, 重绘一下即可. 尺寸在此之前已经确定, 不需要重新布局.
+    connect(ThumbnailLoader::getInstance(), &ThumbnailLoader::loadDone, this, [=]() {
+        this->viewport()->update();
+    });
 
     // 添加 "构造测试数据" 逻辑.
 #if TEST_UI
@@ -68,321 +187,201 @@ MessageShowArea::MessageShowArea() {
 
 void MessageShowArea::addMessage(bool isLeft, const Message &message)
 {
-    // 构造 MessageItem, 添加到布局管理器中.
-    MessageItem* messageItem = MessageItem::makeMessageItem(isLeft, message);
-    container->layout()->addWidget(messageItem);
+    // 用户停留在底部时, 布局完成之后会自动滚动到新消息. 否则用户看到的位置不变.
+    messageModel->appendMessage(isLeft, message);
 }
 
-void MessageShowArea::addFrontMessage(bool isLeft, const Message &message)
+void MessageShowArea::addMessages(const QList<Message> &messages, const QString &myselfUserId)
 {
-    MessageItem* messageItem = MessageItem::makeMessageItem(isLeft, message);
-    QVBoxLayout* layout = dynamic_cast<QVBoxLayout*>(container->layout());
-    layout->insertWidget(0, messageItem);
+    messageModel->insertMessages(messageModel->rowCount(), messages, myselfUserId);
 }
 
-void MessageShowArea::clear()
+void MessageShowArea::addFrontMessage(bool isLeft, const Message &message)
 {
-    // 遍历布局管理器, 删除里面的元素
-    QLayout* layout = container->layout();
-    for (int i = layout->count() - 1; i >= 0; --i) {
-        QLayoutItem* item = layout->takeAt(i);
-        if (item != nullptr && item->widget() != nullptr) {
-            delete item->widget();
-        }
-    }
+    messageModel->prependMessage(isLeft, message);
 }
 
-void MessageShowArea::scrollToEnd()
+void MessageShowArea::clear()
 {
-    // 实现思路:
-    // 拿到滚动区域中的滚动条(垂直滚动条)
-    // 获取到滚动条的最大值
-    // 根据最大值, 设置滚动条的滚动位置.
-    // 为了使滚动效果更佳, 能够在界面绘制好之后进行滚动条的设置
-    // 给这里的滚动操作, 加上个 "延时"
-
-    QTimer* timer = new QTimer();
-    connect(timer, &QTimer::timeout, this, [=]() {
-        // 获取到垂直滚动条的最大值
-        int maxValue = this->verticalScrollBar()->maximum();
-        // 设置滚动条的滚动位置
-        this->verticalScrollBar()->setValue(maxValue);
-
-        timer->stop();
-        timer->deleteLater();
-    });
-    timer->start(500);
+    // 取消还没有完成的分批加载
+    ++loadGeneration;
+    pendingMessages.clear();
+    stickToBottom = true;
+    messageModel->clear();
 }
 
-////////////////////////////////////////////////////////
-/// 表示一个消息元素
-////////////////////////////////////////////////////////
-
-MessageItem::MessageItem(bool isLeft) : isLeft(isLeft)
+void MessageShowArea::loadMessages(const QList<Message> &messages, const QString &myselfUserId)
 {
+    this->clear();
 
+    // 1. 第一帧先显示最新的一屏. 每条消息至少 ITEM_MIN_HEIGHT 高, 据此计算一屏最多有几条消息.
+    int firstScreen = this->viewport()->height() / ITEM_MIN_HEIGHT + 2;
+    int split = qMax(0, (int)messages.size() - firstScreen);
+    messageModel->insertMessages(0, messages.mid(split), myselfUserId);
+    // 之后头插更早的消息时, 如果用户没有滚动, 就一直停留在底部; 用户向上滚动了, 就保持用户看到的消息不动.
+    this->scrollToEnd();
+
+    // 2. 剩下更早的消息, 交给后续的帧来处理
+    if (split == 0) {
+        return;
+    }
+    pendingMessages = messages.first(split);
+    pendingMyselfUserId = myselfUserId;
+    quint64 generation = loadGeneration;
+    QTimer::singleShot(0, this, [=]() {
+        this->loadOlderMessages(generation);
+    });
 }
 
-MessageItem *MessageItem::makeMessageItem(bool isLeft, const Message &message)
+void MessageShowArea::loadOlderMessages(quint64 generation)
 {
-    // 1. 创建对象和布局管理器
-    MessageItem* messageItem = new MessageItem(isLeft);
-    QGridLayout* layout = new QGridLayout();
-    layout->setContentsMargins(30, 10, 40, 0);
-    layout->setSpacing(10);
-    // 这个 MessageItem 最低不能低于 100
-    messageItem->setMinimumHeight(100);
-    messageItem->setLayout(layout);
-
-    // 2. 创建头像
-    QPushButton* avatarBtn = new QPushButton();
-    avatarBtn->setFixedSize(40, 40);
-    avatarBtn->setIconSize(QSize(40, 40));
-    avatarBtn->setIcon(message.sender.avatar);
-    avatarBtn->setStyleSheet("QPushButton { border: none;}");
-    if (isLeft) {
-        layout->addWidget(avatarBtn, 0, 0, 2, 1, Qt::AlignTop | Qt::AlignLeft);
-    } else {
-        layout->addWidget(avatarBtn, 0, 1, 2, 1, Qt::AlignTop | Qt::AlignLeft);
+    if (generation != loadGeneration) {
+        // 用户已经切换到别的会话了
+        return;
     }
 
-    // 3. 创建名字和时间
-    QLabel* nameLabel = new QLabel();
-    nameLabel->setText(message.sender.nickname + " | " + message.time);
-    nameLabel->setAlignment(Qt::AlignBottom);
-    nameLabel->setStyleSheet("QLabel { font-size: 12px; color: rgb(178, 178, 178); }");
-    if (isLeft) {
-        layout->addWidget(nameLabel, 0, 1);
-    } else {
-        layout->addWidget(nameLabel, 0, 0, Qt::AlignRight);
-    }
+    // 1. 在时间预算之内, 从后往前把更早的消息插入到头部
+    QElapsedTimer timer;
+    timer.start();
+    while (!pendingMessages.isEmpty() && timer.elapsed() < FRAME_BUDGET_MS) {
+        int count = qMin(LOAD_CHUNK_SIZE, (int)pendingMessages.size());
+        QList<Message> chunk = pendingMessages.last(count);
+        pendingMessages.resize(pendingMessages.size() - count);
 
-    // 4. 创建消息体
-    QWidget* contentWidget = nullptr;
-    switch (message.messageType) {
-    case TEXT_TYPE:
-        contentWidget = makeTextMessageItem(isLeft, message.content);
-        break;
-    case IMAGE_TYPE:
-        contentWidget = makeImageMessageItem(isLeft, message.fileId, message.content);
-        break;
-    case FILE_TYPE:
-        contentWidget = makeFileMessageItem(isLeft, message);
-        break;
-    case SPEECH_TYPE:
-        contentWidget = makeSpeechMessageItem(isLeft, message);
-        break;
-    default:
-        LOG() << "错误的消息类型! messageType=" << message.messageType;
+        messageModel->insertMessages(0, chunk, pendingMyselfUserId);
     }
-    if (isLeft) {
-        layout->addWidget(contentWidget, 1, 1);
-    } else {
-        layout->addWidget(contentWidget, 1, 0);
-    }
-
-    // 5. 连接信号槽, 处理用户点击头像的操作
-    connect(avatarBtn, &QPushButton::clicked, messageItem, [=]() {
-        MainWidget* mainWidget = MainWidget::getInstance();
-        UserInfoWidget* userInfoWidget = new UserInfoWidget(message.sender, mainWidget);
-        userInfoWidget->exec();
-    });
-
-    // 6. 当用户修改了昵称的时候, 同步修改此处的用户昵称.
-    if (!isLeft) {
-        // 只是针对右侧消息(自己的消息) 做下列操作.
-        DataCenter* dataCenter = DataCenter::getInstance();
-        connect(dataCenter, &DataCenter::changeNicknameDone, messageItem, [=]() {
-            nameLabel->setText(dataCenter->getMyself()->nickname + " | " + message.time);
-        });
 
-        connect(dataCenter, &DataCenter::changeAvatarDone, messageItem, [=]() {
-            UserInfo* myself = dataCenter->getMyself();
-            avatarBtn->setIcon(myself->avatar);
+    // 2. 还有剩余, 让出事件循环, 下一帧继续
+    if (!pendingMessages.isEmpty()) {
+        QTimer::singleShot(0, this, [=]() {
+            this->loadOlderMessages(generation);
         });
     }
-
-    return messageItem;
 }
 
-QWidget *MessageItem::makeTextMessageItem(bool isLeft, const QString& text)
-{
-    MessageContentLabel* messageContentLabel = new MessageContentLabel(text, isLeft, TEXT_TYPE, "", QByteArray());
-    return messageContentLabel;
-}
-
-QWidget *MessageItem::makeImageMessageItem(bool isLeft, const QString& fileId, const QByteArray& content)
+void MessageShowArea::scrollToEnd()
 {
-    MessageImageLabel* messageImageLabel = new MessageImageLabel(fileId, content, isLeft);
-    return messageImageLabel;
+    // 进入 "停留在底部" 模式. 此时布局可能还没有完成, 布局完成之后 restoreAnchor 会再次滚动到底部.
+    stickToBottom = true;
+    QScrollBar* scrollBar = this->verticalScrollBar();
+    scrollBar->setValue(scrollBar->maximum());
 }
 
-QWidget *MessageItem::makeFileMessageItem(bool isLeft, const Message& message)
+void MessageShowArea::saveAnchor()
 {
-    MessageContentLabel* messageContentLabel = new MessageContentLabel("[文件] " + message.fileName, isLeft, message.messageType,
-                                                                       message.fileId, message.content);
-    return messageContentLabel;
-}
+    // 1. 距离底部很近, 就认为用户停留在底部
+    QScrollBar* scrollBar = this->verticalScrollBar();
+    stickToBottom = scrollBar->value() >= scrollBar->maximum() - STICK_TO_BOTTOM_DISTANCE;
+    if (stickToBottom) {
+        return;
+    }
 
-QWidget *MessageItem::makeSpeechMessageItem(bool isLeft, const Message& message)
-{
-    MessageContentLabel* messageContentLabel = new MessageContentLabel("[语音]", isLeft, message.messageType,
-                                                                       message.fileId, message.content);
-    return messageContentLabel;
+    // 2. 否则记录视口最上方的消息, 以及它相对视口顶部的位置
+    QModelIndex index = this->indexAt(QPoint(MARGIN_LEFT, 0));
+    if (!index.isValid()) {
+        return;
+    }
+    anchorMessageId = messageModel->messageAt(index.row()).messageId;
+    anchorOffset = this->visualRect(index).top();
 }
 
-////////////////////////////////////////////////////////
-/// 创建类表示 "文本消息" 正文部分
-/// 也能表示文件消息
-////////////////////////////////////////////////////////
-MessageContentLabel::MessageContentLabel(const QString &text, bool isLeft, model::MessageType messageType, const QString& fileId,
-        const QByteArray& content)
-    : isLeft(isLeft), messageType(messageType), fileId(fileId), content(content)
+void MessageShowArea::restoreAnchor()
 {
-    // 设置一下 SizePolicy
-    this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
-
-    QFont font;
-    font.setFamily("微软雅黑");
-    font.setPixelSize(16);
-
-    this->label = new QLabel(this);
-    this->label->setText(text);
-    this->label->setFont(font);
-    this->label->setAlignment(Qt::AlignVCenter | Qt::AlignLeft);
-    this->label->setWordWrap(true);    // 设置文本自动换行
-    this->label->setStyleSheet("QLabel { padding: 0 10px; line-height: 1.2; background-color: transparent; }");
-
-    // 针对文件消息, 并且 content 为空的情况下, 通过网络来加载数据
-    if (messageType == model::TEXT_TYPE) {
+    QScrollBar* scrollBar = this->verticalScrollBar();
+    if (stickToBottom) {
+        scrollBar->setValue(scrollBar->maximum());
         return;
     }
 
-    if (this->content.isEmpty()) {
-        DataCenter* dataCenter = DataCenter::getInstance();
-        connect(dataCenter, &DataCenter::getSingleFileDone, this, &MessageContentLabel::updateUI);
-        dataCenter->getSingleFileAsync(this->fileId);
-    } else {
-        // content 不为空, 说明当前的这个数据就是已经现成. 直接就把 表示加载状态的变量设为 true
-        this->loadContentDone = true;
+    // 锚点消息移动了多少, 滚动条就跟着移动多少, 让锚点消息停留在原来的位置
+    int row = messageModel->findRow(anchorMessageId);
+    if (row < 0) {
+        return;
+    }
+    QRect rect = this->visualRect(messageModel->index(row));
+    if (!rect.isValid()) {
+        // 锚点消息还没有完成布局
+        return;
     }
+    int delta = rect.top() - anchorOffset;
+    if (delta != 0) {
+        scrollBar->setValue(scrollBar->value() + delta);
+    }
+}
+
+void MessageShowArea::doItemsLayout()
+{
+    PERF_SCOPE("MessageShowArea::layout");
+    QListView::doItemsLayout();
 }
 
-// 这个函数会该控件被显示的时候自动调用到.
-void MessageContentLabel::paintEvent(QPaintEvent *event)
+void MessageShowArea::paintEvent(QPaintEvent *event)
 {
-    (void) event;
+    PERF_SCOPE("MessageShowArea::paint");
+    QListView::paintEvent(event);
+}
 
-    // 1. 获取到父元素的宽度
-    QObject* object = this->parent();
-    if (!object->isWidgetType()) {
-        // 当前这个对象的父元素不是预期的 QWidget, 此时不需要进行任何后续的绘制操作.
+void MessageShowArea::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) {
+        QListView::mousePressEvent(event);
         return;
     }
-    QWidget* parent = dynamic_cast<QWidget*>(object);
-    int width = parent->width() * 0.6;
-
-    // 2. 计算当前文本, 如果是一行放置, 需要多宽.
-    QFontMetrics metrics(this->label->font());
-    int totalWidth = metrics.horizontalAdvance(this->label->text());
-
-    // 3. 计算出此处的行数是多少 (40 表示左右各有 20px 的边距)
-    int rows = (totalWidth / (width - 40)) + 1;
-    if (rows == 1) {
-        // 如果此时得到的行数就只有一行
-        width = totalWidth + 40;
+    QModelIndex index = this->indexAt(event->pos());
+    if (!index.isValid()) {
+        return;
     }
+    QRect itemRect = this->visualRect(index);
+    bool isLeft = messageModel->isLeftAt(index.row());
 
-    // 4. 根据行数, 计算得到高度. (20 表示上下各有 10px 的边距)
-    int height = rows * (this->label->font().pixelSize() * 1.2 ) + 20;
+    // 1. 点击头像, 弹出用户详情
+    if (messageDelegate->avatarRect(itemRect, isLeft).contains(event->pos())) {
+        // UserInfoWidget 内部持有的是引用, 此处复制一份, 避免模态对话框期间消息列表变化.
+        UserInfo sender = messageModel->messageAt(index.row()).sender;
+        MainWidget* mainWidget = MainWidget::getInstance();
+        UserInfoWidget* userInfoWidget = new UserInfoWidget(sender, mainWidget);
+        userInfoWidget->exec();
+        return;
+    }
 
-    // 5. 绘制圆角矩形和箭头
-    QPainter painter(this);
-    QPainterPath path;
-    // 设置 "抗锯齿"
-    painter.setRenderHint(QPainter::Antialiasing);
-    if (isLeft) {
-        painter.setPen(QPen(QColor(255, 255, 255)));
-        painter.setBrush(QColor(255, 255, 255));
-
-        // 绘制圆角矩形
-        painter.drawRoundedRect(10, 0, width, height, 10, 10);
-        // 绘制箭头
-        path.moveTo(10, 15);
-        path.lineTo(0, 20);
-        path.lineTo(10, 25);
-        path.closeSubpath();   // 绘制的线形成闭合的多边形, 才能进行使用 Brush 填充颜色.
-        painter.drawPath(path);  // 不要忘记真正的绘制操作
-
-        this->label->setGeometry(10, 0, width, height);
-    } else {
-        painter.setPen(QPen(QColor(137, 217, 97)));
-        painter.setBrush(QColor(137, 217, 97));
-
-        // 圆角矩形左侧边的横坐标位置
-        int leftPos = this->width() - width - 10; // 10 是用来容纳 箭头 的宽度
-        // 圆角矩形右侧边的横坐标位置
-        int rightPos = this->width() - 10;
-        // 绘制圆角矩形
-        painter.drawRoundedRect(leftPos, 0, width, height, 10, 10);
-        // 绘制箭头
-        path.moveTo(rightPos, 15);
-        path.lineTo(rightPos + 10, 20);
-        path.lineTo(rightPos, 25);
-        path.closeSubpath();
-        painter.drawPath(path);
-
-        this->label->setGeometry(leftPos, 0, width, height);
-    }
-
-    // 6. 重新设置父元素的高度, 确保父元素足够高, 能够容纳下上述绘制的消息显示的区域
-    //    注意高度要涵盖之前名字和时间的 label 的高度, 以及留点冗余空间.
-    parent->setFixedHeight(height + 50);
-}
-
-void MessageContentLabel::mousePressEvent(QMouseEvent *event)
-{
-    // 实现鼠标点击之后, 触发文件另存为
-    if (event->button() == Qt::LeftButton) {
-        // 左键按下
-        if (this->messageType == FILE_TYPE) {
-            // 真正触发另存为
-            if (!this->loadContentDone) {
-                Toast::showMessage("数据尚未加载成功, 请稍后重试");
-                return;
-            }
-            saveAsFile(this->content);
-        } else if (this->messageType == SPEECH_TYPE) {
-            if (!this->loadContentDone) {
-                Toast::showMessage("数据尚未加载成功, 请稍后重试");
-                return;
-            }
-            SoundRecorder* soundRecorder = SoundRecorder::getInstance();
-            this->label->setText("播放中...");
-            connect(soundRecorder, &SoundRecorder::soundPlayDone, this, &MessageContentLabel::playDone, Qt::UniqueConnection);
-            soundRecorder->startPlay(this->content);
-        } else {
-            // 其他消息, 比如普通的文本消息
-            // 啥都不做
-        }
+    // 2. 点击消息正文
+    if (messageDelegate->contentRect(itemRect, index).contains(event->pos())) {
+        clickContent(index.row());
     }
 }
 
-void MessageContentLabel::updateUI(const QString &fileId, const QByteArray &fileContent)
+void MessageShowArea::clickContent(int row)
 {
-    // 也和刚才图片消息的处理一样, 就需要判定收到的数据属于哪个 fileId 的.
-    if (fileId != this->fileId) {
-        return;
+    const Message& message = messageModel->messageAt(row);
+    if (message.messageType == IMAGE_TYPE) {
+        // 打开原图. 只有这个时候才会完整解码原图.
+        if (message.content.isEmpty()) {
+            Toast::showMessage("数据尚未加载成功, 请稍后重试");
+            return;
+        }
+        ImagePreviewDialog* dialog = new ImagePreviewDialog(message.content, MainWidget::getInstance());
+        dialog->show();
+    } else if (message.messageType == FILE_TYPE) {
+        // 真正触发另存为
+        if (message.content.isEmpty()) {
+            Toast::showMessage("数据尚未加载成功, 请稍后重试");
+            return;
+        }
+        saveAsFile(message.content);
+    } else if (message.messageType == SPEECH_TYPE) {
+        // 语音只有在播放的时候才下载, 下载完成之后直接播放
+        QString messageId = message.messageId;
+        messageModel->fetchContent(row, [=](const QByteArray& content) {
+            messageModel->setPlayingMessage(messageId);
+            SoundRecorder::getInstance()->startPlay(content);
+        });
+    } else {
+        // 其他消息, 比如普通的文本消息
+        // 啥都不做
     }
-    this->content = fileContent;
-    this->loadContentDone = true;
-    // 对于文件消息来说, 要在界面上显示 "[文件] test.txt" 这样形式. 这个内容和文件 content 无关.
-    // 在从服务器拿到文件正文之前, 界面内容应该就是绘制好了. 此时拿到正文之后, 界面应该也不必做出任何实质性的调整.
-    // 所以下列的 this->update(), 没有也行.
-    this->update();
 }
 
-void MessageContentLabel::saveAsFile(const QByteArray &content)
+void MessageShowArea::saveAsFile(const QByteArray &content)
 {
     // 弹出对话框, 让用户选择路径
     QString filePath = QFileDialog::getSaveFileName(this, "另存为", QDir::homePath(), "*");
@@ -393,153 +392,597 @@ void MessageContentLabel::saveAsFile(const QByteArray &content)
     writeByteArrayToFile(filePath, content);
 }
 
-void MessageContentLabel::playDone()
+void MessageShowArea::contextMenuEvent(QContextMenuEvent *event)
 {
-    if (this->label->text() == "播放中...") {
-        this->label->setText("[语音]");
+    QModelIndex index = this->indexAt(event->pos());
+    if (!index.isValid()) {
+        return;
     }
-}
-
-void MessageContentLabel::contextMenuEvent(QContextMenuEvent *event)
-{
-    (void) event;
-    if (messageType != SPEECH_TYPE) {
+    const Message& message = messageModel->messageAt(index.row());
+    if (message.messageType != SPEECH_TYPE) {
         LOG() << "非语音消息暂时不支持右键菜单";
         return;
     }
+    QString messageId = message.messageId;
+    QString fileId = message.fileId;
+    QByteArray content = message.content;
 
     QMenu* menu = new QMenu(this);
     QAction* action = menu->addAction("语音转文字");
     menu->setStyleSheet("QMenu { color: rgb(0, 0, 0); }");
     connect(action, &QAction::triggered, this, [=]() {
         DataCenter* dataCenter = DataCenter::getInstance();
-        connect(dataCenter, &DataCenter::speechConvertTextDone, this, &MessageContentLabel::speechConvertTextDone, Qt::UniqueConnection);
-        dataCenter->speechConvertTextAsync(this->fileId, this->content);
+        // 结果总是通过事件循环通知, 拿到 key 之后再登记也不会错过
+        QString key = dataCenter->speechConvertTextAsync(fileId, content);
+        convertingSpeech[key].insert(messageId);
     });
     // 此处弹出 "模态对话框" 显示菜单/菜单项. exec 会在用户进一步操作之前, 阻塞.
     menu->exec(event->globalPos());
     delete menu;
 }
 
-void MessageContentLabel::speechConvertTextDone(const QString &fileId, const QString &text)
+////////////////////////////////////////////////////////
+/// 消息展示区的数据模型
+////////////////////////////////////////////////////////
+MessageListModel::MessageListModel(QObject *parent) : QAbstractListModel(parent)
+{
+
+}
+
+int MessageListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return rows.size();
+}
+
+QVariant MessageListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QVariant();
+    }
+    if (role == Qt::DisplayRole) {
+        return displayText(index.row());
+    }
+    return QVariant();
+}
+
+void MessageListModel::appendMessage(bool isLeft, const Message &message)
+{
+    beginInsertRows(QModelIndex(), rows.size(), rows.size());
+    rows.push_back(MessageRow{message, isLeft});
+    endInsertRows();
+}
+
+void MessageListModel::prependMessage(bool isLeft, const Message &message)
 {
-    if (this->fileId != fileId) {
-        // 直接跳过, 此时的结果不是针对这一条语音消息的结果.
+    beginInsertRows(QModelIndex(), 0, 0);
+    rows.push_front(MessageRow{message, isLeft});
+    endInsertRows();
+}
+
+void MessageListModel::insertMessages(int row, const QList<Message> &messages, const QString &myselfUserId)
+{
+    if (messages.isEmpty()) {
         return;
     }
-    // 修改界面内容
-    this->label->setText("[语音转文字] " + text);
-    this->update();
+    QList<MessageRow> newRows;
+    newRows.reserve(messages.size());
+    for (const auto& message : messages) {
+        newRows.push_back(MessageRow{message, message.sender.userId != myselfUserId});
+    }
+    beginInsertRows(QModelIndex(), row, row + newRows.size() - 1);
+    rows.insert(row, newRows.size(), MessageRow());
+    std::copy(newRows.begin(), newRows.end(), rows.begin() + row);
+    endInsertRows();
 }
 
-////////////////////////////////////////////////////////
-/// 创建类表示 "图片消息" 正文部分
-////////////////////////////////////////////////////////
-MessageImageLabel::MessageImageLabel(const QString &fileId, const QByteArray &content, bool isLeft)
-    : fileId(fileId), content(content), isLeft(isLeft)
+void MessageListModel::clear()
 {
-    this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    beginResetModel();
+    rows.clear();
+    playingMessageId = "";
+    endResetModel();
+}
 
-    imageBtn = new QPushButton(this);
-    imageBtn->setStyleSheet("QPushButton { border: none; }");
+int MessageListModel::findRow(const QString &messageId) const
+{
+    for (int i = rows.size() - 1; i >= 0; --i) {
+        if (rows[i].message.messageId == messageId) {
+            return i;
+        }
+    }
+    return -1;
+}
 
-    if (content.isEmpty()) {
-        // 此处这个控件, 是针对 "从服务器拿到图片消息" 这种情况.
-        // 拿着 fileId, 去服务器获取图片内容
-        DataCenter* dataCenter = DataCenter::getInstance();
-        connect(dataCenter, &DataCenter::getSingleFileDone, this, &MessageImageLabel::updateUI);
-        dataCenter->getSingleFileAsync(fileId);
+const Message &MessageListModel::messageAt(int row) const
+{
+    return rows[row].message;
+}
+
+bool MessageListModel::isLeftAt(int row) const
+{
+    return rows[row].isLeft;
+}
+
+QString MessageListModel::displayText(int row) const
+{
+    const Message& message = rows[row].message;
+    switch (message.messageType) {
+    case TEXT_TYPE:
+        return QString(message.content);
+    case FILE_TYPE:
+        return "[文件] " + message.fileName;
+    case SPEECH_TYPE:
+        if (message.messageId == playingMessageId) {
+            return "播放中...";
+        }
+        if (speechTexts.contains(message.messageId)) {
+            return "[语音转文字] " + speechTexts.value(message.messageId);
+        }
+        return "[语音]";
+    default:
+        return "";
     }
 }
 
-void MessageImageLabel::updateUI(const QString& fileId, const QByteArray& content)
+void MessageListModel::ensureContentLoaded(int row) const
 {
-    if (this->fileId != fileId) {
-        // 没对上 fileId, 当前响应的图片是其他的 图片消息 请求的.
+    const Message& message = rows[row].message;
+    if (message.messageType == TEXT_TYPE || message.messageType == SPEECH_TYPE
+            || !message.content.isEmpty() || message.fileId.isEmpty()) {
+        return;
+    }
+    if (requestedFileIds.contains(message.fileId)) {
         return;
     }
-    // 对上了, 真正显示图片内容
-    this->content = content;
+    requestedFileIds.insert(message.fileId);
+    // 绘制的时候才触发加载, 所以这里是 const 的. 加载完成之后要修改消息内容.
+    MessageListModel* model = const_cast<MessageListModel*>(this);
+    QString fileId = message.fileId;
+    DataCenter::getInstance()->getSingleFileAsync(fileId, model, [=](const QByteArray& content) {
+        model->updateContent(fileId, content);
+    });
+}
 
-    // 进行绘制图片到界面上的操作.
-    this->update();
+void MessageListModel::updateContent(const QString &fileId, const QByteArray &content)
+{
+    requestedFileIds.remove(fileId);
+
+    // 同一个文件可能被多条消息引用, 都要更新
+    int first = -1;
+    int last = -1;
+    for (int i = 0; i < rows.size(); ++i) {
+        Message& message = rows[i].message;
+        if (message.fileId != fileId || !message.content.isEmpty()) {
+            continue;
+        }
+        message.content = content;
+        if (first < 0) {
+            first = i;
+        }
+        last = i;
+    }
+    if (first >= 0) {
+        emit dataChanged(index(first), index(last));
+    }
 }
 
-// 真正进行绘制图片到界面上的操作.
-void MessageImageLabel::paintEvent(QPaintEvent *event)
+void MessageListModel::fetchContent(int row, const std::function<void (const QByteArray &)> &callback)
 {
-    (void) event;
-    // 1. 先拿到该元素的父元素, 看父元素的宽度是多少.
-    //    此处显示的图片宽度的上限 父元素宽度的 60% .
-    QObject* object = this->parent();
-    if (!object->isWidgetType()) {
-        // 这个逻辑理论上来说是不会存在的.
+    const Message& message = rows[row].message;
+    if (!message.content.isEmpty()) {
+        callback(message.content);
+        return;
+    }
+    if (message.fileId.isEmpty()) {
+        Toast::showMessage("数据尚未加载成功, 请稍后重试");
+        return;
+    }
+    if (requestedFileIds.contains(message.fileId)) {
+        // 正在下载, 不重复请求
         return;
     }
-    QWidget* parent = dynamic_cast<QWidget*>(object);
-    int width = parent->width() * 0.6;
+    QString fileId = message.fileId;
+    requestedFileIds.insert(fileId);
+    DataCenter::getInstance()->getSingleFileAsync(fileId, this, [=](const QByteArray& content) {
+        this->updateContent(fileId, content);
+        callback(content);
+    });
+}
 
-    // 2. 加载二进制数据为图片对象
-    QImage image;
-    if (content.isEmpty()) {
-        // 此时图片的响应数据还没回来.
-        // 此处先拿一个 "固定默认图片" 顶替一下.
-        QByteArray tmpContent = loadFileToByteArray(":/resource/image/image.png");
-        image.loadFromData(tmpContent);
-    } else {
-        // 此处的 load 操作 QImage 能够自动识别当前图片是啥类型的 (png, jpg....)
-        image.loadFromData(content);
+bool MessageListModel::isPlayingAt(int row) const
+{
+    return !playingMessageId.isEmpty() && rows[row].message.messageId == playingMessageId;
+}
+
+bool MessageListModel::showWaveformAt(int row) const
+{
+    const Message& message = rows[row].message;
+    return message.messageType == SPEECH_TYPE && !message.speechWaveform.isEmpty()
+           && !speechTexts.contains(message.messageId);
+}
+
+void MessageListModel::setPlayingMessage(const QString &messageId)
+{
+    QString oldMessageId = playingMessageId;
+    playingMessageId = messageId;
+    for (int i = 0; i < rows.size(); ++i) {
+        const QString& id = rows[i].message.messageId;
+        if ((!oldMessageId.isEmpty() && id == oldMessageId) || (!messageId.isEmpty() && id == messageId)) {
+            emit dataChanged(index(i), index(i));
+        }
     }
+}
 
-    // 3. 针对图片进行缩放.
-    int height = 0;
-    if (image.width() > width) {
-        // 发现图片更宽, 就需要把图片缩放一下, 使用 width 作为实际的宽度
-        // 等比例缩放.
-        height = ((double)image.height() / image.width()) * width;
-    } else {
-        // 图片本身不太宽, 不需要缩放.
-        width = image.width();
-        height = image.height();
+void MessageListModel::setSpeechText(const QString &messageId, const QString &text)
+{
+    speechTexts[messageId] = text;
+    notifyMessageChanged(messageId);
+}
+
+void MessageListModel::clearSpeechText(const QString &messageId)
+{
+    if (speechTexts.remove(messageId)) {
+        notifyMessageChanged(messageId);
+    }
+}
+
+void MessageListModel::notifyMessageChanged(const QString &messageId)
+{
+    for (int i = 0; i < rows.size(); ++i) {
+        if (rows[i].message.messageId == messageId) {
+            emit dataChanged(index(i), index(i));
+            break;
+        }
     }
+}
 
-    // pixmap 只是一个中间变量. QImage 不能直接转成 QIcon, 需要 QPixmap 中转一下
-    QPixmap pixmap = QPixmap::fromImage(image);
-    // imageBtn->setFixedSize(width, height);
-    imageBtn->setIconSize(QSize(width, height));
-    imageBtn->setIcon(QIcon(pixmap));
+////////////////////////////////////////////////////////
+/// 绘制一条消息
+////////////////////////////////////////////////////////
+MessageItemDelegate::MessageItemDelegate(QListView *view)
+    : QStyledItemDelegate(view), view(view)
+{
+    contentFont.setFamily("微软雅黑");
+    contentFont.setPixelSize(16);
+    nameFont.setPixelSize(12);
+    textLayoutCache.setMaxCost(TEXT_LAYOUT_CACHE_SIZE);
+}
 
-    // 4. 由于图片高度是计算算出来的. 该元素的父对象的高度, 能够容纳下当前的元素.
-    //    此处 + 50 是为了能够容纳下 上方的 "名字" 部分. 同时留下一点 冗余 空间.
-    parent->setFixedHeight(height + 50);
+QRect MessageItemDelegate::avatarRect(const QRect &itemRect, bool isLeft) const
+{
+    if (isLeft) {
+        return QRect(itemRect.left() + MARGIN_LEFT, itemRect.top() + MARGIN_TOP, AVATAR_SIZE, AVATAR_SIZE);
+    }
+    return QRect(itemRect.left() + itemRect.width() - MARGIN_RIGHT - AVATAR_SIZE, itemRect.top() + MARGIN_TOP,
+                 AVATAR_SIZE, AVATAR_SIZE);
+}
 
-    // 5. 确定按钮所在的位置.
-    //    左侧消息, 和右侧消息, 要显示的位置是不同的.
+QRect MessageItemDelegate::contentRect(const QRect &itemRect, const QModelIndex &index) const
+{
+    const MessageListModel* model = static_cast<const MessageListModel*>(index.model());
+    bool isLeft = model->isLeftAt(index.row());
+    QSize size = contentSize(index, itemRect.width());
+
+    int left = 0;
+    int right = 0;
+    contentColumn(itemRect, isLeft, &left, &right);
+    int top = itemRect.top() + MARGIN_TOP + NAME_HEIGHT + SPACING;
     if (isLeft) {
-        imageBtn->setGeometry(10, 0, width, height);
-    } else {
-        int leftPos = this->width() - width - 10;
-        imageBtn->setGeometry(leftPos, 0, width, height);
+        return QRect(left + ARROW_WIDTH, top, size.width(), size.height());
     }
+    return QRect(right - ARROW_WIDTH - size.width(), top, size.width(), size.height());
 }
 
+QSize MessageItemDelegate::contentSize(const QModelIndex &index, int itemWidth) const
+{
+    const MessageListModel* model = static_cast<const MessageListModel*>(index.model());
+    const Message& message = model->messageAt(index.row());
+    // 消息正文宽度的上限, 是整个消息宽度的 60%
+    int maxWidth = itemWidth * 0.6;
+
+    if (message.messageType == IMAGE_TYPE) {
+        QSize size = imageSize(message);
+        if (size.width() > maxWidth) {
+            // 图片更宽, 等比例缩放, 使用 maxWidth 作为实际的宽度
+            size = QSize(maxWidth, (double)size.height() / size.width() * maxWidth);
+        }
+        return size;
+    }
+
+    if (model->showWaveformAt(index.row())) {
+        // 语音气泡只有一行高, 宽度随时长变化
+        int width = SPEECH_MIN_WIDTH + message.speechDurationMs / 1000 * SPEECH_WIDTH_PER_SECOND;
+        int height = QFontMetrics(contentFont).height() + 2 * BUBBLE_PADDING_V;
+        return QSize(qMin(width, maxWidth), height);
+    }
 
+    // 文本, 文件, 语音消息, 都是文字气泡
+    QSize size = textSize(index, maxWidth - 2 * BUBBLE_PADDING_H);
+    return QSize(size.width() + 2 * BUBBLE_PADDING_H, size.height() + 2 * BUBBLE_PADDING_V);
+}
 
+QSize MessageItemDelegate::textSize(const QModelIndex &index, int textWidth) const
+{
+    const MessageListModel* model = static_cast<const MessageListModel*>(index.model());
+    const Message& message = model->messageAt(index.row());
+    QString text = model->displayText(index.row());
+
+    auto it = textSizeCache.constFind(message.messageId);
+    if (it != textSizeCache.constEnd() && it->width == textWidth && it->text == text) {
+        // 缓存命中
+        return it->size;
+    }
+    // 排版一次, 排版的同时会记录尺寸
+    textLayout(index, textWidth);
+    return textSizeCache.value(message.messageId).size;
+}
 
+const QTextLayout &MessageItemDelegate::textLayout(const QModelIndex &index, int textWidth) const
+{
+    const MessageListModel* model = static_cast<const MessageListModel*>(index.model());
+    const Message& message = model->messageAt(index.row());
+    QString text = model->displayText(index.row());
+
+    TextLayoutEntry* entry = textLayoutCache.object(message.messageId);
+    if (entry != nullptr && entry->width == textWidth && entry->text == text) {
+        // 缓存命中
+        return entry->layout;
+    }
 
+    // QTextLayout 不识别 '\n', 需要替换成 Unicode 的换行符
+    QString layoutText = text;
+    layoutText.replace('\n', QChar::LineSeparator);
+    entry = new TextLayoutEntry();
+    entry->width = textWidth;
+    entry->text = text;
+    QTextLayout& layout = entry->layout;
+    layout.setText(layoutText);
+    layout.setFont(contentFont);
+    QTextOption option;
+    option.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    layout.setTextOption(option);
+    layout.setCacheEnabled(true);
+
+    // 逐行排版, 得到实际占用的宽度和高度
+    qreal height = 0;
+    qreal maxLineWidth = 0;
+    layout.beginLayout();
+    while (true) {
+        QTextLine line = layout.createLine();
+        if (!line.isValid()) {
+            break;
+        }
+        line.setLineWidth(textWidth);
+        line.setPosition(QPointF(0, height));
+        height += line.height();
+        maxLineWidth = qMax(maxLineWidth, line.naturalTextWidth());
+    }
+    layout.endLayout();
 
+    // 尺寸每条消息都保留, 排版结果只保留最近使用的一部分
+    textSizeCache.insert(message.messageId, TextSizeEntry{textWidth, text, QSize(qMin(qCeil(maxLineWidth), textWidth), qCeil(height))});
+    textLayoutCache.insert(message.messageId, entry);
+    return entry->layout;
+}
 
+bool MessageItemDelegate::updateSizeHints(int first, int last) const
+{
+    const MessageListModel* model = static_cast<const MessageListModel*>(view->model());
+    bool changed = false;
+    for (int row = first; row <= last; ++row) {
+        auto it = sizeHints.constFind(model->messageAt(row).messageId);
+        if (it == sizeHints.constEnd()) {
+            // 还没有布局过的行, 之后布局的时候自然会使用新的尺寸
+            continue;
+        }
+        QSize oldSize = it.value();
+        // sizeHint 会记录新的尺寸
+        if (sizeHint(QStyleOptionViewItem(), model->index(row)) != oldSize) {
+            changed = true;
+        }
+    }
+    return changed;
+}
 
+void MessageItemDelegate::clearLayoutCache()
+{
+    sizeHints.clear();
+    textSizeCache.clear();
+    textLayoutCache.clear();
+    contentHashes.clear();
+}
 
+QString MessageItemDelegate::imageKey(const Message &message) const
+{
+    if (message.content.isEmpty()) {
+        // 图片还没有加载回来, 使用默认图片
+        return "placeholder";
+    }
+    if (!message.fileId.isEmpty()) {
+        return message.fileId;
+    }
+    auto it = contentHashes.find(message.messageId);
+    if (it == contentHashes.end()) {
+        QString hash = QCryptographicHash::hash(message.content, QCryptographicHash::Md5).toHex();
+        it = contentHashes.insert(message.messageId, hash);
+    }
+    return it.value();
+}
 
+QSize MessageItemDelegate::imageSize(const Message &message) const
+{
+    QString key = imageKey(message);
+    auto it = imageSizes.find(key);
+    if (it != imageSizes.end()) {
+        return it.value();
+    }
 
+    QSize size;
+    if (message.content.isEmpty()) {
+        size = placeholderImage().size();
+    } else {
+        // 只读取图片的头部得到尺寸, 不进行解码
+        QByteArray content = message.content;
+        QBuffer buffer(&content);
+        QImageReader reader(&buffer);
+        size = reader.size();
+        if (!size.isValid()) {
+            // 图片损坏或者格式不支持, 读不出尺寸, 按照默认图片的尺寸占位
+            LOG() << "读取图片尺寸失败! " << reader.errorString();
+            size = placeholderImage().size();
+        }
+    }
+    imageSizes.insert(key, size);
+    return size;
+}
 
+QSize MessageItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    (void) option;
+    int width = view->viewport()->width();
+    QSize size = contentSize(index, width);
+    int height = MARGIN_TOP + NAME_HEIGHT + SPACING + size.height() + SPACING;
+    QSize result(width, qMax(height, ITEM_MIN_HEIGHT));
+    const MessageListModel* model = static_cast<const MessageListModel*>(index.model());
+    sizeHints.insert(model->messageAt(index.row()).messageId, result);
+    return result;
+}
 
+void MessageItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const MessageListModel* model = static_cast<const MessageListModel*>(index.model());
+    int row = index.row();
+    const Message& message = model->messageAt(row);
+    bool isLeft = model->isLeftAt(row);
+    const QRect& itemRect = option.rect;
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+
+    // 1. 头像. 自己的消息使用最新的头像和昵称, 修改之后重绘即可生效.
+    UserInfo* myself = DataCenter::getInstance()->getMyself();
+    bool useMyself = !isLeft && myself != nullptr;
+    const QIcon& avatar = useMyself ? myself->avatar : message.sender.avatar;
+    const QString& avatarUserId = useMyself ? myself->userId : message.sender.userId;
+    AvatarCache::getInstance()->paint(painter, avatarRect(itemRect, isLeft), AvatarCache::userKey(avatarUserId), avatar);
+
+    // 2. 名字和时间
+    const QString& nickname = useMyself ? myself->nickname : message.sender.nickname;
+    int left = 0;
+    int right = 0;
+    contentColumn(itemRect, isLeft, &left, &right);
+    QRect nameRect(left + ARROW_WIDTH, itemRect.top() + MARGIN_TOP, right - left - 2 * ARROW_WIDTH, NAME_HEIGHT);
+    painter->setFont(nameFont);
+    painter->setPen(theme::MESSAGE_NAME);
+    painter->drawText(nameRect, (isLeft ? Qt::AlignLeft : Qt::AlignRight) | Qt::AlignBottom, nickname + " | " + message.time);
+
+    // 3. 消息正文. 非文本消息, 在第一次绘制的时候才去加载正文.
+    if (message.messageType != TEXT_TYPE) {
+        model->ensureContentLoaded(row);
+    }
+    QRect rect = contentRect(itemRect, index);
+    if (message.messageType == IMAGE_TYPE) {
+        paintImage(painter, rect, message);
+    } else if (model->showWaveformAt(row)) {
+        paintSpeech(painter, rect, isLeft, message, model->isPlayingAt(row));
+    } else {
+        // 可见的消息, 排版结果一般还在缓存中. 已经被淘汰的话, 这里重新排版.
+        int maxWidth = itemRect.width() * 0.6;
+        paintBubble(painter, rect, isLeft, textLayout(index, maxWidth - 2 * BUBBLE_PADDING_H));
+    }
 
+    painter->restore();
+}
 
+void MessageItemDelegate::paintBubbleBackground(QPainter *painter, const QRect &bubbleRect, bool isLeft) const
+{
+    // 绘制圆角矩形和箭头
+    QColor color = isLeft ? theme::BUBBLE_LEFT : theme::BUBBLE_RIGHT;
+    painter->setPen(QPen(color));
+    painter->setBrush(color);
+    painter->drawRoundedRect(bubbleRect, 10, 10);
 
+    QPainterPath path;
+    if (isLeft) {
+        int leftPos = bubbleRect.left();
+        path.moveTo(leftPos, bubbleRect.top() + 15);
+        path.lineTo(leftPos - ARROW_WIDTH, bubbleRect.top() + 20);
+        path.lineTo(leftPos, bubbleRect.top() + 25);
+    } else {
+        int rightPos = bubbleRect.left() + bubbleRect.width();
+        path.moveTo(rightPos, bubbleRect.top() + 15);
+        path.lineTo(rightPos + ARROW_WIDTH, bubbleRect.top() + 20);
+        path.lineTo(rightPos, bubbleRect.top() + 25);
+    }
+    path.closeSubpath();   // 绘制的线形成闭合的多边形, 才能进行使用 Brush 填充颜色.
+    painter->drawPath(path);
+}
 
+void MessageItemDelegate::paintBubble(QPainter *painter, const QRect &bubbleRect, bool isLeft, const QTextLayout &layout) const
+{
+    // 1. 绘制圆角矩形和箭头
+    paintBubbleBackground(painter, bubbleRect, isLeft);
 
+    // 2. 绘制文字. 使用缓存的排版结果, 不再重新计算换行.
+    painter->setPen(theme::BUBBLE_TEXT);
+    layout.draw(painter, QPointF(bubbleRect.left() + BUBBLE_PADDING_H, bubbleRect.top() + BUBBLE_PADDING_V));
+}
 
+void MessageItemDelegate::paintSpeech(QPainter *painter, const QRect &bubbleRect, bool isLeft, const Message &message, bool playing) const
+{
+    paintBubbleBackground(painter, bubbleRect, isLeft);
+    QRect inner = bubbleRect.adjusted(BUBBLE_PADDING_H, BUBBLE_PADDING_V, -BUBBLE_PADDING_H, -BUBBLE_PADDING_V);
+
+    // 1. 时长. 左侧消息显示在右边, 右侧消息显示在左边, 都靠近气泡外侧
+    QString duration = QString("%1\"").arg(qMax(1, (message.speechDurationMs + 500) / 1000));
+    int durationWidth = QFontMetrics(contentFont).horizontalAdvance(duration);
+    painter->setFont(contentFont);
+    painter->setPen(theme::BUBBLE_TEXT);
+    painter->drawText(inner, (isLeft ? Qt::AlignRight : Qt::AlignLeft) | Qt::AlignVCenter, duration);
+
+    // 2. 波形. 可用宽度放不下所有的条时, 等间隔抽取
+    QRect waveRect = isLeft ? inner.adjusted(0, 0, -durationWidth - SPACING, 0)
+                            : inner.adjusted(durationWidth + SPACING, 0, 0, 0);
+    const QByteArray& waveform = message.speechWaveform;
+    int barCount = qMin<int>(waveform.size(), (waveRect.width() + WAVEFORM_BAR_SPACING) / (WAVEFORM_BAR_WIDTH + WAVEFORM_BAR_SPACING));
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(playing ? theme::SPEECH_WAVEFORM_PLAYING : theme::SPEECH_WAVEFORM);
+    for (int i = 0; i < barCount; ++i) {
+        uchar value = waveform[i * waveform.size() / barCount];
+        int height = qMax(2, waveRect.height() * value / 255);
+        int x = waveRect.left() + i * (WAVEFORM_BAR_WIDTH + WAVEFORM_BAR_SPACING);
+        painter->drawRoundedRect(QRectF(x, waveRect.center().y() - height / 2.0, WAVEFORM_BAR_WIDTH, height), 1, 1);
+    }
+}
 
+void MessageItemDelegate::paintImage(QPainter *painter, const QRect &imageRect, const Message &message) const
+{
+    // 缩略图按照实际的像素尺寸生成, 高分屏下也是清晰的
+    qreal dpr = painter->device()->devicePixelRatioF();
+    QSize pixelSize = imageRect.size() * dpr;
+    ThumbnailLoader* loader = ThumbnailLoader::getInstance();
+    QPixmap pixmap;
+
+    // 1. 先查缓存. 缓存中没有, 就交给线程池去解码, 完成之后再重绘. 这里不在主线程中解码图片.
+    if (!message.content.isEmpty()) {
+        QString key = imageKey(message);
+        if (loader->find(key, pixelSize, &pixmap)) {
+            pixmap.setDevicePixelRatio(dpr);
+            painter->drawPixmap(imageRect.topLeft(), pixmap);
+            return;
+        }
+        loader->load(key, message.content, pixelSize);
+    }
 
+    // 2. 此时图片还没有准备好, 先拿一个 "固定默认图片" 顶替一下. 默认图片很小, 直接在主线程中缩放.
+    if (!loader->find("placeholder", pixelSize, &pixmap)) {
+        pixmap = QPixmap::fromImage(placeholderImage().scaled(pixelSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+        loader->insert("placeholder", pixelSize, pixmap);
+    }
+    pixmap.setDevicePixelRatio(dpr);
+    painter->drawPixmap(imageRect.topLeft(), pixmap);
+}
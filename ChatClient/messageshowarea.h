@@ -1,20 +1,28 @@
 #ifndef MESSAGESHOWAREA_H
 #define MESSAGESHOWAREA_H
 
-#include <QScrollArea>
+#include <QListView>
+#include <QAbstractListModel>
+#include <QStyledItemDelegate>
 #include <QWidget>
-#include <QLabel>
-#include <QPushButton>
+#include <QSet>
+#include <QHash>
+#include <QCache>
+#include <QTextLayout>
 
 #include "model/data.h"
 
 // .h 文件中不宜进行 using namespace xxxx
 using model::Message;
 
+class MessageListModel;
+class MessageItemDelegate;
+
 ////////////////////////////////////////////////////////
 /// 表示消息展示区
+/// 基于 model/view 实现, 不再给每条消息创建控件. 只有可见的消息才会被绘制.
 ////////////////////////////////////////////////////////
-class MessageShowArea : public QScrollArea
+class MessageShowArea : public QListView
 {
     Q_OBJECT
 public:
@@ -24,106 +32,182 @@ public:
     void addMessage(bool isLeft, const Message& message);
     // 头插
     void addFrontMessage(bool isLeft, const Message& message);
+    // 尾插一批消息, 只触发一次布局
+    void addMessages(const QList<Message>& messages, const QString& myselfUserId);
     // 清空消息
     void clear();
-    // 滚动到末尾
+    // 显示一个会话的全部消息. 第一帧先显示最新的一屏, 更早的消息在后续的帧中, 按照每帧的时间预算分批补充.
+    // 切换到其他会话 (再次调用 loadMessages 或者 clear) 时, 还没完成的部分会被取消.
+    void loadMessages(const QList<Message>& messages, const QString& myselfUserId);
+    // 滚动到末尾, 并且之后一直停留在底部, 直到用户向上滚动
     void scrollToEnd();
 
-private:
-    QWidget* container;
-};
-
-////////////////////////////////////////////////////////
-/// 表示一个消息元素
-/// 这个里面要能同时支持 文本消息, 图片消息, 文件消息, 语音消息.
-/// 当前先只考虑文本消息. 另外几个后续慢慢添加.
-////////////////////////////////////////////////////////
-
-class MessageItem : public QWidget {
-    Q_OBJECT
-
-public:
-    // 此处的 isLeft 表示这个 Item 是否是一个 "左侧消息"
-    MessageItem(bool isLeft);
-
-    // 通过 工厂方法 创建 MessageItem 实例
-    static MessageItem* makeMessageItem(bool isLeft, const Message& message);
+    void doItemsLayout() override;
 
-    // 添加工厂函数
-    static QWidget* makeTextMessageItem(bool isLeft, const QString& text);
-    static QWidget* makeImageMessageItem(bool isLeft, const QString& fileId, const QByteArray& content);
-    static QWidget* makeFileMessageItem(bool isLeft, const Message& message);
-    static QWidget* makeSpeechMessageItem(bool isLeft, const Message& message);
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void contextMenuEvent(QContextMenuEvent* event) override;
 
 private:
-    bool isLeft;
+    // 点击消息正文. 图片消息查看原图, 文件消息触发另存为, 语音消息触发播放
+    void clickContent(int row);
+    void saveAsFile(const QByteArray& content);
+    // 在下一帧中, 继续补充更早的消息
+    void loadOlderMessages(quint64 generation);
+
+    // 用户滚动之后, 记录新的锚点
+    void saveAnchor();
+    // 布局完成之后, 根据锚点恢复滚动位置
+    void restoreAnchor();
+
+    MessageListModel* messageModel;
+    MessageItemDelegate* messageDelegate;
+
+    // 正在进行语音转文字的消息. key 为 speechConvertTextAsync 返回的识别 key, value 为等待这个结果的消息.
+    // 同一个 fileId 的语音可能出现在多条消息上 (比如转发), 所以是一组 messageId.
+    QHash<QString, QSet<QString>> convertingSpeech;
+
+    // 分批加载的状态. 每次开始加载新的会话, generation 都会增加, 之前会话还没完成的任务就会发现自己已经过期.
+    quint64 loadGeneration = 0;
+    QList<Message> pendingMessages;		// 还没有显示出来的更早的消息, 按照时间顺序排列
+    QString pendingMyselfUserId;
+    // 滚动锚点. 用户停留在底部时, 内容变化之后仍然停留在底部;
+    // 否则记录视口最上方的消息, 内容变化之后 (比如头插了更早的消息), 这条消息仍然停留在原来的位置.
+    bool stickToBottom = true;
+    QString anchorMessageId;
+    int anchorOffset = 0;				// 锚点消息的顶部相对视口顶部的位置
+    bool userScrolling = false;
 };
 
 ////////////////////////////////////////////////////////
-/// 创建类表示 "文本消息" 正文部分
-/// 也让这个类表示 "文件消息"
+/// 消息展示区的数据模型
+/// 这里要能同时支持 文本消息, 图片消息, 文件消息, 语音消息.
 ////////////////////////////////////////////////////////
-
-class MessageContentLabel : public QWidget {
+class MessageListModel : public QAbstractListModel {
     Q_OBJECT
-public:
-    // fileName 可以作为 text 的一部分, 传递进来. 不需要单独列一个参数
-    MessageContentLabel(const QString& text, bool isLeft, model::MessageType messageType, const QString& fileId,
-        const QByteArray& content);
 
-    void paintEvent(QPaintEvent* event) override;
-    void mousePressEvent(QMouseEvent* event) override;
+public:
+    explicit MessageListModel(QObject* parent = nullptr);
 
-    void updateUI(const QString& fileId, const QByteArray& fileContent);
-    void saveAsFile(const QByteArray& content);
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
 
-    void playDone();
+    void appendMessage(bool isLeft, const Message& message);
+    void prependMessage(bool isLeft, const Message& message);
+    // 一次性插入多条消息, 只触发一次插入通知. 发送者不是自己的消息显示在左侧.
+    void insertMessages(int row, const QList<Message>& messages, const QString& myselfUserId);
+    void clear();
 
-    void contextMenuEvent(QContextMenuEvent* event) override;
-    void speechConvertTextDone(const QString& fileId, const QString& text);
+    const Message& messageAt(int row) const;
+    int findRow(const QString& messageId) const;
+    // 此处的 isLeft 表示这条消息是否是一个 "左侧消息"
+    bool isLeftAt(int row) const;
+    // 消息正文要显示的文字. 文件消息显示文件名, 语音消息显示播放状态或者转换出的文字.
+    QString displayText(int row) const;
+
+    // 图片, 文件消息的正文, 在第一次被绘制的时候, 才通过网络加载
+    void ensureContentLoaded(int row) const;
+    void updateContent(const QString& fileId, const QByteArray& content);
+    // 获取消息正文, 还没有加载的话先通过网络加载. 语音消息的正文只有在播放的时候才加载.
+    void fetchContent(int row, const std::function<void(const QByteArray&)>& callback);
+
+    // 语音消息的播放状态和转文字结果
+    void setPlayingMessage(const QString& messageId);
+    void setSpeechText(const QString& messageId, const QString& text);
+    void clearSpeechText(const QString& messageId);
+    bool isPlayingAt(int row) const;
+    // 语音消息带有波形, 并且还没有转成文字时, 显示为波形气泡
+    bool showWaveformAt(int row) const;
 
 private:
-    QLabel* label;
-    bool isLeft;
-
-    model::MessageType messageType;
-    QString fileId;
-    QByteArray content;
-
-    bool loadContentDone = false;
+    struct MessageRow {
+        Message message;
+        bool isLeft;
+    };
+    QList<MessageRow> rows;
+
+    // 某条消息的显示内容变化了, 通知界面重绘这一行
+    void notifyMessageChanged(const QString& messageId);
+
+    // 已经发起过下载请求的 fileId, 避免重复请求
+    mutable QSet<QString> requestedFileIds;
+
+    // 正在播放的语音消息
+    QString playingMessageId;
+    // 语音转文字的结果, key 为 messageId
+    QHash<QString, QString> speechTexts;
 };
 
 ////////////////////////////////////////////////////////
-/// 创建类表示 "图片消息" 正文部分
+/// 绘制一条消息: 头像, 名字和时间, 以及消息正文 (气泡或者图片)
 ////////////////////////////////////////////////////////
-
-class MessageImageLabel : public QWidget {
+class MessageItemDelegate : public QStyledItemDelegate {
     Q_OBJECT
 
 public:
-    MessageImageLabel(const QString& fileId, const QByteArray& content, bool isLeft);
-
-    void updateUI(const QString& fileId, const QByteArray& content);
-    void paintEvent(QPaintEvent* event);
-
-private:
-    QPushButton* imageBtn;
-
-    QString fileId;  		// 该图片在服务器对应的文件 id.
-    QByteArray content;		// 图片的二进制数据
-    bool isLeft;
-};
-
-
-
-
-
-
-
+    explicit MessageItemDelegate(QListView* view);
 
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
 
+    // 命中测试使用. 根据这一行的矩形区域, 计算出头像和消息正文所在的位置.
+    QRect avatarRect(const QRect& itemRect, bool isLeft) const;
+    QRect contentRect(const QRect& itemRect, const QModelIndex& index) const;
 
+    // 消息内容变化之后, 重新计算这几行的尺寸. 和上一次布局时的尺寸不同, 才需要重新布局.
+    bool updateSizeHints(int first, int last) const;
 
+    // 消息列表整体被替换时 (比如切换会话), 清空排版缓存. 图片缩略图由 ThumbnailLoader 统一缓存, 不在这里清空.
+    void clearLayoutCache();
 
+private:
+    // 一条消息的文字尺寸. 只有消息的文字或者可用宽度变化时才重新计算.
+    struct TextSizeEntry {
+        int width = -1;						// 排版时使用的可用宽度
+        QString text;						// 排版时的文字
+        QSize size;							// 文字实际占用的尺寸
+    };
+    // 一条消息的文字排版结果, 绘制的时候直接使用
+    struct TextLayoutEntry {
+        int width = -1;
+        QString text;
+        QTextLayout layout;
+    };
+
+    // 获取 (消息, 可用宽度) 对应的文字尺寸, 缓存中没有的时候才进行排版
+    QSize textSize(const QModelIndex& index, int textWidth) const;
+    // 获取 (消息, 可用宽度) 对应的排版结果, 缓存中没有的时候才进行排版. 返回的引用在下一次排版之前有效.
+    const QTextLayout& textLayout(const QModelIndex& index, int textWidth) const;
+
+    // 消息正文的尺寸 (文本消息为气泡的尺寸, 图片消息为缩放后的图片尺寸)
+    QSize contentSize(const QModelIndex& index, int itemWidth) const;
+    void paintBubbleBackground(QPainter* painter, const QRect& bubbleRect, bool isLeft) const;
+    void paintBubble(QPainter* painter, const QRect& bubbleRect, bool isLeft, const QTextLayout& layout) const;
+    // 语音气泡: 波形和时长
+    void paintSpeech(QPainter* painter, const QRect& bubbleRect, bool isLeft, const Message& message, bool playing) const;
+    void paintImage(QPainter* painter, const QRect& imageRect, const Message& message) const;
+
+    // 图片的缓存 key. 有 fileId 时使用 fileId, 否则使用图片内容的哈希值
+    QString imageKey(const Message& message) const;
+    // 图片的原始尺寸. 只读取一次图片头部.
+    QSize imageSize(const Message& message) const;
+
+    QListView* view;
+    QFont contentFont;
+    QFont nameFont;
+
+    // 每条消息最近一次计算出的尺寸, 用来判断内容变化之后是否需要重新布局. key 为 messageId
+    mutable QHash<QString, QSize> sizeHints;
+    // 文字尺寸缓存, 每条消息一项. key 为 messageId
+    mutable QHash<QString, TextSizeEntry> textSizeCache;
+    // 文字排版缓存. 带有字形缓存, 占用内存较多, 只保留最近绘制 / 排版的消息. key 为 messageId
+    mutable QCache<QString, TextLayoutEntry> textLayoutCache;
+
+    // 图片的原始尺寸. key 为图片 key
+    mutable QHash<QString, QSize> imageSizes;
+    // 没有 fileId 的图片 (刚刚发送出去的图片), 内容的哈希值. key 为 messageId
+    mutable QHash<QString, QString> contentHashes;
+};
 
 #endif // MESSAGESHOWAREA_H
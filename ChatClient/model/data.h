@@ -17,6 +17,7 @@
 #include "speech_recognition.qpb.h"
 #include "message_storage.qpb.h"
 #include "message_transmit.qpb.h"
+#include "sync.qpb.h"
 
 // 创建命名空间
 namespace model {
@@ -123,6 +124,12 @@ enum MessageType {
     SPEECH_TYPE 	// 语音消息
 };
 
+// 语音消息的时长和波形. 发送方录制结束时计算一次, 本地显示的消息和发给服务器的消息都使用这一份.
+struct SpeechMeta {
+    int durationMs = 0;
+    QByteArray waveform;
+};
+
 class Message {
 public:
     QString messageId = "";				// 消息的编号
@@ -133,10 +140,12 @@ public:
     QByteArray content;					// 消息的正文内容
     QString fileId = "";				// 文件的身份标识. 当消息类型为 文件, 图片, 语音 的时候, 才有效. 当消息类型为 文本, 则为 ""
     QString fileName = ""; 				// 文件名称. 只是当消息类型为 文件 消息, 才有效. 其他消息均为 ""
+    int speechDurationMs = 0;			// 语音的时长和波形. 只是当消息类型为 语音 消息, 才有效. 不需要下载语音就可以显示
+    QByteArray speechWaveform;
 
-    // 此处 extraInfo 目前只是在消息类型为文件消息时, 作为 "文件名" 补充.
+    // 此处 extraInfo 目前只是在消息类型为文件消息时, 作为 "文件名" 补充. speechMeta 只在语音消息时使用.
     static Message makeMessage(MessageType messageType, const QString& chatSessionId, const UserInfo& sender,
-                               const QByteArray& content, const QString& extraInfo) {
+                               const QByteArray& content, const QString& extraInfo, const SpeechMeta& speechMeta = SpeechMeta()) {
         if (messageType == TEXT_TYPE) {
             return makeTextMessage(chatSessionId, sender, content);
         } else if (messageType == IMAGE_TYPE) {
@@ -144,7 +153,7 @@ public:
         } else if (messageType == FILE_TYPE) {
             return makeFileMessage(chatSessionId, sender, content, extraInfo);
         } else if (messageType == SPEECH_TYPE) {
-            return makeSpeechMessage(chatSessionId, sender, content);
+            return makeSpeechMessage(chatSessionId, sender, content, extraInfo, speechMeta);
         } else {
             // 触发了未知的消息类型
             return Message();
@@ -187,6 +196,12 @@ public:
             if (messageInfo.message().speechMessage().hasFileId()) {
                 this->fileId = messageInfo.message().speechMessage().fileId();
             }
+            if (messageInfo.message().speechMessage().hasDurationMs()) {
+                this->speechDurationMs = messageInfo.message().speechMessage().durationMs();
+            }
+            if (messageInfo.message().speechMessage().hasWaveform()) {
+                this->speechWaveform = messageInfo.message().speechMessage().waveform();
+            }
         } else {
             // 错误的类型, 啥都不做了, 只是打印一个日志
             LOG() << "非法的消息类型! type=" << type;
@@ -243,7 +258,9 @@ private:
         return message;
     }
 
-    static Message makeSpeechMessage(const QString& chatSessionId, const UserInfo& sender, const QByteArray& content) {
+    // fileId 为空表示还没有上传到服务器; 边录边传的语音, 发送时就已经有 fileId 了
+    static Message makeSpeechMessage(const QString& chatSessionId, const UserInfo& sender, const QByteArray& content, const QString& fileId,
+                                     const SpeechMeta& speechMeta) {
         Message message;
         message.messageId = makeId();
         message.chatSessionId = chatSessionId;
@@ -251,8 +268,9 @@ private:
         message.time = formatTime(getTime());
         message.content = content;
         message.messageType = SPEECH_TYPE;
-        // fileId 后续使用的时候进一步设置
-        message.fileId = "";
+        message.fileId = fileId;
+        message.speechDurationMs = speechMeta.durationMs;
+        message.speechWaveform = speechMeta.waveform;
         // fileName 不使用, 直接设为 ""
         message.fileName = "";
         return message;
@@ -5,8 +5,14 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 
+#include "../debug.h"
+#include "../perfmonitor.h"
+
 namespace model {
 
+// 历史消息搜索结果, 每页的数目
+static const int SEARCH_MESSAGE_PAGE_SIZE = 20;
+
 DataCenter* DataCenter::instance = nullptr;
 
 DataCenter *DataCenter::getInstance()
@@ -43,6 +49,9 @@ DataCenter::DataCenter() : netClient(this)
     memberList = new QHash<QString, QList<UserInfo>>();
     unreadMessageCount = new QHash<QString, int>();
 
+    // 下载过的文件最多缓存 64MB
+    fileCache.setMaxCost(64 * 1024 * 1024);
+
     // 加载数据
     loadDataFile();
 }
@@ -74,6 +83,7 @@ void DataCenter::initDataFile()
 
 void DataCenter::saveDataFile()
 {
+    PERF_SCOPE("DataCenter::saveDataFile");
     QString filePath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/ChatClient.json";
 
     QFile file(filePath);
@@ -106,6 +116,7 @@ void DataCenter::saveDataFile()
 // 加载文件, 是在 DataCenter 被实例化的时候, 调用执行的
 void DataCenter::loadDataFile()
 {
+    PERF_SCOPE("DataCenter::loadDataFile");
     // 确保在加载之前, 先针对文件进行初始化操作.
     QString filePath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/ChatClient.json";
 
@@ -143,6 +154,47 @@ void DataCenter::loadDataFile()
     file.close();
 }
 
+void DataCenter::clearUserData()
+{
+    // 还没有完成的启动流程不再继续统计
+    bootstrapPending = 0;
+    for (const auto& c : bootstrapConnections) {
+        disconnect(c);
+    }
+    bootstrapConnections.clear();
+
+    delete myself;
+    myself = nullptr;
+    delete friendList;
+    friendList = nullptr;
+    delete chatSessionList;
+    chatSessionList = nullptr;
+    delete applyList;
+    applyList = nullptr;
+    delete searchUserResult;
+    searchUserResult = nullptr;
+    delete searchMessageResult;
+    searchMessageResult = nullptr;
+    memberList->clear();
+    recentMessages->clear();
+    unreadMessageCount->clear();
+
+    currentChatSessionId = "";
+    currentVerifyCodeId = "";
+    // 搜索编号加一, 还没有返回的搜索结果会被丢弃
+    ++searchMessageId;
+    searchMessageHasMore = false;
+    searchMessageKey = "";
+
+    fileCache.clear();
+    speechTextCache.clear();
+    convertingSpeechFileIds.clear();
+
+    // 登录会话和未读消息数都保存在文件中, 一起清空
+    loginSessionId = "";
+    saveDataFile();
+}
+
 void DataCenter::clearUnread(const QString &chatSessionId)
 {
     (*unreadMessageCount)[chatSessionId] = 0;
@@ -159,9 +211,20 @@ void DataCenter::addUnread(const QString &chatSessionId)
     saveDataFile();
 }
 
+void DataCenter::addUnread(const QHash<QString, int> &counts)
+{
+    for (auto it = counts.begin(); it != counts.end(); ++it) {
+        (*unreadMessageCount)[it.key()] += it.value();
+    }
+
+    // 手动保存一下结果到文件.
+    saveDataFile();
+}
+
 int DataCenter::getUnread(const QString &chatSessionId)
 {
-    return (*unreadMessageCount)[chatSessionId];
+    // 使用 value 而不是 [], 避免查询的时候插入新的 key
+    return unreadMessageCount->value(chatSessionId, 0);
 }
 
 void DataCenter::initWebsocket()
@@ -175,6 +238,120 @@ void DataCenter::closeWebsocket()
     netClient.closeWebsocket();
 }
 
+void DataCenter::bootstrapAsync()
+{
+    // 上一次启动过程中, 没有完成的连接要断开, 避免重复计数
+    for (const auto& c : bootstrapConnections) {
+        disconnect(c);
+    }
+    bootstrapConnections.clear();
+
+    // 四项数据之间没有先后依赖, 统一在这里发出, 谁先回来先渲染谁.
+    // 依赖个人信息的逻辑 (比如消息展示区区分左右), 由界面等待 getMyselfDone 之后再处理.
+    bootstrapPending = 4;
+    bootstrapTimer.start();
+    bootstrapConnections.push_back(connect(this, &DataCenter::getMyselfDone, this, [=]() {
+        finishBootstrapStage("个人信息");
+    }, Qt::SingleShotConnection));
+    bootstrapConnections.push_back(connect(this, &DataCenter::getMyselfFailed, this, [=]() {
+        abortBootstrap("个人信息");
+    }, Qt::SingleShotConnection));
+    bootstrapConnections.push_back(connect(this, &DataCenter::getChatSessionListDone, this, [=]() {
+        finishBootstrapStage("会话列表");
+    }, Qt::SingleShotConnection));
+    bootstrapConnections.push_back(connect(this, &DataCenter::getFriendListDone, this, [=]() {
+        finishBootstrapStage("好友列表");
+    }, Qt::SingleShotConnection));
+    bootstrapConnections.push_back(connect(this, &DataCenter::getApplyListDone, this, [=]() {
+        finishBootstrapStage("好友申请列表");
+    }, Qt::SingleShotConnection));
+
+#if BOOTSTRAP_AGGREGATE
+    // 一个请求拿到所有数据
+    netClient.syncBootstrap(loginSessionId);
+#else
+    // 四个请求同时发出, 由 QNetworkAccessManager 并发处理
+    netClient.getMyself(loginSessionId);
+    netClient.getChatSessionList(loginSessionId);
+    netClient.getFriendList(loginSessionId);
+    netClient.getApplyList(loginSessionId);
+#endif
+}
+
+void DataCenter::finishBootstrapStage(const QString &stage)
+{
+    if (bootstrapPending <= 0) {
+        return;
+    }
+    --bootstrapPending;
+    qint64 elapsed = bootstrapTimer.elapsed();
+    LOG() << "[启动] " << stage << " 加载完成, elapsed=" << elapsed << "ms";
+
+    if (bootstrapPending == 0) {
+        LOG() << "[启动] 初始数据全部加载完成, aggregate=" << BOOTSTRAP_AGGREGATE << ", time-to-interactive=" << elapsed << "ms";
+        emit bootstrapDone(elapsed, true);
+    }
+}
+
+void DataCenter::abortBootstrap(const QString &stage)
+{
+    if (bootstrapPending <= 0) {
+        return;
+    }
+    bootstrapPending = 0;
+    for (const auto& c : bootstrapConnections) {
+        disconnect(c);
+    }
+    bootstrapConnections.clear();
+
+    // 已经发出的其他请求不受影响, 返回之后界面照常更新
+    qint64 elapsed = bootstrapTimer.elapsed();
+    LOG() << "[启动] " << stage << " 加载失败, 启动未完成, elapsed=" << elapsed << "ms";
+    emit bootstrapDone(elapsed, false);
+}
+
+void DataCenter::resetBootstrap(std::shared_ptr<bite_im::SyncBootstrapRsp> resp)
+{
+    // 个人信息
+    if (myself == nullptr) {
+        myself = new UserInfo();
+    }
+    myself->load(resp->userInfo());
+
+    // 好友列表
+    if (friendList == nullptr) {
+        friendList = new QList<UserInfo>();
+    }
+    friendList->clear();
+    for (const auto& f : resp->friendList()) {
+        UserInfo userInfo;
+        userInfo.load(f);
+        friendList->push_back(userInfo);
+    }
+
+    // 会话列表
+    if (chatSessionList == nullptr) {
+        chatSessionList = new QList<ChatSessionInfo>();
+    }
+    chatSessionList->clear();
+    for (const auto& c : resp->chatSessionInfoList()) {
+        ChatSessionInfo chatSessionInfo;
+        chatSessionInfo.load(c);
+        chatSessionList->push_back(chatSessionInfo);
+    }
+
+    // 好友申请列表
+    if (applyList == nullptr) {
+        applyList = new QList<UserInfo>();
+    }
+    applyList->clear();
+    for (const auto& event : resp->event()) {
+        UserInfo userInfo;
+        userInfo.load(event.sender());
+        applyList->push_back(userInfo);
+    }
+}
+
 void DataCenter::getMyselfAsync()
 {
     // 注意! DataCenter 只是负责 "处理数据", 真正访问网络进行通信, 需要通过 NetClient
@@ -314,9 +491,29 @@ void DataCenter::sendFileMessageAsync(const QString &chatSessionId, const QStrin
     netClient.sendMessage(loginSessionId, chatSessionId, MessageType::FILE_TYPE, content, fileName);
 }
 
-void DataCenter::sendSpeechMessageAsync(const QString &chatSessionid, const QByteArray &content)
+void DataCenter::sendSpeechMessageAsync(const QString &chatSessionid, const QByteArray &content, const SpeechMeta &speechMeta)
 {
-    netClient.sendMessage(loginSessionId, chatSessionid, MessageType::SPEECH_TYPE, content, "");
+    netClient.sendMessage(loginSessionId, chatSessionid, MessageType::SPEECH_TYPE, content, "", speechMeta);
+}
+
+void DataCenter::beginSpeechUpload()
+{
+    netClient.beginSpeechUpload();
+}
+
+void DataCenter::putSpeechChunkAsync(const QByteArray &chunk)
+{
+    netClient.putSpeechChunk(loginSessionId, chunk);
+}
+
+void DataCenter::cancelSpeechUpload()
+{
+    netClient.cancelSpeechUpload();
+}
+
+void DataCenter::finishSpeechMessageAsync(const QString &chatSessionId, const QByteArray &content, const SpeechMeta &speechMeta)
+{
+    netClient.finishSpeechUpload(loginSessionId, chatSessionId, content, speechMeta);
 }
 
 void DataCenter::changeNicknameAsync(const QString &nickname)
@@ -513,13 +710,34 @@ void DataCenter::resetSearchUserResult(const QList<bite_im::UserInfo> &userList)
 
 void DataCenter::searchMessageAsync(const QString &searchKey)
 {
+    ++searchMessageId;
+    searchMessageByTime = false;
+    searchMessageKey = searchKey;
     // 搜索的历史消息, 根据会话来组织的.
-    netClient.searchMessage(loginSessionId, this->currentChatSessionId, searchKey);
+    netClient.searchMessage(loginSessionId, this->currentChatSessionId, searchKey, searchMessageId, 0, SEARCH_MESSAGE_PAGE_SIZE);
 }
 
 void DataCenter::searchMessageByTimeAsync(const QDateTime &begTime, const QDateTime &endTime)
 {
-    netClient.searchMessageByTime(loginSessionId, currentChatSessionId, begTime, endTime);
+    ++searchMessageId;
+    searchMessageByTime = true;
+    searchMessageBegTime = begTime;
+    searchMessageEndTime = endTime;
+    netClient.searchMessageByTime(loginSessionId, currentChatSessionId, begTime, endTime, searchMessageId, 0, SEARCH_MESSAGE_PAGE_SIZE);
+}
+
+void DataCenter::searchMessageMoreAsync()
+{
+    if (searchMessageResult == nullptr || !searchMessageHasMore) {
+        return;
+    }
+    int pageOffset = searchMessageResult->size();
+    if (searchMessageByTime) {
+        netClient.searchMessageByTime(loginSessionId, currentChatSessionId, searchMessageBegTime, searchMessageEndTime,
+                                      searchMessageId, pageOffset, SEARCH_MESSAGE_PAGE_SIZE);
+    } else {
+        netClient.searchMessage(loginSessionId, currentChatSessionId, searchMessageKey, searchMessageId, pageOffset, SEARCH_MESSAGE_PAGE_SIZE);
+    }
 }
 
 QList<Message> *DataCenter::getSearchMessageResult()
@@ -527,18 +745,31 @@ QList<Message> *DataCenter::getSearchMessageResult()
     return searchMessageResult;
 }
 
-void DataCenter::resetSearchMessageResult(const QList<bite_im::MessageInfo> &msgList)
+bool DataCenter::resetSearchMessageResult(const QList<bite_im::MessageInfo> &msgList, int searchId, int pageOffset, bool hasMore)
 {
+    if (searchId != searchMessageId) {
+        // 之前的搜索还没返回的页, 和当前的搜索无关
+        LOG() << "丢弃过期的历史消息分页 searchId=" << searchId << ", 当前 searchId=" << searchMessageId << ", pageOffset=" << pageOffset;
+        return false;
+    }
     if (this->searchMessageResult == nullptr) {
         this->searchMessageResult = new QList<Message>();
     }
-    this->searchMessageResult->clear();
+    if (pageOffset == 0) {
+        this->searchMessageResult->clear();
+    } else if (pageOffset != searchMessageResult->size()) {
+        // 同一次搜索中, 已经接不上当前结果的页
+        LOG() << "丢弃接不上的历史消息分页 pageOffset=" << pageOffset << ", 当前结果数目=" << searchMessageResult->size();
+        return false;
+    }
 
     for (const auto& m : msgList) {
         Message message;
         message.load(m);
         searchMessageResult->push_back(message);
     }
+    searchMessageHasMore = hasMore;
+    return true;
 }
 
 void DataCenter::userLoginAsync(const QString &username, const QString &password)
@@ -571,14 +802,106 @@ void DataCenter::phoneRegisterAsync(const QString &phone, const QString &verifyC
     netClient.phoneRegister(phone, this->currentVerifyCodeId, verifyCode);
 }
 
-void DataCenter::getSingleFileAsync(const QString &fileId)
+void DataCenter::getSingleFileAsync(const QString &fileId, QObject* receiver, const std::function<void(const QByteArray&)>& callback)
 {
+    // 1. 已经下载过了, 直接从缓存中获取. 这里也通过事件循环回调, 保证调用者看到的行为总是异步的.
+    QByteArray* cached = fileCache.object(fileId);
+    if (cached != nullptr) {
+        QByteArray content = *cached;
+        QMetaObject::invokeMethod(receiver, [=]() {
+            callback(content);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    // 2. 登记订阅者. receiver 被销毁的时候, 把它从订阅者中移除.
+    bool downloading = fileSubscribers.contains(fileId);
+    FileSubscriber subscriber;
+    subscriber.receiver = receiver;
+    subscriber.callback = callback;
+    subscriber.destroyedConnection = connect(receiver, &QObject::destroyed, this, [=]() {
+        auto it = fileSubscribers.find(fileId);
+        if (it == fileSubscribers.end()) {
+            return;
+        }
+        it->removeIf([](const FileSubscriber& s) {
+            return s.receiver.isNull();
+        });
+    });
+    fileSubscribers[fileId].push_back(subscriber);
+
+    // 3. 同一个文件已经在下载中了, 不重复请求
+    if (downloading) {
+        return;
+    }
     netClient.getSingleFile(loginSessionId, fileId);
 }
 
-void DataCenter::speechConvertTextAsync(const QString& fileId, const QByteArray &content)
+void DataCenter::resetSingleFile(const QString &fileId, const QByteArray &content)
 {
-    netClient.speechConvertText(loginSessionId, fileId, content);
+    fileCache.insert(fileId, new QByteArray(content), content.size());
+
+    // 只通知关心这个文件的订阅者
+    QList<FileSubscriber> subscribers = fileSubscribers.take(fileId);
+    for (const auto& s : subscribers) {
+        disconnect(s.destroyedConnection);
+        if (s.receiver.isNull()) {
+            continue;
+        }
+        s.callback(content);
+    }
+}
+
+void DataCenter::cancelSingleFile(const QString &fileId)
+{
+    QList<FileSubscriber> subscribers = fileSubscribers.take(fileId);
+    for (const auto& s : subscribers) {
+        disconnect(s.destroyedConnection);
+    }
+}
+
+QString DataCenter::speechConvertTextAsync(const QString& fileId, const QByteArray &content)
+{
+    // 1. 还没有上传到服务器的语音 (没有 fileId), 只能上传语音数据进行识别, 结果也无法缓存.
+    //    同时可能有多条这样的语音在识别, 每次识别使用单独的 key 区分.
+    if (fileId.isEmpty()) {
+        QString key = network::NetClient::makeRequestId();
+        netClient.speechConvertText(loginSessionId, key, content);
+        return key;
+    }
+
+    // 2. 已经识别过了, 直接使用缓存的结果. 这里也通过事件循环通知, 保证调用者看到的行为总是异步的.
+    auto it = speechTextCache.find(fileId);
+    if (it != speechTextCache.end()) {
+        QString text = it.value();
+        QMetaObject::invokeMethod(this, [=]() {
+            emit this->speechConvertTextDone(fileId, text);
+        }, Qt::QueuedConnection);
+        return fileId;
+    }
+
+    // 3. 同一段语音已经在识别中了, 不重复请求. 结果出来之后会通过信号通知.
+    if (convertingSpeechFileIds.contains(fileId)) {
+        return fileId;
+    }
+    convertingSpeechFileIds.insert(fileId);
+    netClient.speechConvertTextByFileId(loginSessionId, fileId, content);
+    return fileId;
+}
+
+void DataCenter::resetSpeechText(const QString &key, const QString &text)
+{
+    // 只有按照 fileId 识别的语音才缓存结果
+    if (convertingSpeechFileIds.remove(key)) {
+        speechTextCache.insert(key, text);
+    }
+    emit this->speechConvertTextDone(key, text);
+}
+
+void DataCenter::failSpeechConvert(const QString &key, const QString &reason)
+{
+    convertingSpeechFileIds.remove(key);
+    emit this->speechConvertTextFailed(key, reason);
 }
 
 ChatSessionInfo *DataCenter::findChatSessionById(const QString &chatSessionId)
@@ -663,6 +986,17 @@ void DataCenter::addMessage(const Message &message)
     messageList.push_back(message);
 }
 
+void DataCenter::updateChatSessionLastMessage(const QString &chatSessionId)
+{
+    ChatSessionInfo* chatSessionInfo = findChatSessionById(chatSessionId);
+    QList<Message>* messageList = getRecentMessageList(chatSessionId);
+    if (chatSessionInfo == nullptr || messageList == nullptr || messageList->isEmpty()) {
+        return;
+    }
+    chatSessionInfo->lastMessage = messageList->back();
+    topChatSessionInfo(*chatSessionInfo);
+}
+
 
 }  // end namespace
 
@@ -2,6 +2,11 @@
 #define DATACENTER_H
 
 #include <QWidget>
+#include <QElapsedTimer>
+#include <QCache>
+#include <QPointer>
+#include <QSet>
+#include <functional>
 #include "data.h"
 
 #include "../network/netclient.h"
@@ -50,8 +55,17 @@ private:
     // 用户的好友搜索结果.
     QList<UserInfo>* searchUserResult = nullptr;
 
-    // 历史消息搜索结果.
+    // 历史消息搜索结果. 分页加载, 目前已经加载的所有页.
     QList<Message>* searchMessageResult = nullptr;
+    // 服务器上是否还有更多的结果
+    bool searchMessageHasMore = false;
+    // 最近一次搜索的编号, 每次新的搜索加一. 不是这一次搜索的响应, 直接丢弃.
+    int searchMessageId = 0;
+    // 最近一次搜索的条件, 加载下一页时使用
+    bool searchMessageByTime = false;
+    QString searchMessageKey;
+    QDateTime searchMessageBegTime;
+    QDateTime searchMessageEndTime;
 
     // 短信验证码的验证 id
     QString currentVerifyCodeId = "";
@@ -59,6 +73,32 @@ private:
     // 让 DataCenter 持有 NetClient 实例.
     network::NetClient netClient;
 
+    // 启动阶段还没有完成的数据项个数, 以及启动计时 (用来统计 time-to-interactive)
+    int bootstrapPending = 0;
+    QElapsedTimer bootstrapTimer;
+    QList<QMetaObject::Connection> bootstrapConnections;
+
+    // 启动阶段的某一项数据加载完成
+    void finishBootstrapStage(const QString& stage);
+    // 启动阶段的某一项数据加载失败. 没有个人信息, 界面无法正常使用, 直接结束这一次启动.
+    void abortBootstrap(const QString& stage);
+
+    // 等待某个文件下载完成的订阅者. receiver 被销毁之后, 自动不再通知.
+    struct FileSubscriber {
+        QPointer<QObject> receiver;
+        std::function<void(const QByteArray&)> callback;
+        QMetaObject::Connection destroyedConnection;
+    };
+    // 按照 fileId 登记的订阅者. key 存在, 表示这个文件正在下载中.
+    QHash<QString, QList<FileSubscriber>> fileSubscribers;
+    // 已经下载过的文件内容. cost 为文件的字节数
+    QCache<QString, QByteArray> fileCache;
+
+    // 已经识别过的语音的文字, key 为 fileId. 同一段语音再次转文字时直接使用.
+    QHash<QString, QString> speechTextCache;
+    // 正在识别中的语音的 fileId, 同一段语音同时只会发起一次识别
+    QSet<QString> convertingSpeechFileIds;
+
 public:
     // 初始化数据文件
     void initDataFile();
@@ -70,9 +110,14 @@ public:
     void clearUnread(const QString& chatSessionId);
     // 增加未读消息数目
     void addUnread(const QString& chatSessionId);
+    // 一次增加多个会话的未读消息数目, 只写一次文件
+    void addUnread(const QHash<QString, int>& counts);
     // 获取未读消息数目
     int getUnread(const QString& chatSessionId);
 
+    // 清空当前用户的所有数据 (包括保存在文件中的登录会话和未读消息数), 用于登录失效之后换一个账号重新登录.
+    void clearUserData();
+
     // 获取到当前的登录会话id
     const QString& getLoginSessionId() const {
         return loginSessionId;
@@ -90,6 +135,13 @@ public:
     /// 核心函数
     //////////////////////////////////////////////////////
 
+    // 启动阶段, 一次性发出所有初始数据的请求 (个人信息, 好友列表, 会话列表, 好友申请列表).
+    // 根据 BOOTSTRAP_AGGREGATE, 可以是四个请求并发, 也可以是一个聚合请求.
+    // 每一项完成时仍然发出各自的 xxxDone 信号, 全部完成之后发出 bootstrapDone 信号.
+    // 个人信息获取失败时, 也会发出 bootstrapDone 信号 (ok 为 false), 由界面决定是否重试.
+    void bootstrapAsync();
+    void resetBootstrap(std::shared_ptr<bite_im::SyncBootstrapRsp> resp);
+
     // 通过网络获取到用户的个人信息, 该函数是一个 "异步" 的函数, 只负责把 HTTP 请求发出去就不管了.
     void getMyselfAsync();
     UserInfo* getMyself();
@@ -119,7 +171,13 @@ public:
     void sendTextMessageAsync(const QString& chatSessionId, const QString& content);
     void sendImageMessageAsync(const QString& chatSessionId, const QByteArray& content);
     void sendFileMessageAsync(const QString& chatSessionId, const QString& fileName, const QByteArray& content);
-    void sendSpeechMessageAsync(const QString& chatSessionid, const QByteArray& content);
+    void sendSpeechMessageAsync(const QString& chatSessionid, const QByteArray& content, const SpeechMeta& speechMeta);
+    // 语音消息边录制边上传: 开始录制时 begin, 录制过程中每凑够一片 put, 录制结束时 finish 上传剩下的部分并发送消息
+    void beginSpeechUpload();
+    void putSpeechChunkAsync(const QByteArray& chunk);
+    void finishSpeechMessageAsync(const QString& chatSessionId, const QByteArray& content, const SpeechMeta& speechMeta);
+    // 录制的语音不发送了, 放弃上传
+    void cancelSpeechUpload();
 
     // 修改用户昵称
     void changeNicknameAsync(const QString& nickname);
@@ -170,11 +228,20 @@ public:
     QList<UserInfo>* getSearchUserResult();
     void resetSearchUserResult(const QList<bite_im::UserInfo>& userList);
 
-    // 搜索历史消息
+    // 搜索历史消息. 只请求第一页, 之后的页通过 searchMessageMoreAsync 按照同样的条件加载.
     void searchMessageAsync(const QString& searchKey);
     void searchMessageByTimeAsync(const QDateTime& begTime, const QDateTime& endTime);
+    void searchMessageMoreAsync();
+    bool hasMoreSearchMessage() const {
+        return searchMessageHasMore;
+    }
     QList<Message>* getSearchMessageResult();
-    void resetSearchMessageResult(const QList<bite_im::MessageInfo>& msgList);
+    bool isCurrentSearchMessage(int searchId) const {
+        return searchId == searchMessageId;
+    }
+    // 把一页结果追加到搜索结果中. pageOffset 为 0 时替换之前的结果.
+    // 过期的页 (之前的搜索的, 或者不能接在已有结果后面的) 会被丢弃, 返回 false.
+    bool resetSearchMessageResult(const QList<bite_im::MessageInfo>& msgList, int searchId, int pageOffset, bool hasMore);
 
     // 登录注册
     void userLoginAsync(const QString& username, const QString& password);
@@ -183,11 +250,21 @@ public:
     void phoneLoginAsync(const QString& phone, const QString& verifyCode);
     void phoneRegisterAsync(const QString& phone, const QString& verifyCode);
 
-    // 获取单个文件
-    void getSingleFileAsync(const QString& fileId);
+    // 获取单个文件. 文件内容只会回调给关心这个 fileId 的 receiver, 同一个文件同时只会发起一次请求.
+    void getSingleFileAsync(const QString& fileId, QObject* receiver, const std::function<void(const QByteArray&)>& callback);
+    // 文件下载完成, 放入缓存并通知订阅者
+    void resetSingleFile(const QString& fileId, const QByteArray& content);
+    // 文件下载失败, 丢弃订阅者, 下次可以重新请求
+    void cancelSingleFile(const QString& fileId);
 
-    // 语音转文字
-    void speechConvertTextAsync(const QString& fileId, const QByteArray& content);
+    // 语音转文字, 识别过程中可能多次发出 speechConvertTextPartial, 最后发出 speechConvertTextDone.
+    // 有 fileId 的语音只把 fileId 发给服务器, 识别过的直接使用缓存的结果. 没有 fileId 的语音上传 content 流式识别.
+    // 返回这次识别的 key, 之后的信号都带着这个 key. 有 fileId 时 key 就是 fileId, 否则每次识别都生成一个新的 key.
+    QString speechConvertTextAsync(const QString& fileId, const QByteArray& content);
+    // 识别完成. 有 fileId 的放入缓存, 然后通知界面
+    void resetSpeechText(const QString& key, const QString& text);
+    // 识别失败, 下次可以重新识别. 通知界面恢复原来的显示.
+    void failSpeechConvert(const QString& key, const QString& reason);
 
 
     //////////////////////////////////////////////////////////////////
@@ -209,18 +286,24 @@ public:
 
     // 添加消息到 DataCenter 中
     void addMessage(const Message& message);
+    // 会话有了新消息, 更新会话的最后一条消息, 并把会话放到列表头部
+    void updateChatSessionLastMessage(const QString& chatSessionId);
 
 signals:
     // 自定义信号
+    void bootstrapDone(qint64 elapsedMs, bool ok);
+    void loginSessionExpired();
     void getMyselfDone();
+    void getMyselfFailed();
     void getFriendListDone();
     void getChatSessionListDone();
     void getApplyListDone();
     void getRecentMessageListDone(const QString& chatSessionId);
     void getRecentMessageListDoneNoUI(const QString& chatSessionId);
-    void sendMessageDone(MessageType messageType, const QByteArray& content, const QString& extraInfo);
+    void sendMessageDone(MessageType messageType, const QByteArray& content, const QString& extraInfo, const SpeechMeta& speechMeta);
     void updateLastMessage(const QString& chatSessionId);
-    void receiveMessageDone(const Message& lastMessage);
+    void receiveMessageDone(const QList<Message>& messages);
+    void messageArrived(const QString& chatSessionId, int count);
     void changeNicknameDone();
     void changeDescriptionDone();
     void getVerifyCodeDone();
@@ -237,13 +320,15 @@ signals:
     void receiveSessionCreateDone();
     void getMemberListDone(const QString& chatSessionId);
     void searchUserDone();
-    void searchMessageDone();
+    void searchMessageDone(int pageOffset);
+    void searchMessageFailed(int pageOffset, const QString& reason);
     void userLoginDone(bool ok, const QString& reason);
     void userRegisterDone(bool ok, const QString& reason);
     void phoneLoginDone(bool ok, const QString& reason);
     void phoneRegisterDone(bool ok, const QString& reason);
-    void getSingleFileDone(const QString& fileId, const QByteArray& fileContent);
-    void speechConvertTextDone(const QString& fileId, const QString& text);
+    void speechConvertTextPartial(const QString& key, const QString& text);
+    void speechConvertTextDone(const QString& key, const QString& text);
+    void speechConvertTextFailed(const QString& key, const QString& reason);
 };
 
 }  // end namespace
@@ -2,6 +2,7 @@
 
 #include <QNetworkReply>
 #include <QUuid>
+#include <QTimer>
 
 #include "../model/data.h"
 #include "../model/datacenter.h"
@@ -11,6 +12,12 @@ using namespace model;
 
 namespace network {
 
+// 推送的新消息, 积攒这么久统一处理一次 (约一帧)
+static const int WS_BATCH_INTERVAL_MS = 16;
+// 流式语音识别时每个分片的大小, 压缩后的语音约 1 秒
+static const int SPEECH_RECOGNITION_CHUNK_BYTES = 8000;
+static const int SPEECH_RECOGNITION_WINDOW = 4;			// 语音识别同时在发送中的分片个数
+
 NetClient::NetClient(model::DataCenter *dataCenter)
     : dataCenter(dataCenter)
 {
@@ -45,6 +52,13 @@ void NetClient::ping()
 
 void NetClient::initWebsocket()
 {
+    if (websocketInited) {
+        // 信号槽之前已经连接过了, 只需要重新建立连接
+        websocketClient.open(WEBSOCKET_URL);
+        return;
+    }
+    websocketInited = true;
+
     // 1. 准备好所有需要的信号槽
     connect(&websocketClient, &QWebSocket::connected, this, [=]() {
         LOG() << "websocket 连接成功!";
@@ -115,16 +129,75 @@ void NetClient::handleWsResponse(const bite_im::NotifyMessage &notifyMessage)
 
 void NetClient::handleWsMessage(const model::Message &message)
 {
-    // 这里要考虑两个情况
-    QList<Message>* messageList = dataCenter->getRecentMessageList(message.chatSessionId);
-    if (messageList == nullptr) {
-        // 1. 如果当前这个消息所属的会话, 里面的消息列表, 没有在本地加载, 此时就需要通过网络先加载整个消息列表.
-        connect(dataCenter, &DataCenter::getRecentMessageListDoneNoUI, this, &NetClient::receiveMessage, Qt::UniqueConnection);
-        dataCenter->getRecentMessageListAsync(message.chatSessionId, false);
-    } else {
-        // 2. 如果当前这个消息所属的会话, 里面的消息已经在本地加载了, 直接把这个消息尾插到消息列表中即可.
-        messageList->push_back(message);
-        this->receiveMessage(message.chatSessionId);
+    // 收到的消息先放到队列中, 每帧统一处理一次.
+    // 短时间内大量推送的消息, 未读数目只写一次文件, 会话列表和消息展示区也只更新一次.
+    pendingWsMessages.push_back(message);
+    if (wsFlushScheduled) {
+        return;
+    }
+    wsFlushScheduled = true;
+    QTimer::singleShot(WS_BATCH_INTERVAL_MS, this, &NetClient::flushWsMessages);
+}
+
+void NetClient::flushWsMessages()
+{
+    wsFlushScheduled = false;
+
+    // 1. 按照会话分组, 会话的顺序就是第一次收到消息的顺序
+    QList<QString> chatSessionIds;
+    QHash<QString, QList<Message>> groups;
+    for (const auto& message : pendingWsMessages) {
+        if (!groups.contains(message.chatSessionId)) {
+            chatSessionIds.push_back(message.chatSessionId);
+        }
+        groups[message.chatSessionId].push_back(message);
+    }
+    pendingWsMessages.clear();
+
+    // 2. 逐个会话处理. 这里要考虑两个情况
+    QHash<QString, int> unreadCounts;
+    for (const QString& chatSessionId : chatSessionIds) {
+        const QList<Message>& messages = groups[chatSessionId];
+        QList<Message>* messageList = dataCenter->getRecentMessageList(chatSessionId);
+        if (messageList == nullptr) {
+            // a) 如果这个会话里面的消息列表, 没有在本地加载, 此时就需要通过网络先加载整个消息列表.
+            //    加载好的列表中已经包含了这些消息, 这里只记下数目. 正在加载时又收到的消息, 不必重复加载.
+            bool loading = loadingMessageCounts.contains(chatSessionId);
+            loadingMessageCounts[chatSessionId] += messages.size();
+            if (!loading) {
+                connect(dataCenter, &DataCenter::getRecentMessageListDoneNoUI, this, &NetClient::receiveLoadedMessages, Qt::UniqueConnection);
+                dataCenter->getRecentMessageListAsync(chatSessionId, false);
+            }
+        } else {
+            // b) 如果这个会话里面的消息已经在本地加载了, 直接把这些消息尾插到消息列表中即可.
+            messageList->append(messages);
+            this->receiveMessages(chatSessionId, messages, &unreadCounts);
+        }
+    }
+
+    // 3. 未读消息数目统一更新, 只写一次文件
+    if (!unreadCounts.isEmpty()) {
+        dataCenter->addUnread(unreadCounts);
+    }
+    LOG() << "[推送消息] 本次处理" << groups.size() << "个会话的新消息";
+}
+
+void NetClient::receiveLoadedMessages(const QString &chatSessionId)
+{
+    if (!loadingMessageCounts.contains(chatSessionId)) {
+        return;
+    }
+    int count = loadingMessageCounts.take(chatSessionId);
+    QList<Message>* messageList = dataCenter->getRecentMessageList(chatSessionId);
+    if (messageList == nullptr || messageList->isEmpty()) {
+        return;
+    }
+    // 加载好的列表中, 最后的 count 条就是收到的新消息
+    QList<Message> messages = messageList->mid(qMax(0, (int)messageList->size() - count));
+    QHash<QString, int> unreadCounts;
+    this->receiveMessages(chatSessionId, messages, &unreadCounts);
+    if (!unreadCounts.isEmpty()) {
+        dataCenter->addUnread(unreadCounts);
     }
 }
 
@@ -215,6 +288,50 @@ QNetworkReply *NetClient::sendHttpRequest(const QString &apiPath, const QByteArr
     return httpResp;
 }
 
+void NetClient::syncBootstrap(const QString &loginSessionId)
+{
+    // 1. 构造请求 body
+    bite_im::SyncBootstrapReq pbReq;
+    pbReq.setRequestId(makeRequestId());
+    pbReq.setSessionId(loginSessionId);
+    QByteArray body = pbReq.serialize(&serializer);
+    LOG() << "[获取启动数据] 发送请求 requestId=" << pbReq.requestId() << ", loginSessionId=" << loginSessionId;
+
+    // 2. 发送 HTTP 请求
+    QNetworkReply* resp = this->sendHttpRequest("/service/sync/bootstrap", body);
+
+    // 3. 处理响应
+    connect(resp, &QNetworkReply::finished, this, [=]() {
+        // a) 解析响应
+        bool ok = false;
+        QString reason;
+        auto pbResp = this->handleHttpResponse<bite_im::SyncBootstrapRsp>(resp, &ok, &reason);
+
+        // b) 判定响应是否正确
+        if (!ok) {
+            LOG() << "[获取启动数据] 失败! requestId=" << pbReq.requestId() << ", reason=" << reason;
+            if (isRejectedByServer(resp)) {
+                // 服务器拒绝了本地保存的登录会话
+                emit dataCenter->loginSessionExpired();
+            }
+            emit dataCenter->getMyselfFailed();
+            return;
+        }
+
+        // c) 把个人信息和几个列表一起写入 DataCenter
+        dataCenter->resetBootstrap(pbResp);
+
+        // d) 逐项发出信号, 界面仍然按照原来的方式, 各自处理
+        emit dataCenter->getMyselfDone();
+        emit dataCenter->getChatSessionListDone();
+        emit dataCenter->getFriendListDone();
+        emit dataCenter->getApplyListDone();
+
+        // e) 打印日志
+        LOG() << "[获取启动数据] 处理响应完毕! requestId=" << pbResp->requestId();
+    });
+}
+
 // 在这个函数内部, 完成具体的网络通信即可
 void NetClient::getMyself(const QString &loginSessionId)
 {
@@ -238,6 +355,11 @@ void NetClient::getMyself(const QString &loginSessionId)
         // b) 判定响应是否正确
         if (!ok) {
             LOG() << "[获取个人信息] 出错! requestId=" << req.requestId() << "reason=" << reason;
+            if (isRejectedByServer(httpResp)) {
+                // 服务器拒绝了本地保存的登录会话. 网络不通的情况不算, 仍然留在主窗口.
+                emit dataCenter->loginSessionExpired();
+            }
+            emit dataCenter->getMyselfFailed();
             return;
         }
 
@@ -402,7 +524,7 @@ void NetClient::getRecentMessageList(const QString &loginSessionId, const QStrin
 // 此处的 extraInfo, 可以用来传递 "扩展信息" . 尤其是对于文件消息来说, 通过这个字段表示 "文件名"
 // 其他类型的消息暂时不涉及, 就直接设为 "". 如果后续有消息类型需要, 都可以给这个参数, 赋予一定的特殊含义.
 void NetClient::sendMessage(const QString &loginSessionId, const QString &chatSessionId, MessageType messageType,
-                            const QByteArray &content, const QString& extraInfo)
+                            const QByteArray &content, const QString& extraInfo, const SpeechMeta& speechMeta)
 {
     // 1. 通过 protobuf 构造 body
     bite_im::NewMessageReq pbReq;
@@ -438,8 +560,16 @@ void NetClient::sendMessage(const QString &loginSessionId, const QString &chatSe
         messageContent.setMessageType(bite_im::MessageTypeGadget::MessageType::SPEECH);
 
         bite_im::SpeechMessageInfo speechMessageInfo;
-        speechMessageInfo.setFileId(""); 			// fileId 是文件在服务器存储的时候, 生成的 id, 此时还无法获取到, 暂时填成 ""
-        speechMessageInfo.setFileContents(content);
+        // 时长和波形由发送方计算好, 接收方不需要下载语音就能显示
+        speechMessageInfo.setDurationMs(speechMeta.durationMs);
+        speechMessageInfo.setWaveform(speechMeta.waveform);
+        if (extraInfo.isEmpty()) {
+            speechMessageInfo.setFileId(""); 			// fileId 是文件在服务器存储的时候, 生成的 id, 此时还无法获取到, 暂时填成 ""
+            speechMessageInfo.setFileContents(content);
+        } else {
+            // 语音已经通过分片上传到服务器了, extraInfo 就是 fileId, 不需要再带上语音数据
+            speechMessageInfo.setFileId(extraInfo);
+        }
         messageContent.setSpeechMessage(speechMessageInfo);
     } else {
         LOG() << "错误的消息类型! messageType=" << messageType;
@@ -470,31 +600,31 @@ void NetClient::sendMessage(const QString &loginSessionId, const QString &chatSe
         // c) 此处只是需要记录 "成功失败" , 不需要把内容写入到 DataCenter 中.
 
         // d) 通知调用者, 响应处理完毕
-        emit dataCenter->sendMessageDone(messageType, content, extraInfo);
+        emit dataCenter->sendMessageDone(messageType, content, extraInfo, speechMeta);
 
         // e) 打印日志
         LOG() << "[发送消息] 响应处理完毕! requestId=" << pbResp->requestId();
     });
 }
 
-void NetClient::receiveMessage(const QString &chatSessionId)
+void NetClient::receiveMessages(const QString &chatSessionId, const QList<Message> &messages, QHash<QString, int> *unreadCounts)
 {
-    // 先需要判定一下, 当前这个收到的消息对应的会话, 是否是正在被用户选中的 "当前会话"
+    // 先需要判定一下, 当前这些收到的消息对应的会话, 是否是正在被用户选中的 "当前会话"
     // 当前会话, 就需要把消息, 显示到消息展示区, 也需要更新会话列表的消息预览
     // 不是当前会话, 只需要更新会话列表中的消息预览, 并且更新 "未读消息数目"
     if (chatSessionId == dataCenter->getCurrentChatSessionId()) {
         // 收到的消息会话, 就是选中会话
-        // 在消息展示区, 新增一个消息
-        const Message& lastMessage = dataCenter->getRecentMessageList(chatSessionId)->back();
-        // 通过信号, 让 NetClient 模块, 能够通知界面(消息展示区)
-        emit dataCenter->receiveMessageDone(lastMessage);
+        // 通过信号, 让 NetClient 模块, 能够通知界面(消息展示区), 一次追加所有消息
+        emit dataCenter->receiveMessageDone(messages);
     } else {
         // 收到的消息会话, 不是选中会话
-        // 更新未读消息数目
-        dataCenter->addUnread(chatSessionId);
+        // 累计未读消息数目, 由调用者统一更新
+        (*unreadCounts)[chatSessionId] += messages.size();
     }
     // 统一更新会话列表的消息预览
     emit dataCenter->updateLastMessage(chatSessionId);
+    // 通知界面弹出提示 (会合并一段时间内的所有新消息)
+    emit dataCenter->messageArrived(chatSessionId, messages.size());
 }
 
 void NetClient::changeNickname(const QString &loginSessionId, const QString &nickname)
@@ -958,7 +1088,8 @@ void NetClient::searchUser(const QString &loginSessionId, const QString &searchK
     });
 }
 
-void NetClient::searchMessage(const QString &loginSessionId, const QString &chatSessionId, const QString &searchKey)
+void NetClient::searchMessage(const QString &loginSessionId, const QString &chatSessionId, const QString &searchKey,
+                              int searchId, int pageOffset, int pageSize)
 {
     // 1. 构造请求 body
     bite_im::MsgSearchReq pbReq;
@@ -966,9 +1097,11 @@ void NetClient::searchMessage(const QString &loginSessionId, const QString &chat
     pbReq.setSessionId(loginSessionId);
     pbReq.setChatSessionId(chatSessionId);
     pbReq.setSearchKey(searchKey);
+    pbReq.setPageOffset(pageOffset);
+    pbReq.setPageSize(pageSize);
     QByteArray body = pbReq.serialize(&serializer);
     LOG() << "[按关键词搜索历史消息] 发送请求 requestId=" << pbReq.requestId() << ", loginSessionId=" << pbReq.sessionId()
-          << ", chatSessionId=" << pbReq.chatSessionId() << ", searchKey=" << searchKey;
+          << ", chatSessionId=" << pbReq.chatSessionId() << ", searchKey=" << searchKey << ", pageOffset=" << pageOffset;
 
     // 2. 发送 HTTP 请求
     QNetworkReply* resp = this->sendHttpRequest("/service/message_storage/search_history", body);
@@ -983,21 +1116,28 @@ void NetClient::searchMessage(const QString &loginSessionId, const QString &chat
         // b) 判定响应是否正确
         if (!ok) {
             LOG() << "[按关键词搜索历史消息] 响应失败! reason=" << reason;
+            // 通知界面这一页没有加载成功, 之后还可以继续加载. 之前的搜索的失败不需要通知.
+            if (dataCenter->isCurrentSearchMessage(searchId)) {
+                emit dataCenter->searchMessageFailed(pageOffset, reason);
+            }
             return;
         }
 
-        // c) 把响应结果写入到 DataCenter
-        dataCenter->resetSearchMessageResult(pbResp->msgList());
+        // c) 把响应结果写入到 DataCenter. 过期的页直接丢弃.
+        if (!dataCenter->resetSearchMessageResult(pbResp->msgList(), searchId, pageOffset, pbResp->hasMore())) {
+            return;
+        }
 
         // d) 发送信号
-        emit dataCenter->searchMessageDone();
+        emit dataCenter->searchMessageDone(pageOffset);
 
         // e) 打印日志
         LOG() << "[按关键词搜索历史消息] 响应完成 requestId=" << pbResp->requestId();
     });
 }
 
-void NetClient::searchMessageByTime(const QString &loginSessionId, const QString &chatSessionId, const QDateTime &begTime, const QDateTime &endTime)
+void NetClient::searchMessageByTime(const QString &loginSessionId, const QString &chatSessionId, const QDateTime &begTime, const QDateTime &endTime,
+                                    int searchId, int pageOffset, int pageSize)
 {
     // 1. 构造请求 body
     bite_im::GetHistoryMsgReq pbReq;
@@ -1006,9 +1146,11 @@ void NetClient::searchMessageByTime(const QString &loginSessionId, const QString
     pbReq.setChatSessionId(chatSessionId);
     pbReq.setStartTime(begTime.toSecsSinceEpoch());
     pbReq.setOverTime(endTime.toSecsSinceEpoch());
+    pbReq.setPageOffset(pageOffset);
+    pbReq.setPageSize(pageSize);
     QByteArray body = pbReq.serialize(&serializer);
     LOG() << "[按时间搜索历史消息] 发送请求 requestId=" << pbReq.requestId() << ", loginSessionId=" << loginSessionId
-          << ", chatSessionId=" << chatSessionId << ", begTime=" << begTime << ", endTime=" << endTime;
+          << ", chatSessionId=" << chatSessionId << ", begTime=" << begTime << ", endTime=" << endTime << ", pageOffset=" << pageOffset;
 
     // 2. 发送 HTTP 请求
     QNetworkReply* resp = this->sendHttpRequest("/service/message_storage/get_history", body);
@@ -1023,14 +1165,20 @@ void NetClient::searchMessageByTime(const QString &loginSessionId, const QString
         // b) 判定响应结果是否正确
         if (!ok) {
             LOG() << "[按时间搜索历史消息] 响应失败! reason=" << reason;
+            // 通知界面这一页没有加载成功, 之后还可以继续加载. 之前的搜索的失败不需要通知.
+            if (dataCenter->isCurrentSearchMessage(searchId)) {
+                emit dataCenter->searchMessageFailed(pageOffset, reason);
+            }
             return;
         }
 
-        // c) 把响应结果记录到 DataCenter 中
-        dataCenter->resetSearchMessageResult(pbResp->msgList());
+        // c) 把响应结果记录到 DataCenter 中. 过期的页直接丢弃.
+        if (!dataCenter->resetSearchMessageResult(pbResp->msgList(), searchId, pageOffset, pbResp->hasMore())) {
+            return;
+        }
 
         // d) 发送信号通知调用者
-        emit dataCenter->searchMessageDone();
+        emit dataCenter->searchMessageDone(pageOffset);
 
         // e) 打印日志
         LOG() << "[按时间搜索历史消息] 响应完成 requestId=" << pbResp->requestId();
@@ -1218,57 +1366,258 @@ void NetClient::getSingleFile(const QString &loginSessionId, const QString &file
         // b) 判定响应结果
         if (!ok) {
             LOG() << "[获取文件内容] 响应失败 reason=" << reason;
+            dataCenter->cancelSingleFile(fileId);
             return;
         }
 
-        // c) 响应结果保存下来. 之前都是把结果保存到 DataCenter 的.
-        //    这里涉及到的文件可能会很多. 不使用 DataCenter 保存.
-        //    直接通过信号把文件数据, 投送到调用者的位置上.
-
-        // d) 发送信号
-        emit dataCenter->getSingleFileDone(fileId, pbResp->fileData().fileContent());
+        // c) 响应结果保存到 DataCenter 的文件缓存中.
+        // d) 不再广播信号. 由 DataCenter 直接回调给关心这个 fileId 的调用者.
+        dataCenter->resetSingleFile(fileId, pbResp->fileData().fileContent());
 
         // e) 打印日志
         LOG() << "[获取文件内容] 响应完成 requestId=" << pbResp->requestId();
     });
 }
 
-void NetClient::speechConvertText(const QString &loginSessionId, const QString &fileId, const QByteArray &content)
+void NetClient::speechConvertText(const QString &loginSessionId, const QString &key, const QByteArray &content)
+{
+    // 语音按分片依次发送给服务器, 每个分片的响应都会带回到目前为止的识别结果, 不需要等整段语音都识别完
+    std::shared_ptr<SpeechRecognition> recognition = std::make_shared<SpeechRecognition>();
+    recognition->streamId = makeRequestId();
+    recognition->loginSessionId = loginSessionId;
+    recognition->key = key;
+    recognition->content = content;
+    recognition->timer.start();
+    LOG() << "[语音转文字] 开始 streamId=" << recognition->streamId << ", size=" << content.size();
+    sendRecognitionChunks(recognition);
+}
+
+void NetClient::speechConvertTextByFileId(const QString &loginSessionId, const QString &fileId, const QByteArray &content)
+{
+    // 语音已经保存在服务器上了, 只需要告诉服务器 fileId 和识别到哪里, 服务器逐段读取文件, 每次都带回到目前为止的识别结果.
+    // 识别过的文件, 服务器第一次就直接返回最终结果.
+    std::shared_ptr<SpeechRecognition> recognition = std::make_shared<SpeechRecognition>();
+    recognition->streamId = makeRequestId();
+    recognition->loginSessionId = loginSessionId;
+    recognition->key = fileId;
+    recognition->fileId = fileId;
+    recognition->content = content;
+    recognition->timer.start();
+    LOG() << "[语音转文字] 开始 streamId=" << recognition->streamId << ", fileId=" << fileId;
+    sendRecognitionChunks(recognition);
+}
+
+void NetClient::sendRecognitionChunks(std::shared_ptr<SpeechRecognition> recognition)
+{
+    // 按照 fileId 识别时不知道文件有多大, 一次只发出一个请求, 由响应判断是否已经识别完
+    int window = recognition->fileId.isEmpty() ? SPEECH_RECOGNITION_WINDOW : 1;
+    while (!recognition->finished && !recognition->lastSent && recognition->inFlight < window) {
+        // 中间的分片可以同时发出多个. 最后一片要等前面的分片都收到响应之后再发,
+        // 保证服务器收到最后一片时, 整段语音都已经到齐, 它的响应就是最终结果.
+        bool nextIsLast = recognition->fileId.isEmpty()
+                          && recognition->offset + SPEECH_RECOGNITION_CHUNK_BYTES >= recognition->content.size();
+        if (nextIsLast && recognition->inFlight > 0) {
+            break;
+        }
+        sendNextRecognitionChunk(recognition);
+    }
+}
+
+void NetClient::sendNextRecognitionChunk(std::shared_ptr<SpeechRecognition> recognition)
 {
     // 1. 构造请求 body
-    bite_im::SpeechRecognitionReq pbReq;
+    bite_im::SpeechRecognitionChunkReq pbReq;
     pbReq.setRequestId(makeRequestId());
-    pbReq.setSessionId(loginSessionId);
-    pbReq.setSpeechContent(content);
+    pbReq.setSessionId(recognition->loginSessionId);
+    pbReq.setStreamId(recognition->streamId);
+    pbReq.setOffset(recognition->offset);
+    if (recognition->fileId.isEmpty()) {
+        pbReq.setSpeechChunk(recognition->content.mid(recognition->offset, SPEECH_RECOGNITION_CHUNK_BYTES));
+        recognition->offset += pbReq.speechChunk().size();
+        pbReq.setLast(recognition->offset >= recognition->content.size());
+    } else {
+        // 语音在服务器上, 只告诉服务器这一次读取哪一段
+        pbReq.setFileId(recognition->fileId);
+        pbReq.setChunkSize(SPEECH_RECOGNITION_CHUNK_BYTES);
+        recognition->offset += SPEECH_RECOGNITION_CHUNK_BYTES;
+    }
+    recognition->lastSent = pbReq.last();
+    ++recognition->inFlight;
     QByteArray body = pbReq.serialize(&serializer);
-    LOG() << "[语音转文字] 发送请求 requestId=" << pbReq.requestId() << ", loginSessonId=" << pbReq.sessionId();
+    LOG() << "[语音转文字] 发送请求 requestId=" << pbReq.requestId() << ", streamId=" << pbReq.streamId()
+          << ", offset=" << pbReq.offset() << ", last=" << pbReq.last();
 
     // 2. 发送 HTTP 请求
-    QNetworkReply* resp = this->sendHttpRequest("/service/speech/recognition", body);
+    QNetworkReply* resp = this->sendHttpRequest("/service/speech/recognition_chunk", body);
 
     // 3. 处理响应
     connect(resp, &QNetworkReply::finished, this, [=]() {
         // a) 解析响应
         bool ok = false;
         QString reason;
-        auto pbResp = this->handleHttpResponse<bite_im::SpeechRecognitionRsp>(resp, &ok, &reason);
+        auto pbResp = this->handleHttpResponse<bite_im::SpeechRecognitionChunkRsp>(resp, &ok, &reason);
+        --recognition->inFlight;
+        if (recognition->finished) {
+            // 已经出结果 (或者已经失败) 之后才回来的响应
+            return;
+        }
 
-        // b) 判定响应结果
+        // b) 判定响应结果. 出错时整个识别失败, 已经识别出来的部分不作为结果.
+        //    按照 fileId 识别时, 服务器找不到这段语音, 退回到上传语音数据进行识别.
+        //    收到的语音在播放之前没有下载, 没有语音数据时只能通知界面识别失败.
         if (!ok) {
             LOG() << "[语音转文字] 响应错误! reason=" << reason;
+            recognition->finished = true;
+            if (!recognition->fileId.isEmpty() && !recognition->content.isEmpty()) {
+                this->speechConvertText(recognition->loginSessionId, recognition->key, recognition->content);
+                return;
+            }
+            dataCenter->failSpeechConvert(recognition->key, reason);
             return;
         }
+        // 乱序返回的, 更早的分片的结果不会比已有的结果更完整
+        bool updated = pbReq.offset() > recognition->resultOffset;
+        if (updated) {
+            recognition->resultOffset = pbReq.offset();
+            recognition->result = pbResp->partialResult();
+        }
+        if (!recognition->firstResultReceived && !recognition->result.isEmpty()) {
+            recognition->firstResultReceived = true;
+            LOG() << "[语音转文字] 收到第一个识别结果, 耗时 " << recognition->timer.elapsed() << "ms";
+        }
 
-        // c) 把结果写入到 DataCenter 中. 此处不打算通过 DataCenter 表示这里的语音识别结果. 直接通过 信号 通知结果即可.
-
-        // d) 发送信号, 通知调用者
-        emit dataCenter->speechConvertTextDone(fileId, pbResp->recognitionResult());
+        // c) 最终结果写入 DataCenter 的缓存, 由 DataCenter 通知界面. 上传语音数据时, 最后一片的响应是最终结果
+        //    (前面的分片都回来之后, 才会发出最后一片). 按照 fileId 识别时, 由服务器判断文件是否已经读完.
+        //    还没有结束, 通知中间结果并继续发送后面的分片
+        bool isFinal = recognition->fileId.isEmpty() ? pbReq.last() : pbResp->isFinal();
+        if (isFinal) {
+            recognition->finished = true;
+            recognition->result = pbResp->partialResult();
+            dataCenter->resetSpeechText(recognition->key, recognition->result);
+            LOG() << "[语音转文字] 识别完成, 总耗时 " << recognition->timer.elapsed() << "ms";
+        } else {
+            if (updated) {
+                emit dataCenter->speechConvertTextPartial(recognition->key, recognition->result);
+            }
+            sendRecognitionChunks(recognition);
+        }
 
-        // e) 打印日志
+        // d) 打印日志
         LOG() << "[语音转文字] 响应完成 requestId=" << pbResp->requestId();
     });
 }
 
+void NetClient::beginSpeechUpload()
+{
+    speechUpload = std::make_shared<SpeechUpload>();
+    speechUpload->uploadId = makeRequestId();
+    LOG() << "[上传语音] 开始 uploadId=" << speechUpload->uploadId;
+}
+
+void NetClient::putSpeechChunk(const QString &loginSessionId, const QByteArray &chunk)
+{
+    if (speechUpload == nullptr || speechUpload->failed) {
+        return;
+    }
+    bite_im::PutFileChunkReq pbReq;
+    pbReq.setRequestId(makeRequestId());
+    pbReq.setSessionId(loginSessionId);
+    pbReq.setUploadId(speechUpload->uploadId);
+    pbReq.setOffset(speechUpload->offset);
+    pbReq.setChunk(chunk);
+    pbReq.setLast(false);
+    speechUpload->offset += chunk.size();
+    speechUpload->pendingChunks.push_back(pbReq);
+    sendNextSpeechChunk(speechUpload);
+}
+
+void NetClient::finishSpeechUpload(const QString &loginSessionId, const QString &chatSessionId, const QByteArray &content,
+                                   const SpeechMeta &speechMeta)
+{
+    // 这段语音的上传任务, 交给分片上传的回调继续持有
+    std::shared_ptr<SpeechUpload> upload = speechUpload;
+    speechUpload.reset();
+
+    if (upload == nullptr || upload->failed) {
+        // 之前的分片上传失败了, 退回到把整段语音放在消息中发送
+        sendMessage(loginSessionId, chatSessionId, MessageType::SPEECH_TYPE, content, "", speechMeta);
+        return;
+    }
+    upload->chatSessionId = chatSessionId;
+    upload->content = content;
+    upload->speechMeta = speechMeta;
+
+    // 只需要上传录制过程中还没有发出去的部分
+    bite_im::PutFileChunkReq pbReq;
+    pbReq.setRequestId(makeRequestId());
+    pbReq.setSessionId(loginSessionId);
+    pbReq.setUploadId(upload->uploadId);
+    pbReq.setOffset(upload->offset);
+    pbReq.setChunk(content.sliced(upload->offset));
+    pbReq.setLast(true);
+    upload->pendingChunks.push_back(pbReq);
+    sendNextSpeechChunk(upload);
+}
+
+void NetClient::cancelSpeechUpload()
+{
+    // 已经上传的分片留在服务器上, 没有 fileId 引用它们, 由服务器清理
+    if (speechUpload == nullptr) {
+        return;
+    }
+    LOG() << "[上传语音] 取消 uploadId=" << speechUpload->uploadId;
+    speechUpload->failed = true;
+    speechUpload->pendingChunks.clear();
+    speechUpload.reset();
+}
+
+void NetClient::sendNextSpeechChunk(std::shared_ptr<SpeechUpload> upload)
+{
+    if (upload->sending || upload->pendingChunks.isEmpty()) {
+        return;
+    }
+    // 1. 取出下一个分片, 发送请求
+    bite_im::PutFileChunkReq pbReq = upload->pendingChunks.takeFirst();
+    upload->sending = true;
+    QByteArray body = pbReq.serialize(&serializer);
+    LOG() << "[上传语音分片] 发送请求 requestId=" << pbReq.requestId() << ", uploadId=" << pbReq.uploadId()
+          << ", offset=" << pbReq.offset() << ", size=" << pbReq.chunk().size() << ", last=" << pbReq.last();
+
+    QNetworkReply* resp = this->sendHttpRequest("/service/file/put_chunk", body);
+
+    // 2. 处理响应
+    connect(resp, &QNetworkReply::finished, this, [=]() {
+        // a) 解析响应
+        bool ok = false;
+        QString reason;
+        auto pbResp = this->handleHttpResponse<bite_im::PutFileChunkRsp>(resp, &ok, &reason);
+        upload->sending = false;
+
+        // b) 判定响应结果. 失败之后剩下的分片都不再上传.
+        //    如果录制已经结束, 退回到把整段语音放在消息中发送; 否则等录制结束时再发送.
+        if (!ok) {
+            LOG() << "[上传语音分片] 处理出错! reason=" << reason;
+            upload->failed = true;
+            upload->pendingChunks.clear();
+            if (!upload->chatSessionId.isEmpty()) {
+                sendMessage(pbReq.sessionId(), upload->chatSessionId, MessageType::SPEECH_TYPE, upload->content, "", upload->speechMeta);
+            }
+            return;
+        }
+
+        // c) 最后一片上传完毕, 通过 fileId 发送消息; 否则继续上传下一片
+        if (pbReq.last()) {
+            sendMessage(pbReq.sessionId(), upload->chatSessionId, MessageType::SPEECH_TYPE, upload->content, pbResp->fileId(),
+                        upload->speechMeta);
+        } else {
+            sendNextSpeechChunk(upload);
+        }
+
+        // d) 打印日志
+        LOG() << "[上传语音分片] 响应完成 requestId=" << pbResp->requestId();
+    });
+}
+
 }  // end network
 
 
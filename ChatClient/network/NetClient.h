@@ -6,6 +6,8 @@
 #include <QWebSocket>
 #include <QProtobufSerializer>
 #include <QNetworkReply>
+#include <QHash>
+#include <QElapsedTimer>
 
 #include "../model/data.h"
 
@@ -17,6 +19,40 @@ namespace model {
 
 namespace network {
 
+// 边录制边上传的语音. 同一段语音的分片依次上传, 前一片的响应回来之后才发送下一片.
+struct SpeechUpload {
+    QString uploadId;
+    qint64 offset = 0;				// 已经放入队列的字节数, 即下一个分片的偏移
+    bool sending = false;			// 是否有分片正在上传
+    bool failed = false;			// 有分片上传失败, 之后的分片不再上传
+    QList<bite_im::PutFileChunkReq> pendingChunks;
+
+    // 以下几项在录制结束之后填写, 最后一片上传完毕后用来发送消息
+    QString chatSessionId;
+    QByteArray content;
+    model::SpeechMeta speechMeta;
+};
+
+// 一次流式语音识别. 同一段语音的分片按顺序发出, 最多同时有几个分片在发送中, 不必每一片都等一个来回.
+// 分片带有偏移, 服务器可以按偏移重新排序. 响应可能乱序返回, 只采用偏移最大的分片带回的识别结果.
+// 最后一片等前面的分片全部收到响应之后才发出, 它的响应就是最终结果.
+// 服务器上已经保存的语音 (有 fileId), 不上传语音数据, 由服务器逐段读取文件识别, 直到响应表明已经是最终结果.
+struct SpeechRecognition {
+    QString streamId;
+    QString loginSessionId;
+    QString key;						// 识别结果通知给 DataCenter 时使用的 key
+    QString fileId;						// 不为空时按照服务器上保存的文件识别
+    QByteArray content;					// 按照 fileId 识别时, 只在服务器找不到文件时才上传
+    qint64 offset = 0;					// 下一个分片的偏移
+    int inFlight = 0;					// 已经发出, 还没有收到响应的分片个数
+    bool lastSent = false;				// 最后一片是否已经发出
+    bool finished = false;				// 已经拿到最终结果, 或者已经失败. 之后的响应直接忽略.
+    qint64 resultOffset = -1;			// 当前识别结果来自哪个偏移的分片
+    QString result;						// 到目前为止的识别结果
+    QElapsedTimer timer;				// 用来统计拿到第一个识别结果的耗时
+    bool firstResultReceived = false;
+};
+
 class NetClient : public QObject
 {
     Q_OBJECT
@@ -39,6 +75,8 @@ public:
     // 针对 websocket 的处理
     void handleWsResponse(const bite_im::NotifyMessage& notifyMessage);
     void handleWsMessage(const model::Message& message);
+    // 处理队列中积攒的所有新消息
+    void flushWsMessages();
     void handleWsRemoveFriend(const QString& userId);
     void handleWsAddFriendApply(const model::UserInfo& userInfo);
     void handleWsAddFriendProcess(const model::UserInfo& userInfo, bool agree);
@@ -50,6 +88,13 @@ public:
     // 生成请求 id
     static QString makeRequestId();
 
+    // 判定响应是否是 "服务器明确拒绝了登录会话", 也就是 HTTP 401 / 403.
+    // 网络不通, 服务器临时出错, 以及其他业务上的失败都不算在内.
+    static bool isRejectedByServer(QNetworkReply* httpResp) {
+        int status = httpResp->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        return status == 401 || status == 403;
+    }
+
     // 封装发送请求的逻辑
     QNetworkReply* sendHttpRequest(const QString& apiPath, const QByteArray& body);
 
@@ -87,14 +132,17 @@ public:
         return respObj;
     }
 
+    void syncBootstrap(const QString& loginSessionId);
     void getMyself(const QString& loginSessionId);
     void getFriendList(const QString& loginSessionId);
     void getChatSessionList(const QString& loginSessionId);
     void getApplyList(const QString& loginSessionId);
     void getRecentMessageList(const QString& loginSessionId, const QString& chatSessionId, bool updateUI);
+    // speechMeta 只在语音消息时使用
     void sendMessage(const QString& loginSessionId, const QString& chatSessionId, model::MessageType messageType,
-                     const QByteArray& content, const QString& extraInfo);
-    void receiveMessage(const QString& chatSessionId);
+                     const QByteArray& content, const QString& extraInfo, const model::SpeechMeta& speechMeta = model::SpeechMeta());
+    void receiveMessages(const QString& chatSessionId, const QList<model::Message>& messages, QHash<QString, int>* unreadCounts);
+    void receiveLoadedMessages(const QString& chatSessionId);
     void changeNickname(const QString& loginSessionId, const QString& nickname);
     void changeDescription(const QString& loginSessionId, const QString& desc);
     void getVerifyCode(const QString& phone);
@@ -107,14 +155,23 @@ public:
     void createGroupChatSession(const QString& loginSessionId, const QList<QString>& userIdList);
     void getMemberList(const QString& loginSessionId, const QString& chatSessionId);
     void searchUser(const QString& loginSessionId, const QString& searchKey);
-    void searchMessage(const QString& loginSessionId, const QString& chatSessionId, const QString& searchKey);
-    void searchMessageByTime(const QString& loginSessionId, const QString& chatSessionId, const QDateTime& begTime, const QDateTime& endTime);
+    // searchId 标识这一页属于哪一次搜索, 响应回来时用来丢弃之前的搜索的结果
+    void searchMessage(const QString& loginSessionId, const QString& chatSessionId, const QString& searchKey,
+                       int searchId, int pageOffset, int pageSize);
+    void searchMessageByTime(const QString& loginSessionId, const QString& chatSessionId, const QDateTime& begTime, const QDateTime& endTime,
+                             int searchId, int pageOffset, int pageSize);
     void userLogin(const QString& username, const QString& password);
     void userRegister(const QString& username, const QString& password);
     void phoneLogin(const QString& phone, const QString& verifyCodeId, const QString& verifyCode);
     void phoneRegister(const QString& phone, const QString& verifyCodeId, const QString& verifyCode);
     void getSingleFile(const QString& loginSessionId, const QString& fileId);
-    void speechConvertText(const QString& loginSessionId, const QString& fileId, const QByteArray& content);
+    void speechConvertText(const QString& loginSessionId, const QString& key, const QByteArray& content);
+    void speechConvertTextByFileId(const QString& loginSessionId, const QString& fileId, const QByteArray& content);
+    void beginSpeechUpload();
+    void putSpeechChunk(const QString& loginSessionId, const QByteArray& chunk);
+    void finishSpeechUpload(const QString& loginSessionId, const QString& chatSessionId, const QByteArray& content,
+                            const model::SpeechMeta& speechMeta);
+    void cancelSpeechUpload();
 
 private:
     model::DataCenter* dataCenter;
@@ -124,6 +181,21 @@ private:
 
     // websocket 客户端
     QWebSocket websocketClient;
+    // websocket 的信号槽是否已经连接过. 重新登录时会再次 initWebsocket, 信号槽只需要连接一次.
+    bool websocketInited = false;
+
+    // websocket 推送过来, 还没有处理的新消息. 每帧统一处理一次.
+    QList<model::Message> pendingWsMessages;
+    bool wsFlushScheduled = false;
+    // 消息列表正在通过网络加载的会话, 以及加载期间收到的新消息数目
+    QHash<QString, int> loadingMessageCounts;
+
+    // 正在录制的语音的上传任务. 录制结束后, 任务由分片上传的回调继续持有, 直到消息发送出去.
+    std::shared_ptr<SpeechUpload> speechUpload;
+    void sendNextSpeechChunk(std::shared_ptr<SpeechUpload> upload);
+    // 在窗口允许的范围内, 继续发送识别的分片
+    void sendRecognitionChunks(std::shared_ptr<SpeechRecognition> recognition);
+    void sendNextRecognitionChunk(std::shared_ptr<SpeechRecognition> recognition);
 
     // 序列化器
     QProtobufSerializer serializer;
@@ -0,0 +1,51 @@
+#include "notificationcenter.h"
+
+#include "toast.h"
+
+// 合并通知的时间窗口. 从窗口内第一条消息开始计时, 窗口结束时统一弹出, 所以通知最多延迟这么久.
+static const int COALESCE_WINDOW_MS = 1000;
+
+NotificationCenter* NotificationCenter::instance = nullptr;
+
+NotificationCenter *NotificationCenter::getInstance()
+{
+    if (instance == nullptr) {
+        instance = new NotificationCenter();
+    }
+    return instance;
+}
+
+NotificationCenter::NotificationCenter(QObject *parent)
+    : QObject{parent}
+{
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, &NotificationCenter::flush);
+}
+
+void NotificationCenter::addMessages(const QString &chatSessionId, int count)
+{
+    messageCount += count;
+    chatSessionIds.insert(chatSessionId);
+    if (!timer->isActive()) {
+        timer->start(COALESCE_WINDOW_MS);
+    }
+}
+
+void NotificationCenter::flush()
+{
+    if (messageCount == 0) {
+        return;
+    }
+    QString text;
+    if (messageCount == 1) {
+        text = "收到新消息!";
+    } else if (chatSessionIds.size() == 1) {
+        text = QString("收到 %1 条新消息!").arg(messageCount);
+    } else {
+        text = QString("收到来自 %1 个会话的 %2 条新消息!").arg(chatSessionIds.size()).arg(messageCount);
+    }
+    messageCount = 0;
+    chatSessionIds.clear();
+    Toast::showMessage(text);
+}
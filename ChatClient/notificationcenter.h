@@ -0,0 +1,34 @@
+#ifndef NOTIFICATIONCENTER_H
+#define NOTIFICATIONCENTER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QSet>
+
+////////////////////////////////////////////////////////
+/// 应用内的消息通知
+/// 一段时间窗口内收到的所有新消息合并成一条通知 ("收到来自 M 个会话的 N 条新消息"),
+/// 短时间内大量推送的消息也不会弹出一堆窗口.
+////////////////////////////////////////////////////////
+class NotificationCenter : public QObject
+{
+    Q_OBJECT
+public:
+    static NotificationCenter* getInstance();
+
+    // 某个会话收到了 count 条新消息
+    void addMessages(const QString& chatSessionId, int count);
+
+private:
+    static NotificationCenter* instance;
+    explicit NotificationCenter(QObject* parent = nullptr);
+
+    // 时间窗口结束, 弹出合并后的通知
+    void flush();
+
+    QTimer* timer;
+    int messageCount = 0;
+    QSet<QString> chatSessionIds;
+};
+
+#endif // NOTIFICATIONCENTER_H
@@ -0,0 +1,309 @@
+#include "perfmonitor.h"
+
+#include <QApplication>
+#include <QTimer>
+#include <QKeyEvent>
+#include <QMetaEnum>
+#include <QStandardPaths>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include "model/data.h"
+
+static const int HEARTBEAT_INTERVAL_MS = 20;	// 主线程心跳的间隔
+static const int STALL_THRESHOLD_MS = 200;		// 心跳超过这个时间没有更新, 认为发生了卡顿
+static const int WATCHDOG_INTERVAL_MS = 50;		// 看门狗线程检查的间隔
+static const int MAX_STALL_RECORDS = 100;		// 最多保留的卡顿记录条数
+
+static const int BUCKET_LIMITS_MS[FrameHistogram::BUCKET_COUNT - 1] = {1, 2, 4, 8, 16, 33, 66};
+
+////////////////////////////////////////////////////////
+/// 耗时直方图
+////////////////////////////////////////////////////////
+
+void FrameHistogram::add(qint64 ns)
+{
+    int bucket = BUCKET_COUNT - 1;
+    for (int i = 0; i < BUCKET_COUNT - 1; ++i) {
+        if (ns < BUCKET_LIMITS_MS[i] * 1000000LL) {
+            bucket = i;
+            break;
+        }
+    }
+    ++buckets[bucket];
+    ++count;
+    totalNs += ns;
+    maxNs = qMax(maxNs, ns);
+}
+
+int FrameHistogram::percentileMs(double p) const
+{
+    quint64 target = count * p;
+    quint64 sum = 0;
+    for (int i = 0; i < BUCKET_COUNT - 1; ++i) {
+        sum += buckets[i];
+        if (sum > target) {
+            return BUCKET_LIMITS_MS[i];
+        }
+    }
+    return maxNs / 1000000;
+}
+
+////////////////////////////////////////////////////////
+/// 性能监控
+////////////////////////////////////////////////////////
+
+PerfMonitor* PerfMonitor::instance = nullptr;
+bool PerfMonitor::running = false;
+
+PerfMonitor *PerfMonitor::getInstance()
+{
+    if (instance == nullptr) {
+        instance = new PerfMonitor();
+    }
+    return instance;
+}
+
+PerfMonitor::PerfMonitor(QObject *parent)
+    : QObject{parent}
+{
+    qRegisterMetaType<StallRecord>("StallRecord");
+}
+
+void PerfMonitor::start()
+{
+    if (running) {
+        return;
+    }
+    running = true;
+    clock.start();
+
+    // 1. 主线程心跳
+    QTimer* heartbeat = new QTimer(this);
+    connect(heartbeat, &QTimer::timeout, this, [=]() {
+        lastHeartbeatMs = clock.elapsed();
+    });
+    heartbeat->start(HEARTBEAT_INTERVAL_MS);
+
+    // 2. 看门狗线程
+    watchdog = new StallWatchdog(this);
+    connect(watchdog, &StallWatchdog::stallDetected, this, &PerfMonitor::addStall);
+    watchdog->start();
+
+    // 3. 监听所有事件, 记录当前正在分发的事件, 顺便处理快捷键
+    qApp->installEventFilter(this);
+
+    // 4. 程序退出时停止看门狗, 并写入一次数据
+    connect(qApp, &QCoreApplication::aboutToQuit, this, [=]() {
+        watchdog->requestInterruption();
+        watchdog->wait();
+        dumpToFile();
+    });
+    LOG() << "性能监控已启动";
+}
+
+bool PerfMonitor::eventFilter(QObject *watched, QEvent *event)
+{
+    currentReceiver = watched->metaObject()->className();
+    currentEventType = event->type();
+
+    if (event->type() == QEvent::KeyPress) {
+        QKeyEvent* keyEvent = static_cast<QKeyEvent*>(event);
+        if (keyEvent->modifiers() == (Qt::ControlModifier | Qt::ShiftModifier) && !keyEvent->isAutoRepeat()) {
+            if (keyEvent->key() == Qt::Key_P) {
+                if (overlay == nullptr) {
+                    overlay = new PerfOverlay();
+                }
+                overlay->setVisible(!overlay->isVisible());
+                return true;
+            }
+            if (keyEvent->key() == Qt::Key_D) {
+                dumpToFile();
+                return true;
+            }
+        }
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+const char* PerfMonitor::enterScope(const char *name)
+{
+    return currentScope.exchange(name);
+}
+
+void PerfMonitor::leaveScope(const char *parent)
+{
+    currentScope = parent;
+}
+
+void PerfMonitor::recordScope(const char *name, qint64 ns)
+{
+    histograms[QString::fromLatin1(name)].add(ns);
+}
+
+void PerfMonitor::addStall(const StallRecord &record)
+{
+    stalls.push_back(record);
+    if (stalls.size() > MAX_STALL_RECORDS) {
+        stalls.pop_front();
+    }
+}
+
+QString PerfMonitor::summary() const
+{
+    QString text = QString("卡顿次数: %1\n").arg(stalls.size());
+    if (!stalls.isEmpty()) {
+        const StallRecord& last = stalls.back();
+        text += QString("最近一次: %1ms %2 %3\n").arg(last.durationMs).arg(last.scope, last.event);
+    }
+    for (auto it = histograms.begin(); it != histograms.end(); ++it) {
+        const FrameHistogram& h = it.value();
+        if (h.count == 0) {
+            continue;
+        }
+        text += QString("%1: n=%2 avg=%3ms p95<%4ms max=%5ms\n")
+                    .arg(it.key())
+                    .arg(h.count)
+                    .arg(h.totalNs / (double)h.count / 1000000.0, 0, 'f', 2)
+                    .arg(h.percentileMs(0.95))
+                    .arg(h.maxNs / 1000000.0, 0, 'f', 1);
+    }
+    return text.trimmed();
+}
+
+void PerfMonitor::dumpToFile()
+{
+    QJsonArray stallArray;
+    for (const auto& s : stalls) {
+        QJsonObject obj;
+        obj["time"] = s.time.toString(Qt::ISODateWithMs);
+        obj["durationMs"] = s.durationMs;
+        obj["scope"] = s.scope;
+        obj["event"] = s.event;
+        stallArray.append(obj);
+    }
+
+    QJsonObject histogramObject;
+    for (auto it = histograms.begin(); it != histograms.end(); ++it) {
+        const FrameHistogram& h = it.value();
+        QJsonArray buckets;
+        for (int i = 0; i < FrameHistogram::BUCKET_COUNT; ++i) {
+            buckets.append((qint64)h.buckets[i]);
+        }
+        QJsonObject obj;
+        obj["count"] = (qint64)h.count;
+        obj["totalMs"] = h.totalNs / 1000000.0;
+        obj["maxMs"] = h.maxNs / 1000000.0;
+        obj["buckets"] = buckets;
+        histogramObject[it.key()] = obj;
+    }
+
+    QJsonArray limits;
+    for (int limit : BUCKET_LIMITS_MS) {
+        limits.append(limit);
+    }
+
+    QJsonObject root;
+    root["bucketLimitsMs"] = limits;
+    root["stalls"] = stallArray;
+    root["histograms"] = histogramObject;
+
+    QString basePath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir dir;
+    if (!dir.exists(basePath)) {
+        dir.mkpath(basePath);
+    }
+    QString filePath = basePath + "/perf.json";
+    model::writeByteArrayToFile(filePath, QJsonDocument(root).toJson());
+    LOG() << "性能数据已写入 " << filePath;
+}
+
+////////////////////////////////////////////////////////
+/// 看门狗线程
+////////////////////////////////////////////////////////
+
+StallWatchdog::StallWatchdog(PerfMonitor *monitor)
+    : QThread(monitor), monitor(monitor)
+{
+
+}
+
+void StallWatchdog::run()
+{
+    bool stalled = false;
+    qint64 stallBeginMs = 0;
+    StallRecord record;
+
+    while (!isInterruptionRequested()) {
+        QThread::msleep(WATCHDOG_INTERVAL_MS);
+        qint64 lastBeat = monitor->lastHeartbeatMs;
+        qint64 gap = monitor->clock.elapsed() - lastBeat;
+
+        if (!stalled && gap > STALL_THRESHOLD_MS) {
+            // 卡顿开始. 此时主线程还停在原地, 读到的就是正在执行的区域和事件.
+            stalled = true;
+            stallBeginMs = lastBeat;
+            const char* scope = monitor->currentScope;
+            const char* receiver = monitor->currentReceiver;
+            int eventType = monitor->currentEventType;
+            const char* eventName = QMetaEnum::fromType<QEvent::Type>().valueToKey(eventType);
+
+            record = StallRecord();
+            record.time = QDateTime::currentDateTime().addMSecs(-gap);
+            record.scope = scope ? QString::fromLatin1(scope) : "";
+            record.event = QString("%1 -> %2").arg(eventName ? eventName : QString::number(eventType),
+                                                   receiver ? QString::fromLatin1(receiver) : "");
+            LOG() << "[卡顿] 主线程已经 " << gap << "ms 没有响应, scope=" << record.scope << ", event=" << record.event;
+        } else if (stalled && lastBeat != stallBeginMs) {
+            // 心跳恢复了, 卡顿结束
+            stalled = false;
+            record.durationMs = lastBeat - stallBeginMs - HEARTBEAT_INTERVAL_MS;
+            LOG() << "[卡顿] 主线程恢复, 持续 " << record.durationMs << "ms";
+            emit stallDetected(record);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////
+/// 调试浮层
+////////////////////////////////////////////////////////
+
+PerfOverlay::PerfOverlay()
+{
+    this->setWindowFlags(Qt::Tool | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint);
+    this->setAttribute(Qt::WA_ShowWithoutActivating);
+    this->setStyleSheet("QLabel { background-color: rgba(0, 0, 0, 180); color: rgb(0, 255, 0); font-family: Consolas; font-size: 12px; padding: 8px; }");
+    this->move(20, 20);
+
+    QTimer* timer = new QTimer(this);
+    connect(timer, &QTimer::timeout, this, [=]() {
+        this->setText(PerfMonitor::getInstance()->summary());
+        this->adjustSize();
+    });
+    timer->start(500);
+}
+
+////////////////////////////////////////////////////////
+/// 代码区域标记
+////////////////////////////////////////////////////////
+
+PerfScope::PerfScope(const char *name) : name(name)
+{
+    if (!PerfMonitor::isRunning()) {
+        return;
+    }
+    parent = PerfMonitor::getInstance()->enterScope(name);
+    timer.start();
+}
+
+PerfScope::~PerfScope()
+{
+    if (!timer.isValid()) {
+        return;
+    }
+    PerfMonitor* monitor = PerfMonitor::getInstance();
+    monitor->recordScope(name, timer.nsecsElapsed());
+    monitor->leaveScope(parent);
+}
@@ -0,0 +1,141 @@
+#ifndef PERFMONITOR_H
+#define PERFMONITOR_H
+
+#include <QObject>
+#include <QThread>
+#include <QWidget>
+#include <QLabel>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QDateTime>
+#include <atomic>
+
+////////////////////////////////////////////////////////
+/// 性能监控
+/// 1. 看门狗线程检测主线程事件循环的卡顿, 记录卡顿时正在处理的事件和代码区域 (PERF_SCOPE)
+/// 2. 统计 PERF_SCOPE 标记的绘制 / 布局耗时的直方图
+/// 3. Ctrl+Shift+P 显示/隐藏浮层, Ctrl+Shift+D 把数据写入文件. 程序退出时也会写一次.
+/// 只有 debug.h 中 PERF_MONITOR 为 1 时才会启动, 没启动时 PERF_SCOPE 只有一次判断的开销.
+////////////////////////////////////////////////////////
+
+// 一次卡顿的记录
+struct StallRecord {
+    QDateTime time;			// 卡顿开始的时间
+    qint64 durationMs = 0;	// 卡顿持续的时间
+    QString scope;			// 卡顿时正在执行的 PERF_SCOPE
+    QString event;			// 卡顿时正在分发的事件
+};
+Q_DECLARE_METATYPE(StallRecord)
+
+// 耗时直方图. 每个桶的上限依次为 1, 2, 4, 8, 16, 33, 66 毫秒, 最后一个桶没有上限.
+struct FrameHistogram {
+    static const int BUCKET_COUNT = 8;
+    quint64 buckets[BUCKET_COUNT] = {0};
+    quint64 count = 0;
+    qint64 totalNs = 0;
+    qint64 maxNs = 0;
+
+    void add(qint64 ns);
+    // 根据桶估算的百分位数 (取所在桶的上限), 单位毫秒
+    int percentileMs(double p) const;
+};
+
+class PerfOverlay;
+class StallWatchdog;
+
+class PerfMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    static PerfMonitor* getInstance();
+    static bool isRunning() { return running; }
+
+    // 启动心跳和看门狗线程
+    void start();
+
+    // 记录一次 PERF_SCOPE 的耗时. 只在主线程中调用.
+    void recordScope(const char* name, qint64 ns);
+    // 进入 / 离开某个 PERF_SCOPE. 看门狗线程会读取当前所在的区域.
+    const char* enterScope(const char* name);
+    void leaveScope(const char* parent);
+
+    // 把统计数据写入文件
+    void dumpToFile();
+    // 浮层上显示的统计文本
+    QString summary() const;
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
+private:
+    static PerfMonitor* instance;
+    static bool running;
+    explicit PerfMonitor(QObject* parent = nullptr);
+
+    void addStall(const StallRecord& record);
+
+    QHash<QString, FrameHistogram> histograms;
+    QList<StallRecord> stalls;
+    PerfOverlay* overlay = nullptr;
+    StallWatchdog* watchdog = nullptr;
+
+    friend class StallWatchdog;
+    // 下面这些数据会被看门狗线程读取
+    QElapsedTimer clock;
+    std::atomic<qint64> lastHeartbeatMs {0};
+    std::atomic<const char*> currentScope {nullptr};
+    std::atomic<const char*> currentReceiver {nullptr};
+    std::atomic<int> currentEventType {0};
+};
+
+////////////////////////////////////////////////////////
+/// 看门狗线程. 主线程的心跳超过阈值没有更新, 就认为发生了卡顿.
+////////////////////////////////////////////////////////
+class StallWatchdog : public QThread
+{
+    Q_OBJECT
+public:
+    StallWatchdog(PerfMonitor* monitor);
+
+protected:
+    void run() override;
+
+private:
+    PerfMonitor* monitor;
+
+signals:
+    void stallDetected(const StallRecord& record);
+};
+
+////////////////////////////////////////////////////////
+/// 调试浮层. 显示卡顿次数和各个区域的耗时分布.
+////////////////////////////////////////////////////////
+class PerfOverlay : public QLabel
+{
+    Q_OBJECT
+public:
+    PerfOverlay();
+};
+
+////////////////////////////////////////////////////////
+/// 标记一段代码区域, 统计耗时, 并且在卡顿时能知道主线程停在了哪里.
+/// name 必须是字符串字面量 (看门狗线程会直接读取这个指针).
+////////////////////////////////////////////////////////
+class PerfScope
+{
+public:
+    explicit PerfScope(const char* name);
+    ~PerfScope();
+
+private:
+    const char* name;
+    const char* parent = nullptr;
+    QElapsedTimer timer;
+};
+
+#define PERF_SCOPE_CONCAT_INNER(a, b) a##b
+#define PERF_SCOPE_CONCAT(a, b) PERF_SCOPE_CONCAT_INNER(a, b)
+#define PERF_SCOPE(name) PerfScope PERF_SCOPE_CONCAT(perfScope, __LINE__)(name)
+
+#endif // PERFMONITOR_H
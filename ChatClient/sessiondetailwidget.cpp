@@ -6,6 +6,8 @@
 
 #include "model/datacenter.h"
 #include "choosefrienddialog.h"
+#include "theme.h"
+#include "avatarcache.h"
 #include "debug.h"
 
 using namespace model;
@@ -14,7 +16,7 @@ using namespace model;
 /// 表示一个头像 +  一个名字组合控件
 /////////////////////////////////////////////
 
-AvatarItem::AvatarItem(const QIcon &avatar, const QString &name)
+AvatarItem::AvatarItem(const QIcon &avatar, const QString &name, const QString &userId)
 {
     // 1. 设置自身的基本属性
     this->setFixedSize(70, 80);
@@ -30,8 +32,12 @@ AvatarItem::AvatarItem(const QIcon &avatar, const QString &name)
     avatarBtn = new QPushButton();
     avatarBtn->setFixedSize(45, 45);
     avatarBtn->setIconSize(QSize(45, 45));
-    avatarBtn->setIcon(avatar);
-    avatarBtn->setStyleSheet("QPushButton { border: none; }");
+    if (userId.isEmpty()) {
+        avatarBtn->setIcon(avatar);
+    } else {
+        avatarBtn->setIcon(AvatarCache::getInstance()->icon(AvatarCache::userKey(userId), avatar, 45));
+    }
+    avatarBtn->setObjectName(theme::ROW_AVATAR_BUTTON);
 
     // 4. 创建名字
     nameLabel = new QLabel();
@@ -86,7 +92,7 @@ SessionDetailWidget::SessionDetailWidget(QWidget* parent, const UserInfo& userIn
     AvatarItem* currentUser = new AvatarItem(QIcon(":/resource/image/defaultAvatar.png"), "张三123456");
     layout->addWidget(currentUser, 0, 1);
 #endif
-    AvatarItem* currentUser = new AvatarItem(userInfo.avatar, userInfo.nickname);
+    AvatarItem* currentUser = new AvatarItem(userInfo.avatar, userInfo.nickname, userInfo.userId);
     layout->addWidget(currentUser, 0, 1);
 
     // 5. 添加 "删除好友" 按钮
@@ -16,7 +16,8 @@ using model::UserInfo;
 class AvatarItem : public QWidget {
     Q_OBJECT
 public:
-    AvatarItem(const QIcon& avatar, const QString& name);
+    // userId 不为空时, 头像使用 AvatarCache 中预先缩放好的图片. "添加" 按钮这种固定图标不需要.
+    AvatarItem(const QIcon& avatar, const QString& name, const QString& userId = "");
 
     QPushButton* getAvatar() {
         return avatarBtn;
@@ -1,48 +1,86 @@
 #include "sessionfriendarea.h"
 
 #include <QScrollBar>
-#include <QVBoxLayout>
-#include <QPushButton>
-#include <QLabel>
-#include <QStyleOption>
 #include <QPainter>
+#include <QMouseEvent>
+#include <QItemSelectionModel>
+#include <QFontMetrics>
+#include <QApplication>
+#include <QStyle>
+#include <QStyleOption>
+#include <QTimer>
 
 #include "model/data.h"
 #include "model/datacenter.h"
 #include "mainwidget.h"
+#include "perfmonitor.h"
+#include "theme.h"
+#include "avatarcache.h"
 #include "debug.h"
 
 using namespace model;
 
+// 一个 Item 的布局参数. 和之前 SessionFriendItem 中 QGridLayout 的设置保持一致.
+static const int ITEM_HEIGHT = 70;
+static const int MARGIN_LEFT = 20;
+static const int MARGIN_RIGHT = 10;
+static const int SPACING = 10;
+static const int AVATAR_SIZE = 50;
+static const int LINE_HEIGHT = 35;			// 名字和消息预览各占一行
+static const int BUTTON_WIDTH = 60;
+static const int BUTTON_HEIGHT = 27;
+
+// 会话的最后一条消息, 在会话列表中显示的文本.
+// 文本消息, 直接显示消息的内容; 图片消息, 直接显示 "[图片]"; 文件消息, 直接显示 "[文件]"; 语音消息, 直接显示 "[语音]"
+static QString lastMessageText(const Message& lastMessage)
+{
+    if (lastMessage.messageType == TEXT_TYPE) {
+        return lastMessage.content;
+    } else if (lastMessage.messageType == IMAGE_TYPE) {
+        return "[图片]";
+    } else if (lastMessage.messageType == FILE_TYPE) {
+        return "[文件]";
+    } else if (lastMessage.messageType == SPEECH_TYPE) {
+        return "[语音]";
+    }
+    LOG() << "错误的消息类型! messageType=" << lastMessage.messageType;
+    return "";
+}
+
+//////////////////////////////////////////////////////////
+/// 整个滚动区域的实现
+//////////////////////////////////////////////////////////
+
 SessionFriendArea::SessionFriendArea(QWidget *parent)
-    : QScrollArea {parent}
+    : QListView {parent}
 {
     // 1. 设置必要的属性
-    // 设置了这个属性, 才能够开启滚动效果
-    this->setWidgetResizable(true);
+    this->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    this->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    this->setSelectionMode(QAbstractItemView::NoSelection);
+    this->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    this->setFocusPolicy(Qt::NoFocus);
+    // 所有 Item 都是一样高的, 布局时不需要逐个计算尺寸
+    this->setUniformItemSizes(true);
+    // 鼠标悬停时需要修改背景色
+    this->setMouseTracking(true);
+    this->viewport()->setAttribute(Qt::WA_Hover);
     // 设置滚动条相关的样式
     this->verticalScrollBar()->setStyleSheet("QScrollBar:vertical { width: 2px; background-color: rgb(46, 46, 46);}");
     this->horizontalScrollBar()->setStyleSheet("QScrollBar:horizontal { height: 0px; }");
-    this->setStyleSheet("QWidget { border: none;}");
-
-    // 2. 把 widget 创建出来
-    container = new QWidget();
-    container->setFixedWidth(310);
-    this->setWidget(container);
-
-    // 3. 给这个 widget 指定布局管理器, 以便后续添加元素进去
-    QVBoxLayout* layout = new QVBoxLayout();
-    layout->setContentsMargins(0, 0, 0, 0);
-    layout->setSpacing(0);
-    layout->setAlignment(Qt::AlignTop);
-    container->setLayout(layout);
-
-    // 简单测试一下滚动的效果, 先去掉, 后续添加 Item
-    // for (int i = 0; i < 50; ++i) {
-    //     QPushButton* btn = new QPushButton();
-    //     btn->setText("按钮");
-    //     layout->addWidget(btn);
-    // }
+    this->setStyleSheet("QListView { border: none; background-color: transparent; }");
+
+    // 2. 创建三种列表的 model 和公共的 delegate. 默认显示会话列表.
+    sessionModel = new SessionFriendModel(SessionItemType, this);
+    friendModel = new SessionFriendModel(FriendItemType, this);
+    applyModel = new SessionFriendModel(ApplyItemType, this);
+    itemDelegate = new SessionFriendDelegate(this);
+    this->setItemDelegate(itemDelegate);
+    this->setModel(sessionModel);
+
+    // 3. 处理更新最后一个消息的信号. 只在这里连接一次, 而不是每个会话都连接一次.
+    DataCenter* dataCenter = DataCenter::getInstance();
+    connect(dataCenter, &DataCenter::updateLastMessage, this, &SessionFriendArea::updateLastMessage);
 
     // 构造出一些临时数据, 用来作为 "界面调试" 依据. 后续要删除掉
 #if TEST_UI
@@ -53,336 +91,380 @@ SessionFriendArea::SessionFriendArea(QWidget *parent)
 #endif
 }
 
-void SessionFriendArea::clear()
+void SessionFriendArea::switchTo(ItemType itemType)
 {
-    QLayout* layout = container->layout();
-    // 遍历布局管理器中的所有元素, 并依次从布局管理器中删除掉
-    for (int i = layout->count() - 1; i >= 0; --i) {
-        // takeAt 就能移除对应下标的元素
-        QLayoutItem* item = layout->takeAt(i);
-        // 别忘了, 还需要对这个对象进行 "释放"
-        if (item->widget()) {
-            // 把这个移除的内容的 widget 进行释放.
-            // 正常使用的时候, new 出来的对象添加到布局管理器的....
-            delete item->widget();
-        }
+    SessionFriendModel* target = modelOf(itemType);
+    if (target == nullptr || target == this->model()) {
+        return;
+    }
+    // setModel 会创建新的 selectionModel, 旧的需要手动释放
+    QItemSelectionModel* oldSelectionModel = this->selectionModel();
+    this->setModel(target);
+    delete oldSelectionModel;
+}
+
+void SessionFriendArea::resetItems(ItemType itemType, const QList<SessionFriendItemData> &items)
+{
+    SessionFriendModel* target = modelOf(itemType);
+    if (target == nullptr) {
+        LOG() << "错误的 ItemType! itemType=" << itemType;
+        return;
     }
+    target->resetItems(items);
 }
 
-// 此时这个函数添加的就不是 SessionFriendItem 了, 而是 SessionFriendItem 的子类.
-// SessionItem, FriendItem, ApplyItem 其中的一个.
 void SessionFriendArea::addItem(ItemType itemType, const QString& id, const QIcon &avatar, const QString &name, const QString &text)
 {
-    SessionFriendItem* item = nullptr;
-    if (itemType == SessionItemType) {
-        item = new SessionItem(this, id, avatar, name, text);
-    } else if (itemType == FriendItemType) {
-        item = new FriendItem(this, id, avatar, name, text);
-    } else if (itemType == ApplyItemType) {
-        item = new ApplyItem(this, id, avatar, name);
-    } else {
+    SessionFriendModel* target = modelOf(itemType);
+    if (target == nullptr) {
         LOG() << "错误的 ItemType! itemType=" << itemType;
         return;
     }
-    container->layout()->addWidget(item);
+    target->addItem(SessionFriendItemData{id, avatar, name, text});
 }
 
 void SessionFriendArea::clickItem(int index)
 {
-    if (index < 0 || index >= container->layout()->count()) {
+    SessionFriendModel* model = currentModel();
+    if (index < 0 || index >= model->rowCount()) {
         LOG() << "点击元素的下标超出范围! index=" << index;
         return;
     }
-    QLayoutItem* layoutItem = container->layout()->itemAt(index);
-    if (layoutItem == nullptr || layoutItem->widget() == nullptr) {
-        LOG() << "指定的元素不存在! index=" << index;
-        return;
-    }
-    SessionFriendItem* item = dynamic_cast<SessionFriendItem*>(layoutItem->widget());
-    item->select();
+    model->select(index);
+    this->scrollTo(model->index(index));
+    this->active(index);
 }
 
-//////////////////////////////////////////////////////////
-/// 滚动区域中的 Item 的实现
-//////////////////////////////////////////////////////////
+void SessionFriendArea::doItemsLayout()
+{
+    PERF_SCOPE("SessionFriendArea::layout");
+    QListView::doItemsLayout();
+}
 
-SessionFriendItem::SessionFriendItem(QWidget *owner, const QIcon &avatar, const QString &name, const QString &text)
-    : owner(owner)
+void SessionFriendArea::paintEvent(QPaintEvent *event)
 {
-    this->setFixedHeight(70);
-    this->setStyleSheet("QWidget { background-color: rgb(231, 231, 231); }");
-
-    // 创建网格布局管理器
-    QGridLayout* layout = new QGridLayout();
-    layout->setContentsMargins(20, 0, 0, 0);
-    layout->setHorizontalSpacing(10);
-    layout->setVerticalSpacing(0);
-    this->setLayout(layout);
-
-    // 创建头像
-    QPushButton* avatarBtn = new QPushButton();
-    avatarBtn->setFixedSize(50, 50);
-    avatarBtn->setIconSize(QSize(50, 50));
-    avatarBtn->setIcon(avatar);
-    avatarBtn->setStyleSheet("QPushButton {border: none;}");
-    avatarBtn->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
-
-    // 创建名字
-    QLabel* nameLabel = new QLabel();
-    nameLabel->setText(name);
-    nameLabel->setStyleSheet("QLabel { font-size: 18px; font-weight: 600; }");
-    nameLabel->setFixedHeight(35);
-    nameLabel->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
-
-    // 创建消息预览的 label
-    messageLabel = new QLabel();
-    messageLabel->setText(text);
-    messageLabel->setFixedHeight(35);
-    messageLabel->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
-
-    // 头像处于 0, 0 位置, 占据 2 行, 占据 2 列
-    layout->addWidget(avatarBtn, 0, 0, 2, 2);
-    // 名字处于 0, 2 位置, 占据 1 行, 占据 1 列
-    layout->addWidget(nameLabel, 0, 2, 1, 8);
-    // 消息预览处于 1, 2 位置, 占据 1 行, 占据 1 列
-    layout->addWidget(messageLabel, 1, 2, 1, 8);
+    PERF_SCOPE("SessionFriendArea::paint");
+    QListView::paintEvent(event);
 }
 
-void SessionFriendItem::paintEvent(QPaintEvent *event)
+void SessionFriendArea::mousePressEvent(QMouseEvent *event)
 {
-    (void) event;
-    QStyleOption opt;
-    opt.initFrom(this);
-    QPainter p(this);
-    style()->drawPrimitive(QStyle::PE_Widget, &opt, &p, this);
+    QModelIndex index = this->indexAt(event->pos());
+    if (!index.isValid()) {
+        return;
+    }
+    SessionFriendModel* model = currentModel();
+
+    // 好友申请 Item 上的两个按钮, 是 delegate 绘制出来的, 需要在这里判定是否点中.
+    if (model->getItemType() == ApplyItemType) {
+        const QString& userId = model->itemAt(index.row()).id;
+        QRect itemRect = this->visualRect(index);
+        DataCenter* dataCenter = DataCenter::getInstance();
+        if (itemDelegate->acceptButtonRect(itemRect).contains(event->pos())) {
+            // 发送网络请求, 告知服务器, 同意了.
+            // 针对这个操作, 信号处理, 是需要更新好友列表以及好友申请列表. 直接在主窗口中处理更合适的.
+            dataCenter->acceptFriendApplyAsync(userId);
+            return;
+        }
+        if (itemDelegate->rejectButtonRect(itemRect).contains(event->pos())) {
+            dataCenter->rejectFriendApplyAsync(userId);
+            return;
+        }
+    }
+
+    this->clickItem(index.row());
 }
 
-void SessionFriendItem::mousePressEvent(QMouseEvent *event)
+SessionFriendModel *SessionFriendArea::modelOf(ItemType itemType)
 {
-    (void) event;
-    select();
+    if (itemType == SessionItemType) {
+        return sessionModel;
+    } else if (itemType == FriendItemType) {
+        return friendModel;
+    } else if (itemType == ApplyItemType) {
+        return applyModel;
+    }
+    return nullptr;
 }
 
-void SessionFriendItem::enterEvent(QEnterEvent *event)
+SessionFriendModel *SessionFriendArea::currentModel()
 {
-    (void) event;
+    return static_cast<SessionFriendModel*>(this->model());
+}
 
-    // 当前这个 item 是选中状态, 则背景色不受到该逻辑影响
-    if (this->selected) {
-        return;
+void SessionFriendArea::active(int row)
+{
+    SessionFriendModel* model = currentModel();
+    const QString id = model->itemAt(row).id;
+    MainWidget* mainWidget = MainWidget::getInstance();
+
+    if (model->getItemType() == SessionItemType) {
+        // 点击之后, 要加载会话的历史消息列表
+        LOG() << "点击 SessionItem 触发的逻辑! chatSessionId=" << id;
+
+        // 加载会话历史消息, 即会涉及到当前内存的数据操作, 又会涉及到网络通信, 还涉及到界面的变更.
+        mainWidget->loadRecentMessage(id);
+
+        // 清空未读消息的数据, 并且更新这一行的显示. 把会话消息预览这里, 前面的 "[未读x条]" 内容给干掉
+        DataCenter* dataCenter = DataCenter::getInstance();
+        dataCenter->clearUnread(id);
+        model->refreshRow(row);
+    } else if (model->getItemType() == FriendItemType) {
+        // 点击之后, 要激活对应的会话列表元素
+        LOG() << "点击 FriendItem 触发的逻辑! userId=" << id;
+        mainWidget->switchSession(id);
+    } else {
+        // 好友申请只有两个按钮是可以点击的
+        LOG() << "点击 ApplyItem 触发的逻辑! userId=" << id;
     }
-    // 设置一个更深的颜色
-    this->setStyleSheet("QWidget { background-color: rgb(215, 215, 215);}");
 }
 
-void SessionFriendItem::leaveEvent(QEvent *event)
+void SessionFriendArea::updateLastMessage(const QString &chatSessionId)
 {
-    (void) event;
-
-    // 当前这个 item 是选中状态, 则背景色不受到该逻辑影响
-    if (this->selected) {
+    // 短时间内收到大量消息时, 不逐条处理, 合并到下一次事件循环中一起处理, 界面也只重绘一次.
+    pendingLastMessages.removeOne(chatSessionId);
+    pendingLastMessages.push_back(chatSessionId);
+    if (flushScheduled) {
         return;
     }
-    // 还原背景色
-    this->setStyleSheet("QWidget { background-color: rgb(231, 231, 231);}");
+    flushScheduled = true;
+    QTimer::singleShot(0, this, &SessionFriendArea::flushLastMessages);
 }
 
-void SessionFriendItem::select()
+void SessionFriendArea::flushLastMessages()
 {
-    // 鼠标点击时会触发这个函数.
-    // 拿到所有的兄弟元素
-    const QObjectList children = this->parentWidget()->children();
-    for (QObject* child : children) {
-        if (!child->isWidgetType()) {
-            // 判定是否是 widget.
+    flushScheduled = false;
+    DataCenter* dataCenter = DataCenter::getInstance();
+
+    // 按照消息到达的顺序处理, 最后收到消息的会话最终排在最前面
+    for (const QString& chatSessionId : pendingLastMessages) {
+        // 1. 把最后一条消息, 获取到.
+        QList<Message>* messageList = dataCenter->getRecentMessageList(chatSessionId);
+        if (messageList == nullptr || messageList->size() == 0) {
+            // 当前会话没有任何消息, 无需更新
             continue;
         }
-        // 确实是 widget, 就把这里的child 强转成 SessionFriendItem
-        SessionFriendItem* item = dynamic_cast<SessionFriendItem*>(child);
-        if (item->selected) {
-            item->selected = false;
-            item->setStyleSheet("QWidget { background-color: rgb(231, 231, 231); }");
-        }
-    }
-
-    // 点击时, 修改背景色.
-    // 此处不仅仅要设置当前 item 背景色, 也要还原其他元素的背景色.
-    this->setStyleSheet("QWidget { background-color: rgb(210, 210, 210); }");
-    this->selected = true;
 
-    // 调用 active
-    this->active();
-}
+        // 2. 会话数据也要更新, 重新构建会话列表时保持一致
+        dataCenter->updateChatSessionLastMessage(chatSessionId);
 
-void SessionFriendItem::active()
-{
-    // 父类的 active
-    // 并不需要实现任何逻辑.
+        // 3. 原地更新这一行, 并且移动到最前面. 未读消息数目是通过 UnreadRole 实时获取的, 不需要额外处理.
+        sessionModel->updateText(chatSessionId, lastMessageText(messageList->back()));
+        int row = sessionModel->findRow(chatSessionId);
+        if (row > 0) {
+            sessionModel->moveToTop(row);
+        }
+    }
+    pendingLastMessages.clear();
 }
 
 //////////////////////////////////////////////////////////
-/// 会话 Item 的实现
+/// 列表的数据模型
 //////////////////////////////////////////////////////////
 
-SessionItem::SessionItem(QWidget *owner, const QString &chatSessionId, const QIcon &avatar,
-                         const QString &name, const QString &lastMessage)
-    : SessionFriendItem(owner, avatar, name, lastMessage), chatSessionId(chatSessionId), text(lastMessage)
+SessionFriendModel::SessionFriendModel(ItemType itemType, QObject *parent)
+    : QAbstractListModel(parent), itemType(itemType)
 {
-    // 处理更新最后一个消息的信号
-    DataCenter* dataCenter = DataCenter::getInstance();
-    connect(dataCenter, &DataCenter::updateLastMessage, this, &SessionItem::updateLastMessage);
 
-    // 需要显示出未读消息的数目, 为了支持客户端重启之后, 未读消息仍然能正确显示.
-    int unread = dataCenter->getUnread(chatSessionId);
-    if (unread > 0) {
-        // 存在未读消息
-        this->messageLabel->setText(QString("[未读%1条] ").arg(unread) + text);
+}
+
+int SessionFriendModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
     }
+    return items.size();
 }
 
-void SessionItem::active()
+QVariant SessionFriendModel::data(const QModelIndex &index, int role) const
 {
-    // 点击之后, 要加载会话的历史消息列表
-    LOG() << "点击 SessionItem 触发的逻辑! chatSessionId=" << chatSessionId;
+    if (!index.isValid() || index.row() >= items.size()) {
+        return QVariant();
+    }
+    const SessionFriendItemData& item = items[index.row()];
+    switch (role) {
+    case Qt::DisplayRole:
+        return item.name;
+    case Qt::DecorationRole:
+        return item.avatar;
+    case IdRole:
+        return item.id;
+    case TextRole:
+        return item.text;
+    case UnreadRole:
+        // 只有会话才有未读消息. 从 DataCenter 实时获取, 客户端重启之后也能正确显示.
+        if (itemType != SessionItemType) {
+            return 0;
+        }
+        return DataCenter::getInstance()->getUnread(item.id);
+    case SelectedRole:
+        return !selectedId.isEmpty() && item.id == selectedId;
+    default:
+        return QVariant();
+    }
+}
 
-    // 加载会话历史消息, 即会涉及到当前内存的数据操作, 又会涉及到网络通信, 还涉及到界面的变更.
-    MainWidget* mainWidget = MainWidget::getInstance();
-    mainWidget->loadRecentMessage(chatSessionId);
+void SessionFriendModel::resetItems(const QList<SessionFriendItemData> &items)
+{
+    beginResetModel();
+    this->items = items;
+    rowIndex.clear();
+    rowIndex.reserve(items.size());
+    for (int i = 0; i < items.size(); ++i) {
+        rowIndex.insert(items[i].id, i);
+    }
+    endResetModel();
+}
 
-    // 清空未读消息的数据, 并且更新显示
-    DataCenter* dataCenter = DataCenter::getInstance();
-    dataCenter->clearUnread(chatSessionId);
+void SessionFriendModel::addItem(const SessionFriendItemData &item)
+{
+    beginInsertRows(QModelIndex(), items.size(), items.size());
+    rowIndex.insert(item.id, items.size());
+    items.push_back(item);
+    endInsertRows();
+}
 
-    // 更新界面的显示. 把会话消息预览这里, 前面的 "[未读x条]" 内容给干掉
-    this->messageLabel->setText(text);
+const SessionFriendItemData &SessionFriendModel::itemAt(int row) const
+{
+    return items[row];
 }
 
-void SessionItem::updateLastMessage(const QString &chatSessionId)
+int SessionFriendModel::findRow(const QString &id) const
 {
-    DataCenter* dataCenter = DataCenter::getInstance();
-    // 1. 判定 chatSessionId 是否匹配
-    if (this->chatSessionId != chatSessionId) {
-        // 当前 SessionItem 不是你正在发消息的 SessionItem!
-        return;
-    }
-    // chatSessionId 匹配, 真正更新最后一条消息!!
+    return rowIndex.value(id, -1);
+}
 
-    // 2. 把最后一条消息, 获取到.
-    QList<Message>* messageList = dataCenter->getRecentMessageList(chatSessionId);
-    if (messageList == nullptr || messageList->size() == 0) {
-        // 当前会话没有任何消息, 无需更新
+void SessionFriendModel::moveToTop(int row)
+{
+    if (row <= 0 || row >= items.size()) {
         return;
     }
-
-    const Message& lastMessage = messageList->back();
-
-    // 3. 明确显示的文本内容
-    //    由于消息有四种类型.
-    //    文本消息, 直接显示消息的内容; 图片消息, 直接显示 "[图片]"; 文件消息, 直接显示 "[文件]"; 语音消息, 直接显示 "[语音]"
-    if (lastMessage.messageType == TEXT_TYPE) {
-        text = lastMessage.content;
-    } else if (lastMessage.messageType == IMAGE_TYPE) {
-        text = "[图片]";
-    } else if (lastMessage.messageType == FILE_TYPE) {
-        text = "[文件]";
-    } else if (lastMessage.messageType == SPEECH_TYPE) {
-        text = "[语音]";
-    } else {
-        LOG() << "错误的消息类型!";
-        return;
+    beginMoveRows(QModelIndex(), row, row, QModelIndex(), 0);
+    items.move(row, 0);
+    // 只有 [0, row] 范围内的行号发生了变化
+    for (int i = 0; i <= row; ++i) {
+        rowIndex[items[i].id] = i;
     }
+    endMoveRows();
+}
 
-    // 4. 把这个内容, 显示到界面上
-    //    针对这里的逻辑, 后续还需要考虑到 "未读消息" 情况. 关于未读消息的处理, 后续编写 "接收消息" 的时候再处理.
-    //    先判定, 当前消息的会话, 是不是正在选中的会话. 如果是, 不会更新任何未读消息.
-    //    如果不是, 看未读消息是否 > 0, 并且做出前缀的拼装
-    if (chatSessionId == dataCenter->getCurrentChatSessionId()) {
-        this->messageLabel->setText(text);
-    } else {
-        int unread = dataCenter->getUnread(chatSessionId);
-        if (unread > 0) {
-            this->messageLabel->setText(QString("[未读%1条] ").arg(unread) + text);
-        }
+void SessionFriendModel::select(int row)
+{
+    // 还原之前选中的元素, 再设置新的选中元素
+    int oldRow = findRow(selectedId);
+    selectedId = items[row].id;
+    if (oldRow >= 0 && oldRow != row) {
+        refreshRow(oldRow);
     }
+    refreshRow(row);
 }
 
-//////////////////////////////////////////////////////////
-/// 好友 Item 的实现
-//////////////////////////////////////////////////////////
-
-FriendItem::FriendItem(QWidget *owner, const QString &userId, const QIcon &avatar,
-                       const QString &name, const QString &description)
-    : SessionFriendItem(owner, avatar, name, description), userId(userId)
+void SessionFriendModel::updateText(const QString &id, const QString &text)
 {
-
+    int row = findRow(id);
+    if (row < 0) {
+        return;
+    }
+    items[row].text = text;
+    refreshRow(row);
 }
 
-void FriendItem::active()
+void SessionFriendModel::refreshRow(int row)
 {
-    // 点击之后, 要激活对应的会话列表元素
-    LOG() << "点击 FriendItem 触发的逻辑! userId=" << userId;
-
-    MainWidget* mainWidget = MainWidget::getInstance();
-    mainWidget->switchSession(userId);
+    QModelIndex idx = this->index(row);
+    emit dataChanged(idx, idx);
 }
 
 //////////////////////////////////////////////////////////
-/// 好友申请 Item 的实现
+/// 绘制一个 Item
 //////////////////////////////////////////////////////////
 
-ApplyItem::ApplyItem(QWidget *owner, const QString &userId, const QIcon &avatar, const QString &name)
-    : SessionFriendItem(owner, avatar, name, ""), userId(userId)
+SessionFriendDelegate::SessionFriendDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
 {
-    // 1. 移除父类的 messageLabel
-    QGridLayout* layout = dynamic_cast<QGridLayout*>(this->layout());
-    layout->removeWidget(messageLabel);
-    // 要记得释放内存, 否则会内存泄露.
-    delete messageLabel;
-
-    // 2. 创建两个按钮出来
-    QPushButton* acceptBtn = new QPushButton();
-    acceptBtn->setText("同意");
-    QPushButton* rejectBtn = new QPushButton();
-    rejectBtn->setText("拒绝");
-
-    // 3. 添加到布局管理器中
-    layout->addWidget(acceptBtn, 1, 2, 1, 1);
-    layout->addWidget(rejectBtn, 1, 3, 1, 1);
-
-    // 4. 添加信号槽
-    connect(acceptBtn, &QPushButton::clicked, this, &ApplyItem::acceptFriendApply);
-    connect(rejectBtn, &QPushButton::clicked, this, &ApplyItem::rejectFriendApply);
+    nameFont.setPixelSize(18);
+    nameFont.setWeight(QFont::DemiBold);
 }
 
-void ApplyItem::active()
+QSize SessionFriendDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
 {
-    // 这个函数本身就不需要实现任何内容
-    LOG() << "点击 ApplyItem 触发的逻辑! userId=" << userId;
+    (void) index;
+    return QSize(option.rect.width(), ITEM_HEIGHT);
 }
 
-void ApplyItem::acceptFriendApply()
+QRect SessionFriendDelegate::acceptButtonRect(const QRect &itemRect) const
 {
-    // 发送网络请求, 告知服务器, 同意了.
-    DataCenter* dataCenter = DataCenter::getInstance();
-    // 同意谁的好友申请了.
-    // 针对这个操作, 信号处理, 是需要更新好友列表以及好友申请列表. 直接在主窗口中处理更合适的.
-    dataCenter->acceptFriendApplyAsync(this->userId);
+    int left = itemRect.left() + MARGIN_LEFT + AVATAR_SIZE + SPACING;
+    int top = itemRect.top() + LINE_HEIGHT + (LINE_HEIGHT - BUTTON_HEIGHT) / 2;
+    return QRect(left, top, BUTTON_WIDTH, BUTTON_HEIGHT);
 }
 
-void ApplyItem::rejectFriendApply()
+QRect SessionFriendDelegate::rejectButtonRect(const QRect &itemRect) const
 {
-    DataCenter* dataCenter = DataCenter::getInstance();
-    dataCenter->rejectFriendApplyAsync(this->userId);
+    return acceptButtonRect(itemRect).translated(BUTTON_WIDTH + SPACING, 0);
 }
 
+void SessionFriendDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const QRect& rect = option.rect;
+    painter->save();
+
+    // 1. 背景色. 选中的颜色最深, 鼠标悬停其次.
+    QColor background = theme::SESSION_ITEM_BACKGROUND;
+    if (index.data(SessionFriendModel::SelectedRole).toBool()) {
+        background = theme::SESSION_ITEM_SELECTED;
+    } else if (option.state & QStyle::State_MouseOver) {
+        background = theme::SESSION_ITEM_HOVER;
+    }
+    painter->fillRect(rect, background);
+
+    // 2. 头像. 会话使用会话的头像, 好友和好友申请使用用户的头像.
+    const SessionFriendModel* model = static_cast<const SessionFriendModel*>(index.model());
+    QString id = index.data(SessionFriendModel::IdRole).toString();
+    QString avatarKey = model->getItemType() == SessionItemType ? AvatarCache::sessionKey(id) : AvatarCache::userKey(id);
+    QIcon avatar = index.data(Qt::DecorationRole).value<QIcon>();
+    QRect avatarRect(rect.left() + MARGIN_LEFT, rect.top() + (ITEM_HEIGHT - AVATAR_SIZE) / 2, AVATAR_SIZE, AVATAR_SIZE);
+    AvatarCache::getInstance()->paint(painter, avatarRect, avatarKey, avatar);
+
+    // 3. 名字
+    int textLeft = avatarRect.right() + 1 + SPACING;
+    int textWidth = rect.right() + 1 - MARGIN_RIGHT - textLeft;
+    QRect nameRect(textLeft, rect.top(), textWidth, LINE_HEIGHT);
+    QFontMetrics nameMetrics(nameFont);
+    painter->setFont(nameFont);
+    painter->setPen(option.palette.color(QPalette::WindowText));
+    painter->drawText(nameRect, Qt::AlignLeft | Qt::AlignVCenter,
+                      nameMetrics.elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideRight, textWidth));
+
+    // 4. 第二行. 好友申请显示 "同意" "拒绝" 两个按钮, 其他情况显示消息预览.
+    if (model->getItemType() == ApplyItemType) {
+        QStyle* style = option.widget ? option.widget->style() : QApplication::style();
+        QStyleOptionButton button;
+        button.state = QStyle::State_Enabled | QStyle::State_Raised;
+        button.palette = option.palette;
+        button.fontMetrics = option.fontMetrics;
+
+        button.rect = acceptButtonRect(rect);
+        button.text = "同意";
+        style->drawControl(QStyle::CE_PushButton, &button, painter, option.widget);
+
+        button.rect = rejectButtonRect(rect);
+        button.text = "拒绝";
+        style->drawControl(QStyle::CE_PushButton, &button, painter, option.widget);
+    } else {
+        QString text = index.data(SessionFriendModel::TextRole).toString();
+        int unread = index.data(SessionFriendModel::UnreadRole).toInt();
+        if (unread > 0) {
+            // 存在未读消息
+            text = QString("[未读%1条] ").arg(unread) + text;
+        }
+        // 消息预览只显示一行
+        text.replace('\n', ' ');
+        QRect textRect(textLeft, rect.top() + LINE_HEIGHT, textWidth, LINE_HEIGHT);
+        painter->setFont(option.font);
+        painter->drawText(textRect, Qt::AlignLeft | Qt::AlignVCenter,
+                          option.fontMetrics.elidedText(text, Qt::ElideRight, textWidth));
+    }
 
-
-
-
-
-
-
-
-
-
-
+    painter->restore();
+}
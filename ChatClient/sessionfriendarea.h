@@ -2,8 +2,11 @@
 #define SESSIONFRIENDAREA_H
 
 #include <QWidget>
-#include <QScrollArea>
-#include <QLabel>
+#include <QListView>
+#include <QAbstractListModel>
+#include <QStyledItemDelegate>
+#include <QIcon>
+#include <QHash>
 
 //////////////////////////////////////////////////////////
 /// 滚动区域中的 Item 的类型
@@ -15,125 +18,135 @@ enum ItemType {
     ApplyItemType
 };
 
+//////////////////////////////////////////////////////////
+/// 一个 Item 的数据. id 跟着不同的 itemType 有不同的含义.
+/// 如果是 SessionItem, id 就是 chatSessionId
+/// 如果是 FriendItem / ApplyItem, id 就是 userId
+//////////////////////////////////////////////////////////
+
+struct SessionFriendItemData {
+    QString id;
+    QIcon avatar;
+    QString name;
+    // 会话的最后一条消息预览, 或者好友的签名. 好友申请不显示这部分.
+    QString text;
+};
+
+class SessionFriendModel;
+class SessionFriendDelegate;
+
 //////////////////////////////////////////////////////////
 /// 整个滚动区域的实现
+/// 会话列表, 好友列表, 好友申请列表各自有一个 model. 切换标签页只是切换 model, 只有可见的 Item 才会被绘制.
 //////////////////////////////////////////////////////////
 
-class SessionFriendArea : public QScrollArea
+class SessionFriendArea : public QListView
 {
     Q_OBJECT
 public:
     explicit SessionFriendArea(QWidget *parent = nullptr);
 
-    // 清空该区域中所有的 item
-    void clear();
+    // 切换显示哪种列表
+    void switchTo(ItemType itemType);
 
-    // 添加一个 item 到该区域中, itemType 表示添加哪种 item, id 跟着不同的 itemType 有不同的含义.
-    // 如果是 SessionItem, id 就是 chatSessionId
-    // 如果是 FriendItem / ApplyItem, id 就是 userId
+    // 使用新的数据, 整体替换某种列表的内容
+    void resetItems(ItemType itemType, const QList<SessionFriendItemData>& items);
+
+    // 添加一个 item 到指定的列表中
     void addItem(ItemType itemType, const QString& id, const QIcon& avatar, const QString& name, const QString& text);
 
-    // 选中某个指定的 item, 通过 index 下标来进行选择
+    // 选中当前列表中的某个指定的 item, 通过 index 下标来进行选择
     void clickItem(int index);
 
-private:
-    // 后续往 container 内部的 layout 中添加元素, 就能够触发 QScrollArea 滚动效果.
-    QWidget* container;
-
-signals:
-};
-
-//////////////////////////////////////////////////////////
-/// 滚动区域中的 Item 的实现
-//////////////////////////////////////////////////////////
-
-class SessionFriendItem : public QWidget {
-    Q_OBJECT
-public:
-    SessionFriendItem(QWidget* owner, const QIcon& avatar, const QString& name, const QString& text);
+    void doItemsLayout() override;
 
+protected:
     void paintEvent(QPaintEvent* event) override;
     void mousePressEvent(QMouseEvent* event) override;
-    void enterEvent(QEnterEvent* event) override;
-    void leaveEvent(QEvent* event) override;
-
-    void select();
-    // active 函数期望实现 Item 被点击之后的业务逻辑.
-    virtual void active();
 
 private:
-    // owner 就指向了上述的 SessionFriendArea
-    QWidget* owner;
-
-    // 这个变量用来表示当前 Item 是否是 "选中" 状态
-    bool selected = false;
-
-
-protected:
-    // 让这个成员被子类访问
-    QLabel* messageLabel;
-};
-
-//////////////////////////////////////////////////////////
-/// 会话 Item 的实现
-//////////////////////////////////////////////////////////
+    SessionFriendModel* modelOf(ItemType itemType);
+    SessionFriendModel* currentModel();
 
-class SessionItem : public SessionFriendItem {
-    Q_OBJECT
-
-public:
-    SessionItem(QWidget* owner, const QString& chatSessionId, const QIcon& avatar,
-                const QString& name, const QString& lastMessage);
-
-    void active() override;
+    // 选中之后, Item 被点击的业务逻辑
+    void active(int row);
 
+    // 会话列表中, 某个会话的最后一条消息发生变化. 同一帧内的多次变化会合并, 在下一次事件循环中统一处理.
     void updateLastMessage(const QString& chatSessionId);
+    void flushLastMessages();
 
-private:
-    // 当前会话 id
-    QString chatSessionId;
+    SessionFriendModel* sessionModel;
+    SessionFriendModel* friendModel;
+    SessionFriendModel* applyModel;
+    SessionFriendDelegate* itemDelegate;
 
-    // 最后一条消息的文本预览
-    QString text;
+    // 等待处理的最后一条消息变化, 按照消息到达的先后顺序排列, 不重复
+    QList<QString> pendingLastMessages;
+    bool flushScheduled = false;
 };
 
 //////////////////////////////////////////////////////////
-/// 好友 Item 的实现
+/// 列表的数据模型. 选中状态和未读消息数目, 都作为 model 的 role 提供给 delegate.
 //////////////////////////////////////////////////////////
 
-class FriendItem : public SessionFriendItem {
+class SessionFriendModel : public QAbstractListModel {
     Q_OBJECT
-
 public:
-    FriendItem(QWidget* owner, const QString& userId, const QIcon& avatar, const QString& name,
-               const QString& description);
-
-    void active() override;
+    enum Role {
+        IdRole = Qt::UserRole + 1,
+        TextRole,
+        UnreadRole,
+        SelectedRole
+    };
+
+    SessionFriendModel(ItemType itemType, QObject* parent);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    ItemType getItemType() const { return itemType; }
+
+    void resetItems(const QList<SessionFriendItemData>& items);
+    void addItem(const SessionFriendItemData& item);
+    const SessionFriendItemData& itemAt(int row) const;
+    int findRow(const QString& id) const;
+
+    // 修改选中的 item
+    void select(int row);
+    // 原地更新某一个 item 的文本, 并通知界面重绘这一行
+    void updateText(const QString& id, const QString& text);
+    // 把某一行移动到最前面
+    void moveToTop(int row);
+    // 只通知界面重绘这一行 (比如未读消息数目变化了)
+    void refreshRow(int row);
 
 private:
-    // 好友的用户id
-    QString userId;
+    ItemType itemType;
+    QList<SessionFriendItemData> items;
+    // id 到行号的索引, 避免每次都遍历整个列表
+    QHash<QString, int> rowIndex;
+    // 当前选中的 item 的 id
+    QString selectedId;
 };
 
 //////////////////////////////////////////////////////////
-/// 好友申请 Item 的实现
+/// 绘制一个 Item: 背景, 头像, 名字, 消息预览或者好友申请的两个按钮
 //////////////////////////////////////////////////////////
 
-class ApplyItem : public SessionFriendItem {
+class SessionFriendDelegate : public QStyledItemDelegate {
     Q_OBJECT
-
 public:
-    // 此处不需要显示一个 附加的文本了. 比上面的两个 Item 的构造函数, 少了一个参数
-    ApplyItem(QWidget* owner, const QString& userId, const QIcon& avatar, const QString& name);
+    explicit SessionFriendDelegate(QObject* parent);
 
-    void active() override;
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
 
-    void acceptFriendApply();
-    void rejectFriendApply();
+    // 好友申请 Item 中 "同意" 和 "拒绝" 按钮的位置
+    QRect acceptButtonRect(const QRect& itemRect) const;
+    QRect rejectButtonRect(const QRect& itemRect) const;
 
 private:
-    // 申请人的 userId
-    QString userId;
+    QFont nameFont;
 };
 
 #endif // SESSIONFRIENDAREA_H
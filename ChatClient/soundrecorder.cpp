@@ -1,10 +1,15 @@
 #include "soundrecorder.h"
-#include <QDir>
 #include <QMediaDevices>
 
 #include "model/data.h"
 #include "toast.h"
 
+// 录制时每攒够这么多压缩后的数据, 就发出一个分片, 1 秒 (压缩后每秒 8000 字节)
+static const int RECORD_CHUNK_BYTES = 8000;
+
+// 播放时预先缓冲的数据量, 200ms (16000Hz * 2 字节 * 0.2s)
+static const int PLAY_BUFFER_BYTES = 16000 * 2 / 5;
+
 /////////////////////////////////////////////
 /// 单例模式
 /////////////////////////////////////////////
@@ -22,13 +27,7 @@ SoundRecorder *SoundRecorder::getInstance()
 // 录制参考 https://doc.qt.io/qt-6/qaudiosource.html
 SoundRecorder::SoundRecorder(QObject *parent)
     : QObject{parent} {
-    // 1. 创建目录
-    QDir soundRootPath(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
-    soundRootPath.mkdir("sound");
-
-    // 2. 初始化录制模块
-    soundFile.setFileName(RECORD_PATH);
-
+    // 1. 初始化录制模块
     QAudioFormat inputFormat;
     inputFormat.setSampleRate(16000);
     inputFormat.setChannelCount(1);
@@ -50,7 +49,7 @@ SoundRecorder::SoundRecorder(QObject *parent)
         }
     });
 
-    // 3. 初始化播放模块
+    // 2. 初始化播放模块
     outputDevices = new QMediaDevices(this);
     outputDevice = outputDevices->defaultAudioOutput();
     QAudioFormat outputFormat;
@@ -62,6 +61,8 @@ SoundRecorder::SoundRecorder(QObject *parent)
         return;
     }
     audioSink = new QAudioSink(outputDevice, outputFormat);
+    // 数据都在内存中, 开始播放时一次填满缓冲区, 之后不会因为读取数据而断断续续
+    audioSink->setBufferSize(PLAY_BUFFER_BYTES);
 
     connect(audioSink, &QAudioSink::stateChanged, this, [=](QtAudio::State state) {
         if (state == QtAudio::IdleState) {
@@ -80,14 +81,45 @@ SoundRecorder::SoundRecorder(QObject *parent)
 }
 
 void SoundRecorder::startRecord() {
-    soundFile.open( QIODevice::WriteOnly | QIODevice::Truncate );
-    audioSource->start(&soundFile);
+    voiceDetector.reset();
+    encoder.reset();
+    emittedBytes = 0;
+    // 录制的数据不再写入临时文件, 而是在 readyRead 的时候直接读到内存中
+    recordDevice = audioSource->start();
+    connect(recordDevice, &QIODevice::readyRead, this, &SoundRecorder::readRecordData, Qt::UniqueConnection);
 }
 
 void SoundRecorder::stopRecord() {
+    // 1. 停止之前, 把设备中剩下的数据读完
+    readRecordData();
     audioSource->stop();
-    soundFile.close();
-    emit this->soundRecordDone(RECORD_PATH);
+    recordDevice = nullptr;
+
+    // 2. 一直没有说话, 这段录音没有内容
+    if (!voiceDetector.hasVoice()) {
+        LOG() << "录音中没有检测到说话";
+        emit this->soundRecordDone(QByteArray());
+        return;
+    }
+
+    // 3. 压缩剩下的采样点, 得到完整的语音. 末尾的静音还在 VAD 中, 直接丢弃.
+    encoder.finish();
+    emit this->soundRecordDone(encoder.data());
+}
+
+void SoundRecorder::readRecordData() {
+    if (recordDevice == nullptr) {
+        return;
+    }
+    // 去掉静音之后再压缩. 停顿中的数据会暂时留在 VAD 中, 继续说话时才输出
+    encoder.append(voiceDetector.process(recordDevice->readAll()));
+
+    // 攒够一片就发出去
+    const QByteArray& data = encoder.data();
+    if (data.size() - emittedBytes >= RECORD_CHUNK_BYTES) {
+        emit this->soundRecordChunk(data.sliced(emittedBytes));
+        emittedBytes = data.size();
+    }
 }
 
 void SoundRecorder::startPlay(const QByteArray& content) {
@@ -95,16 +127,19 @@ void SoundRecorder::startPlay(const QByteArray& content) {
         Toast::showMessage("数据加载中, 请稍后播放");
         return;
     }
-    // 1. 把数据写入到临时文件
-    model::writeByteArrayToFile(PLAY_PATH, content);
+    // 1. 正在播放其他语音, 先停下来
+    if (playBuffer.isOpen()) {
+        this->stopPlay();
+    }
 
-    // 2. 播放语音
-    inputFile.setFileName(PLAY_PATH);
-    inputFile.open(QIODevice::ReadOnly);
-    audioSink->start(&inputFile);
+    // 2. 解压之后直接从内存播放. 以前的原始 PCM 语音不需要解压.
+    playContent = SpeechCodec::decode(content);
+    playBuffer.setBuffer(&playContent);
+    playBuffer.open(QIODevice::ReadOnly);
+    audioSink->start(&playBuffer);
 }
 
 void SoundRecorder::stopPlay() {
     audioSink->stop();
-    inputFile.close();
+    playBuffer.close();
 }
@@ -2,24 +2,23 @@
 #define SOUNDRECORDER_H
 
 #include <QObject>
-#include <QStandardPaths>
-#include <QFile>
+#include <QBuffer>
 #include <QAudioSource>
 #include <QAudioSink>
 #include <QMediaDevices>
 
+#include "speechcodec.h"
+#include "voiceactivity.h"
+
 class SoundRecorder : public QObject
 {
     Q_OBJECT
-public:
-    const QString RECORD_PATH = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/sound/tmpRecord.pcm";
-    const QString PLAY_PATH = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/sound/tmpPlay.pcm";
-
 public:
     static SoundRecorder* getInstance();
 
     /////////////////////////////////////////////////
     /// 录制语音语音
+    /// 录制到的数据先去掉静音, 然后直接在内存中压缩, 每凑够一片就发出 soundRecordChunk 信号, 可以边录边上传.
     /////////////////////////////////////////////////
     // 开始录制
     void startRecord();
@@ -30,14 +29,22 @@ private:
     static SoundRecorder* instance;
     explicit SoundRecorder(QObject *parent = nullptr);
 
-    QFile soundFile;
+    // 读取录制设备中的数据并压缩
+    void readRecordData();
+
     QAudioSource* audioSource;
+    QIODevice* recordDevice = nullptr;
+    VoiceActivityDetector voiceDetector;
+    SpeechEncoder encoder;
+    // 已经通过 soundRecordChunk 发出去的字节数
+    qsizetype emittedBytes = 0;
 
     /////////////////////////////////////////////////
     /// 播放语音
     /////////////////////////////////////////////////
 public:
-    // 开始播放
+    // 开始播放. content 可以是压缩过的语音, 也可以是原始 PCM.
+    // 直接从内存中播放, 不经过临时文件. 正在播放其他语音时, 先停止之前的播放.
     void startPlay(const QByteArray& content);
     // 停止播放
     void stopPlay();
@@ -46,11 +53,15 @@ private:
     QAudioSink *audioSink;
     QMediaDevices *outputDevices;
     QAudioDevice outputDevice;
-    QFile inputFile;
+    // 正在播放的语音数据 (解压之后的 PCM)
+    QByteArray playContent;
+    QBuffer playBuffer;
 
 signals:
-    // 录制完毕后发送这个信号
-    void soundRecordDone(const QString& path);
+    // 录制过程中, 压缩好的数据每凑够一片发送一次. 所有分片按顺序拼起来, 就是录制完毕时 content 的开头部分.
+    void soundRecordChunk(const QByteArray& chunk);
+    // 录制完毕后发送这个信号. content 为压缩好的完整语音. 整段录音都没有说话时, content 为空
+    void soundRecordDone(const QByteArray& content);
     // 播放完毕发送这个信号
     void soundPlayDone();
 
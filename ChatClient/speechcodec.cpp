@@ -0,0 +1,238 @@
+#include "speechcodec.h"
+
+#include <QtEndian>
+#include <cstring>
+
+static const char MAGIC[4] = {'I', 'M', 'A', '4'};
+static const int HEADER_BYTES = 8;			// 魔数 4 字节 + 采样点个数 4 字节
+static const int BLOCK_SAMPLES = 505;		// 每个数据块的采样点个数 (和 WAV 中 256 字节的块一致)
+static const int BLOCK_HEADER_BYTES = 4;	// 第一个采样点 2 字节 + 步长索引 1 字节 + 保留 1 字节
+
+// IMA-ADPCM 的步长表
+static const int STEP_TABLE[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// 根据 4bit 编码调整步长索引
+static const int INDEX_TABLE[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+struct AdpcmState {
+    int predictor = 0;
+    int index = 0;
+};
+
+// 根据 4bit 编码更新预测值和步长索引, 返回重建出来的采样点.
+// 编码和解码共用这一个函数, 保证两边重建出的采样点完全一致.
+static inline int decodeNibble(AdpcmState& state, int nibble)
+{
+    int step = STEP_TABLE[state.index];
+    int diff = step >> 3;
+    if (nibble & 4) {
+        diff += step;
+    }
+    if (nibble & 2) {
+        diff += step >> 1;
+    }
+    if (nibble & 1) {
+        diff += step >> 2;
+    }
+    if (nibble & 8) {
+        state.predictor -= diff;
+    } else {
+        state.predictor += diff;
+    }
+    state.predictor = qBound(-32768, state.predictor, 32767);
+    state.index = qBound(0, state.index + INDEX_TABLE[nibble], 88);
+    return state.predictor;
+}
+
+// 把一个采样点编码成 4bit
+static inline int encodeSample(AdpcmState& state, int sample)
+{
+    int step = STEP_TABLE[state.index];
+    int diff = sample - state.predictor;
+    int nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+    }
+    if (diff >= (step >> 1)) {
+        nibble |= 2;
+        diff -= step >> 1;
+    }
+    if (diff >= (step >> 2)) {
+        nibble |= 1;
+    }
+    decodeNibble(state, nibble);
+    return nibble;
+}
+
+// 一个数据块压缩之后的字节数
+static inline qsizetype blockBytes(qsizetype count)
+{
+    return BLOCK_HEADER_BYTES + count / 2;
+}
+
+// 压缩之后的总字节数
+static qsizetype encodedSize(qsizetype sampleCount)
+{
+    qsizetype fullBlocks = sampleCount / BLOCK_SAMPLES;
+    qsizetype rest = sampleCount % BLOCK_SAMPLES;
+    qsizetype size = HEADER_BYTES + fullBlocks * blockBytes(BLOCK_SAMPLES);
+    if (rest > 0) {
+        size += blockBytes(rest);
+    }
+    return size;
+}
+
+// 从数据中得到采样点个数. 不是合法的压缩数据, 返回 -1.
+// 头部中的采样点个数为 0, 表示是边录边压缩的, 采样点个数由长度推算 (这种数据最后一个块的采样点个数总是奇数).
+static qsizetype sampleCountOf(const QByteArray& data)
+{
+    if (data.size() < HEADER_BYTES || memcmp(data.constData(), MAGIC, sizeof(MAGIC)) != 0) {
+        return -1;
+    }
+    quint32 sampleCount = qFromLittleEndian<quint32>(data.constData() + sizeof(MAGIC));
+    if (sampleCount > 0) {
+        // 原始 PCM 恰好以魔数开头的可能性很小, 再用长度校验一次
+        return encodedSize(sampleCount) == data.size() ? sampleCount : -1;
+    }
+    qsizetype bodyBytes = data.size() - HEADER_BYTES;
+    qsizetype fullBlocks = bodyBytes / blockBytes(BLOCK_SAMPLES);
+    qsizetype restBytes = bodyBytes % blockBytes(BLOCK_SAMPLES);
+    if (restBytes == 0) {
+        return fullBlocks * BLOCK_SAMPLES;
+    }
+    if (restBytes < BLOCK_HEADER_BYTES) {
+        return -1;
+    }
+    return fullBlocks * BLOCK_SAMPLES + (restBytes - BLOCK_HEADER_BYTES) * 2 + 1;
+}
+
+// 写入头部. sampleCount 为 0 表示由长度推算
+static void writeHeader(uchar* dst, quint32 sampleCount)
+{
+    memcpy(dst, MAGIC, sizeof(MAGIC));
+    qToLittleEndian<quint32>(sampleCount, dst + sizeof(MAGIC));
+}
+
+// 压缩一个数据块, 返回写入的字节数.
+// index 为上一个块结束时的步长索引, 块开头不需要重新适应音量. 压缩完之后更新为这个块结束时的步长索引.
+static qsizetype encodeBlock(const qint16* src, int count, int* index, uchar* dst)
+{
+    AdpcmState state;
+    state.predictor = src[0];
+    state.index = *index;
+
+    // 1. 块头
+    qToLittleEndian<qint16>(state.predictor, dst);
+    dst[2] = state.index;
+    dst[3] = 0;
+    dst += BLOCK_HEADER_BYTES;
+
+    // 2. 之后的采样点, 每个字节放两个, 低 4 位在前
+    for (int i = 1; i < count; ++i) {
+        int nibble = encodeSample(state, src[i]);
+        if (i & 1) {
+            *dst = nibble;
+        } else {
+            *dst++ |= nibble << 4;
+        }
+    }
+    *index = state.index;
+    return blockBytes(count);
+}
+
+QByteArray SpeechCodec::decode(const QByteArray &data)
+{
+    qsizetype sampleCount = sampleCountOf(data);
+    if (sampleCount < 0) {
+        // 以前的语音消息是原始 PCM, 直接播放
+        return data;
+    }
+    const uchar* src = reinterpret_cast<const uchar*>(data.constData()) + HEADER_BYTES;
+
+    QByteArray result(sampleCount * 2, Qt::Uninitialized);
+    qint16* dst = reinterpret_cast<qint16*>(result.data());
+
+    for (qsizetype begin = 0; begin < sampleCount; begin += BLOCK_SAMPLES) {
+        int count = qMin<qsizetype>(BLOCK_SAMPLES, sampleCount - begin);
+        AdpcmState state;
+        state.predictor = qFromLittleEndian<qint16>(src);
+        state.index = qBound(0, (int)src[2], 88);
+        src += BLOCK_HEADER_BYTES;
+
+        *dst++ = state.predictor;
+        for (int i = 1; i < count; ++i) {
+            int nibble = (i & 1) ? (*src & 0x0F) : (*src++ >> 4);
+            *dst++ = decodeNibble(state, nibble);
+        }
+        if ((count - 1) & 1) {
+            ++src;
+        }
+    }
+    return result;
+}
+
+/////////////////////////////////////////////
+/// 边录边压缩
+/////////////////////////////////////////////
+
+void SpeechEncoder::reset()
+{
+    pendingPcm.clear();
+    index = 0;
+    encoded = QByteArray(HEADER_BYTES, 0);
+    writeHeader(reinterpret_cast<uchar*>(encoded.data()), 0);
+}
+
+void SpeechEncoder::append(const QByteArray &pcm)
+{
+    pendingPcm.append(pcm);
+    const qsizetype blockPcmBytes = BLOCK_SAMPLES * 2;
+    qsizetype fullBlocks = pendingPcm.size() / blockPcmBytes;
+    if (fullBlocks == 0) {
+        return;
+    }
+
+    // 凑满的块全部压缩, 剩下的留到下次
+    qsizetype oldSize = encoded.size();
+    encoded.resize(oldSize + fullBlocks * blockBytes(BLOCK_SAMPLES));
+    uchar* dst = reinterpret_cast<uchar*>(encoded.data()) + oldSize;
+    const qint16* src = reinterpret_cast<const qint16*>(pendingPcm.constData());
+    for (qsizetype i = 0; i < fullBlocks; ++i) {
+        dst += encodeBlock(src + i * BLOCK_SAMPLES, BLOCK_SAMPLES, &index, dst);
+    }
+    pendingPcm.remove(0, fullBlocks * blockPcmBytes);
+}
+
+void SpeechEncoder::finish()
+{
+    int count = pendingPcm.size() / 2;
+    // 最后一个块的采样点个数必须是奇数 (这样才能由长度推算出来), 偶数时丢掉最后一个采样点 (1/16000 秒)
+    if (count % 2 == 0 && count > 0) {
+        --count;
+    }
+    if (count > 0) {
+        qsizetype oldSize = encoded.size();
+        encoded.resize(oldSize + blockBytes(count));
+        uchar* dst = reinterpret_cast<uchar*>(encoded.data()) + oldSize;
+        encodeBlock(reinterpret_cast<const qint16*>(pendingPcm.constData()), count, &index, dst);
+    }
+    pendingPcm.clear();
+}
@@ -0,0 +1,47 @@
+#ifndef SPEECHCODEC_H
+#define SPEECHCODEC_H
+
+#include <QByteArray>
+
+////////////////////////////////////////////////////////
+/// 语音消息的压缩编码 (IMA-ADPCM, 16000Hz 单声道)
+/// 录制出来的原始 PCM 每秒 32KB, 压缩之后每秒 8KB. 上传 / 存储 / 下载 / 语音转文字都使用压缩后的数据.
+/// 数据格式: 8 字节头部 ("IMA4" + 采样点个数, 小端. 边录边压缩时为 0, 由长度推算) + 若干个数据块.
+/// 每个数据块最多 505 个采样点, 块头 4 字节 (第一个采样点 + 步长索引), 之后每个采样点 4bit.
+/// 数据块之间互相独立, 损坏只影响所在的块.
+/// 没有头部的数据当作原始 PCM 处理, 这样以前发出去的语音消息仍然可以播放.
+////////////////////////////////////////////////////////
+class SpeechCodec
+{
+public:
+    // 解压成原始 PCM (Int16), 用来播放. 原始 PCM 原样返回 (不会拷贝).
+    // 压缩由 SpeechEncoder 在录制过程中完成.
+    static QByteArray decode(const QByteArray& data);
+
+private:
+    SpeechCodec() = delete;
+};
+
+////////////////////////////////////////////////////////
+/// 边录边压缩. 录制过程中不断追加 PCM, 每凑满一个数据块就压缩一块,
+/// data() 随时都可以拿去上传 (只会在末尾追加, 已经产生的数据不会再修改).
+////////////////////////////////////////////////////////
+class SpeechEncoder
+{
+public:
+    // 开始新的一段语音. data() 中只有头部.
+    void reset();
+    // 追加录制到的 PCM (Int16)
+    void append(const QByteArray& pcm);
+    // 录制结束, 压缩剩下不满一块的采样点. 之后 data() 就是完整的语音.
+    void finish();
+
+    const QByteArray& data() const { return encoded; }
+
+private:
+    QByteArray pendingPcm;		// 还没凑满一个数据块的 PCM
+    QByteArray encoded;			// 已经压缩好的数据
+    int index = 0;				// 上一个块结束时的步长索引
+};
+
+#endif // SPEECHCODEC_H
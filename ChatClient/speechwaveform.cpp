@@ -0,0 +1,107 @@
+#include "speechwaveform.h"
+
+#include <QList>
+
+#include "speechcodec.h"
+
+#if defined(__AVX2__)
+#define WAVEFORM_USE_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WAVEFORM_USE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define WAVEFORM_USE_NEON 1
+#include <arm_neon.h>
+#endif
+
+static const int SAMPLE_RATE = 16000;
+
+// 一段采样点的峰值 (绝对值的最大值). 先分别求出最小值和最大值, 最后再取绝对值, 避免 -32768 取绝对值溢出.
+static int segmentPeak(const qint16* samples, int count)
+{
+    int minValue = 0;
+    int maxValue = 0;
+    int i = 0;
+#if WAVEFORM_USE_AVX2
+    __m256i minAcc = _mm256_setzero_si256();
+    __m256i maxAcc = _mm256_setzero_si256();
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+        minAcc = _mm256_min_epi16(minAcc, v);
+        maxAcc = _mm256_max_epi16(maxAcc, v);
+    }
+    alignas(32) qint16 minLanes[16];
+    alignas(32) qint16 maxLanes[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(minLanes), minAcc);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(maxLanes), maxAcc);
+    for (int lane = 0; lane < 16; ++lane) {
+        minValue = qMin<int>(minValue, minLanes[lane]);
+        maxValue = qMax<int>(maxValue, maxLanes[lane]);
+    }
+#elif WAVEFORM_USE_SSE2
+    __m128i minAcc = _mm_setzero_si128();
+    __m128i maxAcc = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        minAcc = _mm_min_epi16(minAcc, v);
+        maxAcc = _mm_max_epi16(maxAcc, v);
+    }
+    alignas(16) qint16 minLanes[8];
+    alignas(16) qint16 maxLanes[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(minLanes), minAcc);
+    _mm_store_si128(reinterpret_cast<__m128i*>(maxLanes), maxAcc);
+    for (int lane = 0; lane < 8; ++lane) {
+        minValue = qMin<int>(minValue, minLanes[lane]);
+        maxValue = qMax<int>(maxValue, maxLanes[lane]);
+    }
+#elif WAVEFORM_USE_NEON
+    int16x8_t minAcc = vdupq_n_s16(0);
+    int16x8_t maxAcc = vdupq_n_s16(0);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(samples + i);
+        minAcc = vminq_s16(minAcc, v);
+        maxAcc = vmaxq_s16(maxAcc, v);
+    }
+    qint16 minLanes[8];
+    qint16 maxLanes[8];
+    vst1q_s16(minLanes, minAcc);
+    vst1q_s16(maxLanes, maxAcc);
+    for (int lane = 0; lane < 8; ++lane) {
+        minValue = qMin<int>(minValue, minLanes[lane]);
+        maxValue = qMax<int>(maxValue, maxLanes[lane]);
+    }
+#endif
+    // 剩下不满一组的采样点 (没有向量指令时, 就是全部的采样点)
+    for (; i < count; ++i) {
+        minValue = qMin<int>(minValue, samples[i]);
+        maxValue = qMax<int>(maxValue, samples[i]);
+    }
+    return qMax(maxValue, -minValue);
+}
+
+void SpeechWaveform::analyze(const QByteArray &content, int *durationMs, QByteArray *waveform)
+{
+    // 1. 解压成 PCM, 得到时长
+    QByteArray pcm = SpeechCodec::decode(content);
+    qsizetype sampleCount = pcm.size() / 2;
+    const qint16* samples = reinterpret_cast<const qint16*>(pcm.constData());
+    *durationMs = sampleCount * 1000 / SAMPLE_RATE;
+
+    // 2. 平均分段, 求每一段的峰值
+    int barCount = qMin<qsizetype>(BAR_COUNT, sampleCount);
+    QList<int> peaks(barCount);
+    int maxPeak = 0;
+    for (int i = 0; i < barCount; ++i) {
+        qsizetype begin = sampleCount * i / barCount;
+        qsizetype end = sampleCount * (i + 1) / barCount;
+        peaks[i] = segmentPeak(samples + begin, end - begin);
+        maxPeak = qMax(maxPeak, peaks[i]);
+    }
+
+    // 3. 相对最大峰值归一化, 音量小的语音也能看出起伏
+    waveform->resize(barCount);
+    for (int i = 0; i < barCount; ++i) {
+        (*waveform)[i] = maxPeak == 0 ? 0 : (char)(peaks[i] * 255 / maxPeak);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef SPEECHWAVEFORM_H
+#define SPEECHWAVEFORM_H
+
+#include <QByteArray>
+
+////////////////////////////////////////////////////////
+/// 语音消息的时长和波形
+/// 发送方计算好之后放在消息中, 接收方不需要下载语音, 就可以在气泡中显示时长和波形.
+/// 波形把整段语音平均分成 BAR_COUNT 段, 每段一个字节, 为这一段的峰值 (0~255, 相对整段语音的最大峰值).
+/// 峰值的计算根据编译目标使用 AVX2 / SSE2 / NEON, 都不支持时使用普通的循环.
+////////////////////////////////////////////////////////
+class SpeechWaveform
+{
+public:
+    static const int BAR_COUNT = 32;
+
+    // 根据语音内容 (压缩过的语音或者原始 PCM) 计算时长和波形
+    static void analyze(const QByteArray& content, int* durationMs, QByteArray* waveform);
+
+private:
+    SpeechWaveform() = delete;
+};
+
+#endif // SPEECHWAVEFORM_H
@@ -0,0 +1,73 @@
+#include "theme.h"
+
+#include <QApplication>
+#include <QWidget>
+#include <QVBoxLayout>
+#include <QPushButton>
+#include <QLabel>
+#include <QElapsedTimer>
+
+#include "model/data.h"
+
+namespace theme {
+
+void apply()
+{
+    QString style;
+    style += "QPushButton#" + ROW_AVATAR_BUTTON + " { border: none; }";
+    qApp->setStyleSheet(style);
+}
+
+// 创建一个 "头像 + 名字" 的行 (会话详情中的成员头像 AvatarItem). 选择好友列表已经改为委托绘制, 不再有行控件.
+// useTheme 为 false 时, 按照原来的方式单独设置头像按钮的样式表.
+static QWidget* createRow(QWidget* parent, bool useTheme)
+{
+    QWidget* row = new QWidget(parent);
+    QVBoxLayout* layout = new QVBoxLayout();
+    layout->setSpacing(0);
+    layout->setContentsMargins(0, 0, 0, 0);
+    row->setLayout(layout);
+
+    QPushButton* avatarBtn = new QPushButton();
+    avatarBtn->setFixedSize(45, 45);
+    avatarBtn->setIconSize(QSize(45, 45));
+    avatarBtn->setIcon(QIcon(":/resource/image/defaultAvatar.png"));
+    QLabel* nameLabel = new QLabel("张三");
+
+    if (useTheme) {
+        avatarBtn->setObjectName(ROW_AVATAR_BUTTON);
+    } else {
+        avatarBtn->setStyleSheet("QPushButton { border: none; }");
+    }
+
+    layout->addWidget(avatarBtn);
+    layout->addWidget(nameLabel);
+    return row;
+}
+
+// 创建 count 行并完成 polish (样式表在 polish 时才真正生效), 返回耗时 (毫秒)
+static double measureRows(int count, bool useTheme)
+{
+    QWidget container;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < count; ++i) {
+        QWidget* row = createRow(&container, useTheme);
+        row->ensurePolished();
+    }
+    return timer.nsecsElapsed() / 1000000.0;
+}
+
+void runRowBenchmark()
+{
+    const int ROW_COUNT = 1000;
+    // 先预热一次, 避免把图片资源和字体的首次加载算进去
+    measureRows(10, false);
+    measureRows(10, true);
+
+    double inlineMs = measureRows(ROW_COUNT, false);
+    double themeMs = measureRows(ROW_COUNT, true);
+    LOG() << "[主题测试] 创建" << ROW_COUNT << "个成员头像, 每个控件单独设置样式表:" << inlineMs << "ms, 全局主题:" << themeMs << "ms";
+}
+
+}  // end theme
@@ -0,0 +1,45 @@
+#ifndef THEME_H
+#define THEME_H
+
+#include <QColor>
+#include <QString>
+
+////////////////////////////////////////////////////////
+/// 全局主题
+/// 1. 大量创建的行控件 (会话详情中的成员头像), 不再各自调用 setStyleSheet,
+///    而是设置 objectName, 由 apply 中统一设置的应用级样式表匹配.
+///    每个控件单独的样式表都要单独解析一次, 统一之后只在启动时解析一次.
+/// 2. 委托中自己绘制的颜色也统一放在这里, 改配色只需要改这一个地方.
+////////////////////////////////////////////////////////
+namespace theme {
+
+// 行控件使用的 objectName, 和 apply 中的样式表对应
+inline const QString ROW_AVATAR_BUTTON = "rowAvatarBtn";		// 无边框的头像按钮
+
+// 会话 / 好友 / 好友申请列表
+inline const QColor SESSION_ITEM_BACKGROUND(231, 231, 231);
+inline const QColor SESSION_ITEM_HOVER(215, 215, 215);
+inline const QColor SESSION_ITEM_SELECTED(210, 210, 210);
+
+// 选择好友列表
+inline const QColor CHOOSE_ITEM_BACKGROUND(255, 255, 255);
+inline const QColor CHOOSE_ITEM_HOVER(230, 230, 230);
+
+// 消息气泡
+inline const QColor BUBBLE_LEFT(255, 255, 255);
+inline const QColor BUBBLE_RIGHT(137, 217, 97);
+inline const QColor BUBBLE_TEXT(0, 0, 0);
+inline const QColor MESSAGE_NAME(178, 178, 178);
+// 语音气泡中的波形. 播放中的语音使用另一种颜色
+inline const QColor SPEECH_WAVEFORM(90, 90, 90);
+inline const QColor SPEECH_WAVEFORM_PLAYING(30, 120, 220);
+
+// 设置应用级样式表. 在 QApplication 创建之后, 任何窗口创建之前调用一次.
+void apply();
+
+// 测量成员头像行的创建耗时, 对比 "每个控件单独设置样式表" 和 "使用全局主题". 只在 TEST_THEME_BENCH 为 1 时使用.
+void runRowBenchmark();
+
+}  // end theme
+
+#endif // THEME_H
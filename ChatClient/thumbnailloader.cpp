@@ -0,0 +1,102 @@
+#include "thumbnailloader.h"
+
+#include <QBuffer>
+#include <QImageReader>
+#include <QThread>
+
+#include "model/data.h"
+
+// 缩略图缓存最多占用 64MB
+static const qsizetype THUMBNAIL_CACHE_BYTES = 64 * 1024 * 1024;
+
+ThumbnailLoader* ThumbnailLoader::instance = nullptr;
+
+ThumbnailLoader *ThumbnailLoader::getInstance()
+{
+    if (instance == nullptr) {
+        instance = new ThumbnailLoader();
+    }
+    return instance;
+}
+
+ThumbnailLoader::ThumbnailLoader(QObject *parent)
+    : QObject{parent}
+{
+    // 解码是 CPU 密集的操作, 不需要占满所有的核心
+    pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount() / 2));
+    cache.setMaxCost(THUMBNAIL_CACHE_BYTES);
+}
+
+QString ThumbnailLoader::makeCacheKey(const QString &key, const QSize &size)
+{
+    return QString("%1@%2x%3").arg(key).arg(size.width()).arg(size.height());
+}
+
+bool ThumbnailLoader::find(const QString &key, const QSize &size, QPixmap *pixmap)
+{
+    QPixmap* cached = cache.object(makeCacheKey(key, size));
+    if (cached == nullptr) {
+        return false;
+    }
+    *pixmap = *cached;
+    return true;
+}
+
+void ThumbnailLoader::insert(const QString &key, const QSize &size, const QPixmap &pixmap)
+{
+    qsizetype cost = (qsizetype)pixmap.width() * pixmap.height() * pixmap.depth() / 8;
+    cache.insert(makeCacheKey(key, size), new QPixmap(pixmap), cost);
+}
+
+void ThumbnailLoader::load(const QString &key, const QByteArray &content, const QSize &size)
+{
+    QString cacheKey = makeCacheKey(key, size);
+    if (pending.contains(cacheKey) || cache.contains(cacheKey) || failed.contains(cacheKey)) {
+        return;
+    }
+    pending.insert(cacheKey);
+
+    // QByteArray 是写时拷贝的, 这里传入工作线程不会复制图片数据
+    pool.start([=]() {
+        QImage image = decode(content, size);
+        // QPixmap 只能在主线程中使用, 回到主线程中转换并放入缓存.
+        QMetaObject::invokeMethod(this, [=]() {
+            pending.remove(cacheKey);
+            if (image.isNull()) {
+                LOG() << "缩略图解码失败! key=" << key;
+                failed.insert(cacheKey);
+                return;
+            }
+            insert(key, size, QPixmap::fromImage(image));
+            emit loadDone(key, size);
+        }, Qt::QueuedConnection);
+    });
+}
+
+QImage ThumbnailLoader::decode(const QByteArray &content, const QSize &size)
+{
+    QByteArray data = content;
+    QBuffer buffer(&data);
+    QImageReader reader(&buffer);
+    // 让解码器直接输出目标尺寸. 对于 jpeg 这样的格式, 解码器可以跳过大部分的像素, 不需要先得到完整的原图.
+    reader.setScaledSize(size);
+    QImage image = reader.read();
+    if (!image.isNull() && image.size() != size) {
+        // 有的格式不支持 setScaledSize, 再缩放一次
+        image = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+QSize ThumbnailLoader::scaledSize(const QByteArray &content, int maxWidth)
+{
+    QByteArray data = content;
+    QBuffer buffer(&data);
+    QImageReader reader(&buffer);
+    QSize size = reader.size();
+    if (size.width() > maxWidth) {
+        // 图片更宽, 等比例缩放, 使用 maxWidth 作为实际的宽度
+        size = QSize(maxWidth, (double)size.height() / size.width() * maxWidth);
+    }
+    return size;
+}
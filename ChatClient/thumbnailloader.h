@@ -0,0 +1,52 @@
+#ifndef THUMBNAILLOADER_H
+#define THUMBNAILLOADER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QCache>
+#include <QPixmap>
+#include <QSet>
+#include <QImage>
+
+////////////////////////////////////////////////////////
+/// 图片缩略图的生成和缓存
+/// 在线程池中使用 QImageReader::setScaledSize 直接解码成显示尺寸, 不在主线程中解码原图.
+/// 原图只有在用户点开图片时才会完整解码.
+////////////////////////////////////////////////////////
+class ThumbnailLoader : public QObject
+{
+    Q_OBJECT
+public:
+    static ThumbnailLoader* getInstance();
+
+    // 查找已经生成好的缩略图. size 为实际的像素尺寸
+    bool find(const QString& key, const QSize& size, QPixmap* pixmap);
+    // 把主线程生成好的缩略图放入缓存 (比如很小的默认图片)
+    void insert(const QString& key, const QSize& size, const QPixmap& pixmap);
+    // 异步生成缩略图. 同一张缩略图, 同时只会有一个任务在执行. 完成之后发出 loadDone 信号.
+    // 解码失败的缩略图会被记录下来, 不再重复解码, 调用方继续使用默认图片.
+    void load(const QString& key, const QByteArray& content, const QSize& size);
+
+    // 根据图片的原始尺寸, 计算出宽度不超过 maxWidth 时的显示尺寸. 只读取图片的头部.
+    static QSize scaledSize(const QByteArray& content, int maxWidth);
+
+private:
+    static ThumbnailLoader* instance;
+    explicit ThumbnailLoader(QObject *parent = nullptr);
+
+    static QString makeCacheKey(const QString& key, const QSize& size);
+    static QImage decode(const QByteArray& content, const QSize& size);
+
+    QThreadPool pool;
+    // 缩略图缓存. cost 为图片占用的字节数
+    QCache<QString, QPixmap> cache;
+    // 正在生成中的缩略图
+    QSet<QString> pending;
+    // 解码失败的缩略图 (图片损坏或者格式不支持)
+    QSet<QString> failed;
+
+signals:
+    void loadDone(const QString& key, const QSize& size);
+};
+
+#endif // THUMBNAILLOADER_H
@@ -3,80 +3,95 @@
 #include <QApplication>
 #include <QScreen>
 #include <QVBoxLayout>
-#include <QLabel>
-#include <QTimer>
 
-Toast::Toast(const QString &text)
+static const int TOAST_DURATION_MS = 2000;	// 窗口显示的时间
+static const int TOAST_SPACING = 10;		// 多个窗口之间的间隔
+
+QList<Toast*> Toast::visibleToasts;
+QList<Toast*> Toast::idleToasts;
+
+Toast::Toast()
 {
     // 1. 设置窗口的基本参数
     this->setFixedSize(800, 150);
     this->setWindowTitle("消息通知");
     this->setWindowIcon(QIcon(":/resource/image/logo.png"));
-    this->setAttribute(Qt::WA_DeleteOnClose);
     this->setStyleSheet("QDialog { background-color: rgb(255, 255, 255); }");
     // 去掉窗口的标题栏
     this->setWindowFlags(Qt::FramelessWindowHint);
 
-    // 2. 先考虑一下窗口的位置.
-    // 获取到整个屏幕的尺寸, 通过 primaryScreen 来获取.
-    QScreen* screen = QApplication::primaryScreen();
-    int width = screen->size().width();
-    int height = screen->size().height();
-    int x = (width - this->width()) / 2;
-    int y = height - this->height() - 100;	// 此处的 100 是窗口底边距离屏幕底边的间隔
-    this->move(x, y);
-
-    // 3. 添加一个布局管理器
+    // 2. 添加一个布局管理器
     QVBoxLayout* layout = new QVBoxLayout();
     layout->setSpacing(0);
     layout->setContentsMargins(0, 0, 0, 0);
     this->setLayout(layout);
 
-    // 4. 创建显示文本的 Label
-    QLabel* label = new QLabel();
+    // 3. 创建显示文本的 Label
+    label = new QLabel();
     label->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
     label->setAlignment(Qt::AlignCenter);
     label->setStyleSheet("QLabel { font-size: 32px; }");
-    label->setText(text);
     layout->addWidget(label);
 
-    // 5. 实现 2s 之后自动关闭.
-    QTimer* timer = new QTimer(this);
-    connect(timer, &QTimer::timeout, this, [=]() {
-        timer->stop();
-        // 核心代码, 关闭当前窗口
-        this->close();
-    });
-    timer->start(2000);
+    // 4. 到时间之后自动关闭. 关闭只是隐藏, 窗口留着复用.
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, &Toast::dismiss);
 }
 
-void Toast::showMessage(const QString &text)
+void Toast::display(const QString &text)
 {
-    Toast* toast = new Toast(text);
-    toast->show();
+    label->setText(text);
+    visibleToasts.removeOne(this);
+    visibleToasts.push_back(this);
+    relayout();
+    this->show();
+    timer->start(TOAST_DURATION_MS);
 }
 
+void Toast::dismiss()
+{
+    timer->stop();
+    this->hide();
+    visibleToasts.removeOne(this);
+    idleToasts.push_back(this);
+    relayout();
+}
 
+void Toast::relayout()
+{
+    // 获取到整个屏幕的尺寸, 通过 primaryScreen 来获取.
+    QScreen* screen = QApplication::primaryScreen();
+    int width = screen->size().width();
+    int height = screen->size().height();
+    // 最新的窗口在最下面. 最下面的窗口底边距离屏幕底边 100.
+    int y = height - 100;
+    for (int i = visibleToasts.size() - 1; i >= 0; --i) {
+        Toast* toast = visibleToasts[i];
+        y -= toast->height();
+        toast->move((width - toast->width()) / 2, y);
+        y -= TOAST_SPACING;
+    }
+}
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+void Toast::showMessage(const QString &text)
+{
+    // 1. 相同内容的通知正在显示, 重新计时即可
+    for (Toast* toast : visibleToasts) {
+        if (toast->label->text() == text) {
+            toast->display(text);
+            return;
+        }
+    }
+
+    // 2. 找一个可以使用的窗口. 优先复用已经关闭的, 显示的数目达到上限时, 复用最早弹出的.
+    Toast* toast = nullptr;
+    if (!idleToasts.isEmpty()) {
+        toast = idleToasts.takeLast();
+    } else if (visibleToasts.size() >= MAX_VISIBLE) {
+        toast = visibleToasts.front();
+    } else {
+        toast = new Toast();
+    }
+    toast->display(text);
+}
@@ -3,16 +3,36 @@
 
 #include <QDialog>
 #include <QWidget>
+#include <QLabel>
+#include <QTimer>
+#include <QList>
 
 class Toast : public QDialog
 {
     Q_OBJECT
 public:
-    // 此处不需要指定父窗口. 全局通知的父窗口就是 桌面.
-    Toast(const QString& text);
-
     // 并不需要手动来 new 这个对象, 而是通过 showMessage 来弹出窗口
+    // 同时显示的窗口最多 MAX_VISIBLE 个, 超出时复用最早弹出的那个. 关闭的窗口不会销毁, 留着下次复用.
+    // 相同内容的通知正在显示时, 不会再弹出一个新的, 只是重新计时.
     static void showMessage(const QString& text);
+
+private:
+    static const int MAX_VISIBLE = 3;
+
+    // 此处不需要指定父窗口. 全局通知的父窗口就是 桌面.
+    Toast();
+
+    void display(const QString& text);
+    void dismiss();
+
+    // 根据显示的先后顺序, 从屏幕底部往上依次排列
+    static void relayout();
+
+    static QList<Toast*> visibleToasts;		// 正在显示的窗口, 按弹出的先后顺序
+    static QList<Toast*> idleToasts;		// 已经关闭, 可以复用的窗口
+
+    QLabel* label;
+    QTimer* timer;
 };
 
 #endif // TOAST_H
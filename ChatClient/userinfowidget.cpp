@@ -5,6 +5,7 @@
 
 #include "model/datacenter.h"
 #include "mainwidget.h"
+#include "avatarcache.h"
 
 using namespace model;
 
@@ -29,7 +30,7 @@ UserInfoWidget::UserInfoWidget(const UserInfo& userInfo, QWidget* parent)
     avatarBtn = new QPushButton();
     avatarBtn->setFixedSize(75, 75);
     avatarBtn->setIconSize(QSize(75, 75));
-    avatarBtn->setIcon(userInfo.avatar);
+    avatarBtn->setIcon(AvatarCache::getInstance()->icon(AvatarCache::userKey(userInfo.userId), userInfo.avatar, 75));
 
     QString labelStyle = "QLabel { font-weight: 800; padding-left: 20px;}";
     QString btnStyle = "QPushButton { border: 1px solid rgb(100, 100, 100); border-radius: 5px; background-color: rgb(240, 240, 240); }";
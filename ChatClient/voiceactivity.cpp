@@ -0,0 +1,315 @@
+#include "voiceactivity.h"
+
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QtMath>
+
+#include "model/data.h"
+
+#if defined(__AVX2__)
+#define VAD_USE_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VAD_USE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define VAD_USE_NEON 1
+#include <arm_neon.h>
+#endif
+
+static const int SAMPLE_RATE = 16000;
+static const int FRAME_SAMPLES = 320;				// 一帧 20ms
+static const int FRAME_BYTES = FRAME_SAMPLES * 2;
+static const int PREROLL_FRAMES = 5;				// 说话之前保留 100ms
+static const int HANGOVER_FRAMES = 10;				// 说话之后保留 200ms
+static const int MAX_PAUSE_FRAMES = 25;				// 压缩停顿时, 停顿最多再保留 500ms
+static const double MIN_ENERGY = 300.0 * 300.0;		// 能量的下限 (RMS 300). 再安静的环境, 低于这个都算静音
+static const double VOICE_RATIO = 6.0;				// 能量超过底噪的这么多倍, 认为是说话
+static const int MIN_STAT_FRAMES = 50;				// 最小能量按 1 秒一段统计
+static const double NOISE_RISE_RATE = 0.01;			// 说话帧上底噪向最小能量靠近的速度 (每帧)
+static const double ZCR_THRESHOLD = 0.25;			// 过零率超过这个值, 能量只需要达到 1/4 也认为是说话 (清辅音)
+
+////////////////////////////////////////////////////////
+/// 帧特征: 能量 (采样点的平方和) 和过零次数 (相邻两个采样点符号不同的次数)
+/// -32768 按 -32767 计算, 这样两个采样点的平方和不会超出 int32, 向量化版本可以直接使用 madd
+////////////////////////////////////////////////////////
+
+// 从 begin 开始, 用普通的循环计算剩下的部分
+static void frameFeaturesTail(const qint16* samples, int count, int energyBegin, int zcBegin,
+                              qint64* energy, int* zeroCrossings)
+{
+    for (int i = energyBegin; i < count; ++i) {
+        int s = qMax<int>(samples[i], -32767);
+        *energy += s * s;
+    }
+    for (int i = qMax(zcBegin, 1); i < count; ++i) {
+        if ((samples[i] ^ samples[i - 1]) < 0) {
+            ++*zeroCrossings;
+        }
+    }
+}
+
+static void frameFeaturesScalar(const qint16* samples, int count, qint64* energy, int* zeroCrossings)
+{
+    *energy = 0;
+    *zeroCrossings = 0;
+    frameFeaturesTail(samples, count, 0, 0, energy, zeroCrossings);
+}
+
+#if VAD_USE_AVX2
+static const char* KERNEL_NAME = "AVX2";
+
+static void frameFeaturesSimd(const qint16* samples, int count, qint64* energy, int* zeroCrossings)
+{
+    const __m256i minValue = _mm256_set1_epi16(-32767);
+    const __m256i zero = _mm256_setzero_si256();
+
+    // 1. 能量. madd 得到相邻两个采样点的平方和 (int32), 再扩展成 int64 累加
+    __m256i energyAcc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_max_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i)), minValue);
+        __m256i sq = _mm256_madd_epi16(v, v);
+        energyAcc = _mm256_add_epi64(energyAcc, _mm256_unpacklo_epi32(sq, zero));
+        energyAcc = _mm256_add_epi64(energyAcc, _mm256_unpackhi_epi32(sq, zero));
+    }
+
+    // 2. 过零次数. 和错开一个位置的数据异或, 符号位为 1 说明符号不同, 算术右移得到 -1
+    __m256i zcAcc = _mm256_setzero_si256();
+    int j = 1;
+    for (; j + 16 <= count; j += 16) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + j));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + j - 1));
+        zcAcc = _mm256_sub_epi16(zcAcc, _mm256_srai_epi16(_mm256_xor_si256(a, b), 15));
+    }
+
+    alignas(32) qint64 energyLanes[4];
+    alignas(32) qint16 zcLanes[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(energyLanes), energyAcc);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(zcLanes), zcAcc);
+    *energy = energyLanes[0] + energyLanes[1] + energyLanes[2] + energyLanes[3];
+    *zeroCrossings = 0;
+    for (qint16 lane : zcLanes) {
+        *zeroCrossings += lane;
+    }
+    frameFeaturesTail(samples, count, i, j, energy, zeroCrossings);
+}
+#elif VAD_USE_SSE2
+static const char* KERNEL_NAME = "SSE2";
+
+static void frameFeaturesSimd(const qint16* samples, int count, qint64* energy, int* zeroCrossings)
+{
+    const __m128i minValue = _mm_set1_epi16(-32767);
+    const __m128i zero = _mm_setzero_si128();
+
+    // 1. 能量. madd 得到相邻两个采样点的平方和 (int32), 再扩展成 int64 累加
+    __m128i energyAcc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)), minValue);
+        __m128i sq = _mm_madd_epi16(v, v);
+        energyAcc = _mm_add_epi64(energyAcc, _mm_unpacklo_epi32(sq, zero));
+        energyAcc = _mm_add_epi64(energyAcc, _mm_unpackhi_epi32(sq, zero));
+    }
+
+    // 2. 过零次数. 和错开一个位置的数据异或, 符号位为 1 说明符号不同, 算术右移得到 -1
+    __m128i zcAcc = _mm_setzero_si128();
+    int j = 1;
+    for (; j + 8 <= count; j += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + j));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + j - 1));
+        zcAcc = _mm_sub_epi16(zcAcc, _mm_srai_epi16(_mm_xor_si128(a, b), 15));
+    }
+
+    alignas(16) qint64 energyLanes[2];
+    alignas(16) qint16 zcLanes[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(energyLanes), energyAcc);
+    _mm_store_si128(reinterpret_cast<__m128i*>(zcLanes), zcAcc);
+    *energy = energyLanes[0] + energyLanes[1];
+    *zeroCrossings = 0;
+    for (qint16 lane : zcLanes) {
+        *zeroCrossings += lane;
+    }
+    frameFeaturesTail(samples, count, i, j, energy, zeroCrossings);
+}
+#elif VAD_USE_NEON
+static const char* KERNEL_NAME = "NEON";
+
+static void frameFeaturesSimd(const qint16* samples, int count, qint64* energy, int* zeroCrossings)
+{
+    const int16x8_t minValue = vdupq_n_s16(-32767);
+
+    // 1. 能量. 平方扩展成 int32, 再两两相加扩展成 int64 累加
+    int64x2_t energyAcc = vdupq_n_s64(0);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vmaxq_s16(vld1q_s16(samples + i), minValue);
+        energyAcc = vpadalq_s32(energyAcc, vmull_s16(vget_low_s16(v), vget_low_s16(v)));
+        energyAcc = vpadalq_s32(energyAcc, vmull_s16(vget_high_s16(v), vget_high_s16(v)));
+    }
+
+    // 2. 过零次数. 和错开一个位置的数据异或, 符号位为 1 说明符号不同, 算术右移得到 -1
+    int16x8_t zcAcc = vdupq_n_s16(0);
+    int j = 1;
+    for (; j + 8 <= count; j += 8) {
+        int16x8_t a = vld1q_s16(samples + j);
+        int16x8_t b = vld1q_s16(samples + j - 1);
+        zcAcc = vsubq_s16(zcAcc, vshrq_n_s16(veorq_s16(a, b), 15));
+    }
+
+    qint16 zcLanes[8];
+    vst1q_s16(zcLanes, zcAcc);
+    *energy = vgetq_lane_s64(energyAcc, 0) + vgetq_lane_s64(energyAcc, 1);
+    *zeroCrossings = 0;
+    for (qint16 lane : zcLanes) {
+        *zeroCrossings += lane;
+    }
+    frameFeaturesTail(samples, count, i, j, energy, zeroCrossings);
+}
+#else
+static const char* KERNEL_NAME = "scalar";
+
+static void frameFeaturesSimd(const qint16* samples, int count, qint64* energy, int* zeroCrossings)
+{
+    frameFeaturesScalar(samples, count, energy, zeroCrossings);
+}
+#endif
+
+////////////////////////////////////////////////////////
+/// 语音活动检测
+////////////////////////////////////////////////////////
+
+void VoiceActivityDetector::reset()
+{
+    pendingFrame.clear();
+    pendingSilence.clear();
+    noiseFloor = 0;
+    blockMinEnergy = -1;
+    prevBlockMinEnergy = -1;
+    blockFrames = 0;
+    hangoverFrames = 0;
+    voiceStarted = false;
+}
+
+QByteArray VoiceActivityDetector::process(const QByteArray &pcm)
+{
+    QByteArray output;
+    pendingFrame.append(pcm);
+    qsizetype offset = 0;
+    for (; offset + FRAME_BYTES <= pendingFrame.size(); offset += FRAME_BYTES) {
+        processFrame(reinterpret_cast<const qint16*>(pendingFrame.constData() + offset), &output);
+    }
+    pendingFrame.remove(0, offset);
+    return output;
+}
+
+void VoiceActivityDetector::processFrame(const qint16 *samples, QByteArray *output)
+{
+    qint64 energy = 0;
+    int zeroCrossings = 0;
+    frameFeaturesSimd(samples, FRAME_SAMPLES, &energy, &zeroCrossings);
+
+    // 1. 说话, 或者刚说完话不久, 之前积攒的停顿和这一帧一起输出
+    bool voice = isVoiceFrame(energy, zeroCrossings);
+    bool keep = voice || hangoverFrames > 0;
+    hangoverFrames = voice ? HANGOVER_FRAMES : qMax(0, hangoverFrames - 1);
+    if (keep) {
+        voiceStarted = true;
+        output->append(pendingSilence);
+        pendingSilence.clear();
+        output->append(reinterpret_cast<const char*>(samples), FRAME_BYTES);
+        return;
+    }
+
+    // 2. 静音先存起来. 还没开始说话时只保留最近的 100ms, 压缩停顿时只保留最近的 500ms
+    pendingSilence.append(reinterpret_cast<const char*>(samples), FRAME_BYTES);
+    int maxFrames = !voiceStarted ? PREROLL_FRAMES : (compressPauses ? MAX_PAUSE_FRAMES : -1);
+    if (maxFrames >= 0 && pendingSilence.size() > maxFrames * FRAME_BYTES) {
+        pendingSilence.remove(0, pendingSilence.size() - maxFrames * FRAME_BYTES);
+    }
+}
+
+bool VoiceActivityDetector::isVoiceFrame(qint64 energy, int zeroCrossings)
+{
+    double meanEnergy = (double)energy / FRAME_SAMPLES;
+    double zcr = (double)zeroCrossings / (FRAME_SAMPLES - 1);
+
+    // 1. 最近 1~2 秒内的最小能量. 说话中总有字与字之间的间隙, 最小值接近背景噪声.
+    if (blockMinEnergy < 0 || meanEnergy < blockMinEnergy) {
+        blockMinEnergy = meanEnergy;
+    }
+    double minEnergy = prevBlockMinEnergy < 0 ? blockMinEnergy : qMin(prevBlockMinEnergy, blockMinEnergy);
+    if (++blockFrames >= MIN_STAT_FRAMES) {
+        prevBlockMinEnergy = blockMinEnergy;
+        blockMinEnergy = -1;
+        blockFrames = 0;
+    }
+
+    // 2. 判断是否是说话
+    double threshold = qMax(MIN_ENERGY, noiseFloor * VOICE_RATIO);
+    bool voice = meanEnergy > threshold || (meanEnergy > threshold / 4 && zcr > ZCR_THRESHOLD);
+
+    // 3. 更新底噪
+    if (!voice) {
+        // 静音帧. 变安静时立即跟上, 变吵时缓慢跟上
+        noiseFloor = meanEnergy < noiseFloor ? meanEnergy : noiseFloor * 0.95 + meanEnergy * 0.05;
+    } else if (minEnergy > noiseFloor) {
+        // 说话帧. 背景噪声很大时所有的帧都会被当成说话, 静音帧上的更新永远不会发生.
+        // 这里让底噪缓慢地向最小能量靠近, 持续的噪声过一会就会被当成静音.
+        noiseFloor += (minEnergy - noiseFloor) * NOISE_RISE_RATE;
+    }
+    return voice;
+}
+
+void VoiceActivityDetector::runBenchmark()
+{
+    // 1. 生成 10 分钟的测试录音: 底噪 + 每 3 秒中说 2 秒话 (两个正弦波叠加)
+    const int SECONDS = 600;
+    const int sampleCount = SECONDS * SAMPLE_RATE;
+    QByteArray pcm(sampleCount * 2, Qt::Uninitialized);
+    qint16* samples = reinterpret_cast<qint16*>(pcm.data());
+    QRandomGenerator random(42);
+    for (int i = 0; i < sampleCount; ++i) {
+        double t = (double)i / SAMPLE_RATE;
+        double value = random.bounded(400) - 200;
+        if ((i / SAMPLE_RATE) % 3 != 0) {
+            value += 6000 * qSin(2 * M_PI * 220 * t) + 3000 * qSin(2 * M_PI * 1250 * t);
+        }
+        samples[i] = qBound(-32768, qRound(value), 32767);
+    }
+    const int frameCount = sampleCount / FRAME_SAMPLES;
+
+    // 2. 帧特征计算: 向量化 vs 普通循环. 结果累加起来, 也顺便核对两者一致
+    auto measure = [&](void (*kernel)(const qint16*, int, qint64*, int*), qint64* checksum) {
+        QElapsedTimer timer;
+        timer.start();
+        *checksum = 0;
+        for (int f = 0; f < frameCount; ++f) {
+            qint64 energy = 0;
+            int zeroCrossings = 0;
+            kernel(samples + f * FRAME_SAMPLES, FRAME_SAMPLES, &energy, &zeroCrossings);
+            *checksum += energy + zeroCrossings;
+        }
+        return timer.nsecsElapsed() / 1000000.0;
+    };
+    qint64 scalarChecksum = 0;
+    qint64 simdChecksum = 0;
+    measure(frameFeaturesSimd, &simdChecksum);		// 先预热一次
+    double scalarMs = measure(frameFeaturesScalar, &scalarChecksum);
+    double simdMs = measure(frameFeaturesSimd, &simdChecksum);
+    LOG() << "[VAD测试]" << SECONDS << "秒录音," << frameCount << "帧. 普通循环:" << scalarMs << "ms,"
+          << KERNEL_NAME << ":" << simdMs << "ms, 结果一致:" << (scalarChecksum == simdChecksum);
+
+    // 3. 整个处理流程 (按 100ms 一次输入, 和录制时一样)
+    VoiceActivityDetector detector;
+    detector.reset();
+    QElapsedTimer timer;
+    timer.start();
+    qsizetype outputBytes = 0;
+    const int chunkBytes = SAMPLE_RATE * 2 / 10;
+    for (qsizetype offset = 0; offset < pcm.size(); offset += chunkBytes) {
+        outputBytes += detector.process(pcm.mid(offset, chunkBytes)).size();
+    }
+    LOG() << "[VAD测试] 完整处理耗时" << timer.nsecsElapsed() / 1000000.0 << "ms, 去掉静音之后"
+          << (double)outputBytes / (SAMPLE_RATE * 2) << "秒 / 原始" << SECONDS << "秒";
+}
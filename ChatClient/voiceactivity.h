@@ -0,0 +1,49 @@
+#ifndef VOICEACTIVITY_H
+#define VOICEACTIVITY_H
+
+#include <QByteArray>
+
+////////////////////////////////////////////////////////
+/// 语音活动检测 (VAD), 用来去掉录音中的静音
+/// 按 20ms 一帧计算能量和过零率, 能量明显高于底噪, 或者能量稍高且过零率高 (清辅音) 的帧认为是说话.
+/// 底噪在静音帧上更新, 同时参考最近一两秒内的最小能量, 持续的背景噪声比较大时也能跟上.
+/// 1. 开头的静音去掉, 只保留说话前的 100ms
+/// 2. 末尾的静音去掉, 只保留说话后的 200ms
+/// 3. 中间过长的停顿压缩到 700ms (说话之后保留的 200ms + 500ms), 可以关闭
+/// 录制过程中边录边处理. 停顿中的数据要等到继续说话才会输出, 所以输出会比输入稍晚一些.
+/// 能量和过零率的计算根据编译目标使用 AVX2 / SSE2 / NEON, 都不支持时使用普通的循环.
+////////////////////////////////////////////////////////
+class VoiceActivityDetector
+{
+public:
+    // 开始新的一段录音
+    void reset();
+    // 输入录制到的 PCM (16000Hz 单声道 Int16), 返回去掉静音之后可以输出的部分
+    QByteArray process(const QByteArray& pcm);
+    // 是否检测到过说话. 一直没有说话, 说明这段录音没有内容.
+    bool hasVoice() const { return voiceStarted; }
+
+    // 是否压缩中间的长停顿. 默认压缩.
+    void setCompressPauses(bool compress) { compressPauses = compress; }
+
+    // 测量帧特征计算在长录音上的耗时 (向量化 vs 普通循环), 结果输出到日志
+    static void runBenchmark();
+
+private:
+    // 处理一个完整的帧, 可以输出的数据追加到 output 中
+    void processFrame(const qint16* samples, QByteArray* output);
+    // 判断一帧是否是说话
+    bool isVoiceFrame(qint64 energy, int zeroCrossings);
+
+    QByteArray pendingFrame;		// 还不满一帧的数据
+    QByteArray pendingSilence;		// 静音中的数据, 继续说话时才输出
+    double noiseFloor = 0;			// 底噪的平均能量 (每个采样点), 根据静音帧和最小能量不断更新
+    double blockMinEnergy = -1;		// 当前这一段 (1 秒) 中每帧平均能量的最小值, -1 表示还没有帧
+    double prevBlockMinEnergy = -1;	// 上一段的最小值
+    int blockFrames = 0;			// 当前这一段已经统计的帧数
+    int hangoverFrames = 0;			// 说话结束之后, 还要继续保留的帧数
+    bool voiceStarted = false;
+    bool compressPauses = true;
+};
+
+#endif // VOICEACTIVITY_H
@@ -9,6 +9,7 @@
 #include "message_transmit.qpb.h"
 #include "speech_recognition.qpb.h"
 #include "notify.qpb.h"
+#include "sync.qpb.h"
 
 #include <QDateTime>
 #include <QDebug>
@@ -107,6 +108,81 @@ bite_im::MessageInfo makeSpeechMessageInfo(int index, const QString& chatSession
     return messageInfo;
 }
 
+// 生成历史消息查询结果中的一页. 总共 total 条结果, 每 10 条里有一条图片消息, 一条文件消息, 一条语音消息.
+// pageSize 为 0 时不分页, 返回所有结果.
+QList<bite_im::MessageInfo> makeHistoryPage(int total, int pageOffset, int pageSize, const QString& chatSessionId,
+                                            const QByteArray& avatar, bool* hasMore) {
+    int end = pageSize > 0 ? qMin(total, pageOffset + pageSize) : total;
+    QList<bite_im::MessageInfo> msgList;
+    for (int i = qMax(0, pageOffset); i < end; ++i) {
+        if (i % 10 == 7) {
+            msgList.push_back(makeImageMessageInfo(i, chatSessionId, avatar));
+        } else if (i % 10 == 8) {
+            msgList.push_back(makeFileMessageInfo(i, chatSessionId, avatar));
+        } else if (i % 10 == 9) {
+            msgList.push_back(makeSpeechMessageInfo(i, chatSessionId, avatar));
+        } else {
+            msgList.push_back(makeTextMessageInfo(i, chatSessionId, avatar));
+        }
+    }
+    *hasMore = end < total;
+    return msgList;
+}
+
+// 以下几个函数生成当前用户的个人信息 / 好友列表 / 会话列表 / 好友申请列表.
+// 启动数据接口和各个单独的接口都通过它们构造数据, 保证两边返回的内容一致.
+bite_im::UserInfo makeMyselfInfo(const QByteArray& groupAvatar) {
+    bite_im::UserInfo userInfo;
+    userInfo.setUserId("1029");    // 调整自己的用户 id, 和返回的消息列表的内容匹配上
+    userInfo.setNickname("张三");
+    userInfo.setDescription("这是个性签名");
+    userInfo.setPhone("18612345678");
+    userInfo.setAvatar(groupAvatar);
+    return userInfo;
+}
+
+QList<bite_im::UserInfo> makeFriendList(const QByteArray& avatar) {
+    QList<bite_im::UserInfo> friendList;
+    for (int i = 0; i < 20; ++i) {
+        friendList.push_back(makeUserInfo(i, avatar));
+    }
+    return friendList;
+}
+
+// 若干个单聊会话 + 一个群聊会话
+QList<bite_im::ChatSessionInfo> makeChatSessionList(const QByteArray& avatar, const QByteArray& groupAvatar) {
+    QList<bite_im::ChatSessionInfo> chatSessionList;
+    for (int i = 0; i < 30; ++i) {
+        bite_im::ChatSessionInfo chatSessionInfo;
+        chatSessionInfo.setChatSessionId(QString::number(2000 + i));
+        chatSessionInfo.setChatSessionName("会话" + QString::number(i));
+        chatSessionInfo.setSingleChatFriendId(QString::number(1000 + i));
+        chatSessionInfo.setAvatar(avatar);
+        chatSessionInfo.setPrevMessage(makeTextMessageInfo(i, chatSessionInfo.chatSessionId(), avatar));
+        chatSessionList.push_back(chatSessionInfo);
+    }
+
+    bite_im::ChatSessionInfo groupSessionInfo;
+    groupSessionInfo.setChatSessionId(QString::number(2100));
+    groupSessionInfo.setChatSessionName("会话" + QString::number(2100));
+    groupSessionInfo.setSingleChatFriendId("");
+    groupSessionInfo.setAvatar(groupAvatar);
+    groupSessionInfo.setPrevMessage(makeTextMessageInfo(0, groupSessionInfo.chatSessionId(), avatar));
+    chatSessionList.push_back(groupSessionInfo);
+    return chatSessionList;
+}
+
+QList<bite_im::FriendEvent> makeApplyList(const QByteArray& avatar) {
+    QList<bite_im::FriendEvent> applyList;
+    for (int i = 0; i < 5; ++i) {
+        bite_im::FriendEvent friendEvent;
+        friendEvent.setEventId("");	// 此处不再使用这个 eventId, 直接设为 ""
+        friendEvent.setSender(makeUserInfo(i, avatar));
+        applyList.push_back(friendEvent);
+    }
+    return applyList;
+}
+
 //////////////////////////////////////////////////////////////////
 /// HTTP 服务器
 //////////////////////////////////////////////////////////////////
@@ -133,6 +209,10 @@ bool HttpServer::init()
         return "pong";
     });
 
+    httpServer.route("/service/sync/bootstrap", [=](const QHttpServerRequest& req) {
+        return this->syncBootstrap(req);
+    });
+
     httpServer.route("/service/user/get_user_info", [=](const QHttpServerRequest& req) {
         return this->getUserInfo(req);
     });
@@ -229,13 +309,51 @@ bool HttpServer::init()
         return this->getSingleFile(req);
     });
 
+    httpServer.route("/service/file/put_chunk", [=](const QHttpServerRequest& req) {
+        return this->putFileChunk(req);
+    });
+
     httpServer.route("/service/speech/recognition", [=](const QHttpServerRequest& req) {
         return this->recognition(req);
     });
 
+    httpServer.route("/service/speech/recognition_chunk", [=](const QHttpServerRequest& req) {
+        return this->recognitionChunk(req);
+    });
+
     return ret == 8000;
 }
 
+QHttpServerResponse HttpServer::syncBootstrap(const QHttpServerRequest &req)
+{
+    // 解析请求
+    bite_im::SyncBootstrapReq pbReq;
+    pbReq.deserialize(&serializer, req.body());
+    LOG() << "[REQ 获取启动数据] requestId=" << pbReq.requestId() << ", loginSessionId=" << pbReq.sessionId();
+
+    // 构造响应. 内容和 getUserInfo / getFriendList / getChatSessionList / getApplyList 分别返回的一致
+    bite_im::SyncBootstrapRsp pbResp;
+    pbResp.setRequestId(pbReq.requestId());
+    pbResp.setSuccess(true);
+    pbResp.setErrmsg("");
+
+    QByteArray avatar = loadFileToByteArray(":/resource/image/defaultAvatar.png");
+    QByteArray groupAvatar = loadFileToByteArray(":/resource/image/groupAvatar.png");
+
+    pbResp.setUserInfo(makeMyselfInfo(groupAvatar));
+    pbResp.setFriendList(makeFriendList(avatar));
+    pbResp.setChatSessionInfoList(makeChatSessionList(avatar, groupAvatar));
+    pbResp.setEvent(makeApplyList(avatar));
+
+    // 序列化
+    QByteArray body = pbResp.serialize(&serializer);
+
+    // 构造 HTTP 响应对象
+    QHttpServerResponse httpResp(body, QHttpServerResponse::StatusCode::Ok);
+    httpResp.setHeader("Content-Type", "application/x-protobuf");
+    return httpResp;
+}
+
 QHttpServerResponse HttpServer::getUserInfo(const QHttpServerRequest &req)
 {
     // 解析请求, 把 req 的 body 取出来, 并且通过 pb 进行反序列化
@@ -249,13 +367,7 @@ QHttpServerResponse HttpServer::getUserInfo(const QHttpServerRequest &req)
     pbResp.setSuccess(true);
     pbResp.setErrmsg("");
 
-    bite_im::UserInfo userInfo;
-    userInfo.setUserId("1029");    // 调整自己的用户 id, 和返回的消息列表的内容匹配上
-    userInfo.setNickname("张三");
-    userInfo.setDescription("这是个性签名");
-    userInfo.setPhone("18612345678");
-    userInfo.setAvatar(loadFileToByteArray(":/resource/image/groupAvatar.png"));
-    pbResp.setUserInfo(userInfo);
+    pbResp.setUserInfo(makeMyselfInfo(loadFileToByteArray(":/resource/image/groupAvatar.png")));
 
     QByteArray body = pbResp.serialize(&serializer);
 
@@ -281,10 +393,7 @@ QHttpServerResponse HttpServer::getFriendList(const QHttpServerRequest &req)
     // 从文件读取数据操作, 其实是比较耗时的. (读取硬盘)
     // 耗时操作如果放在循环内部, 就会使整个的响应处理时间, 更长.
     QByteArray avatar = loadFileToByteArray(":/resource/image/defaultAvatar.png");
-    for (int i = 0; i < 20; ++i) {
-        bite_im::UserInfo userInfo = makeUserInfo(i, avatar);
-        pbRsp.friendList().push_back(userInfo);
-    }
+    pbRsp.setFriendList(makeFriendList(avatar));
 
     // 进行序列化
     QByteArray body = pbRsp.serialize(&serializer);
@@ -309,31 +418,8 @@ QHttpServerResponse HttpServer::getChatSessionList(const QHttpServerRequest &req
     pbRsp.setErrmsg("");
 
     QByteArray avatar = loadFileToByteArray(":/resource/image/defaultAvatar.png");
-
-    // 构造若干个单聊会话
-    for (int i = 0; i < 30; ++i) {
-        bite_im::ChatSessionInfo chatSessionInfo;
-        chatSessionInfo.setChatSessionId(QString::number(2000 + i));
-        chatSessionInfo.setChatSessionName("会话" + QString::number(i));
-        chatSessionInfo.setSingleChatFriendId(QString::number(1000 + i));
-        chatSessionInfo.setAvatar(avatar);
-        bite_im::MessageInfo messageInfo = makeTextMessageInfo(i, chatSessionInfo.chatSessionId(), avatar);
-
-        chatSessionInfo.setPrevMessage(messageInfo);
-
-        pbRsp.chatSessionInfoList().push_back(chatSessionInfo);
-    }
-
-    // 构造一个群聊会话
     QByteArray groupAvatar = loadFileToByteArray(":/resource/image/groupAvatar.png");
-    bite_im::ChatSessionInfo chatSessionInfo;
-    chatSessionInfo.setChatSessionId(QString::number(2100));
-    chatSessionInfo.setChatSessionName("会话" + QString::number(2100));
-    chatSessionInfo.setSingleChatFriendId("");
-    chatSessionInfo.setAvatar(groupAvatar);
-    bite_im::MessageInfo messageInfo = makeTextMessageInfo(0, chatSessionInfo.chatSessionId(), avatar);
-    chatSessionInfo.setPrevMessage(messageInfo);
-    pbRsp.chatSessionInfoList().push_back(chatSessionInfo);
+    pbRsp.setChatSessionInfoList(makeChatSessionList(avatar, groupAvatar));
 
     // 序列化响应
     QByteArray body = pbRsp.serialize(&serializer);
@@ -355,15 +441,8 @@ QHttpServerResponse HttpServer::getApplyList(const QHttpServerRequest& req) {
     pbResp.setSuccess(true);
     pbResp.setErrmsg("");
 
-    // 循环构造出 event 对象, 构造出整个结果数组
     QByteArray avatar = loadFileToByteArray(":/resource/image/defaultAvatar.png");
-    for (int i = 0; i < 5; ++i) {
-        bite_im::FriendEvent friendEvent;
-        friendEvent.setEventId("");	// 此处不再使用这个 eventId, 直接设为 ""
-        friendEvent.setSender(makeUserInfo(i, avatar));
-
-        pbResp.event().push_back(friendEvent);
-    }
+    pbResp.setEvent(makeApplyList(avatar));
 
     // 序列化成字节数组
     QByteArray body = pbResp.serialize(&serializer);
@@ -682,7 +761,8 @@ QHttpServerResponse HttpServer::searchHistory(const QHttpServerRequest &req)
     bite_im::MsgSearchReq pbReq;
     pbReq.deserialize(&serializer, req.body());
     LOG() << "[REQ 搜索历史消息] requestId=" << pbReq.requestId() << ", loginSessionId=" << pbReq.sessionId()
-          << ", chatSessionId=" << pbReq.chatSessionId() << ", searchKey=" << pbReq.searchKey();
+          << ", chatSessionId=" << pbReq.chatSessionId() << ", searchKey=" << pbReq.searchKey()
+          << ", pageOffset=" << pbReq.pageOffset() << ", pageSize=" << pbReq.pageSize();
 
     // 构造响应 body
     bite_im::MsgSearchRsp pbResp;
@@ -690,20 +770,11 @@ QHttpServerResponse HttpServer::searchHistory(const QHttpServerRequest &req)
     pbResp.setSuccess(true);
     pbResp.setErrmsg("");
 
+    // 模拟总共有 200 条搜索结果, 按照请求的分页返回
     QByteArray avatar = loadFileToByteArray(":/resource/image/defaultAvatar.png");
-    for (int i = 0; i < 10; ++i) {
-        bite_im::MessageInfo message = makeTextMessageInfo(i, pbReq.chatSessionId(), avatar);
-        pbResp.msgList().push_back(message);
-    }
-    // 构造图片消息
-    bite_im::MessageInfo message = makeImageMessageInfo(10, pbReq.chatSessionId(), avatar);
-    pbResp.msgList().push_back(message);
-    // 构造文件消息
-    message = makeFileMessageInfo(11, pbReq.chatSessionId(), avatar);
-    pbResp.msgList().push_back(message);
-    // 构造语音消息
-    message = makeSpeechMessageInfo(12, pbReq.chatSessionId(), avatar);
-    pbResp.msgList().push_back(message);
+    bool hasMore = false;
+    pbResp.setMsgList(makeHistoryPage(200, pbReq.pageOffset(), pbReq.pageSize(), pbReq.chatSessionId(), avatar, &hasMore));
+    pbResp.setHasMore(hasMore);
 
     QByteArray body = pbResp.serialize(&serializer);
 
@@ -718,7 +789,8 @@ QHttpServerResponse HttpServer::getHistory(const QHttpServerRequest& req) {
     bite_im::GetHistoryMsgReq pbReq;
     pbReq.deserialize(&serializer, req.body());
     LOG() << "[REQ 按时间搜索历史消息] requestId=" << pbReq.requestId() << ", loginSessionId=" << pbReq.sessionId()
-          << ", chatSessionId=" << pbReq.chatSessionId() << ", begTime=" << pbReq.startTime() << ", endTime=" << pbReq.overTime();
+          << ", chatSessionId=" << pbReq.chatSessionId() << ", begTime=" << pbReq.startTime() << ", endTime=" << pbReq.overTime()
+          << ", pageOffset=" << pbReq.pageOffset() << ", pageSize=" << pbReq.pageSize();
 
     // 构造响应
     bite_im::GetHistoryMsgRsp pbResp;
@@ -726,11 +798,11 @@ QHttpServerResponse HttpServer::getHistory(const QHttpServerRequest& req) {
     pbResp.setSuccess(true);
     pbResp.setErrmsg("");
 
+    // 模拟这段时间内总共有 100 条消息, 按照请求的分页返回
     QByteArray avatar = loadFileToByteArray(":/resource/image/defaultAvatar.png");
-    for (int i = 0; i < 10; ++i) {
-        bite_im::MessageInfo message = makeTextMessageInfo(i, pbReq.chatSessionId(), avatar);
-        pbResp.msgList().push_back(message);
-    }
+    bool hasMore = false;
+    pbResp.setMsgList(makeHistoryPage(100, pbReq.pageOffset(), pbReq.pageSize(), pbReq.chatSessionId(), avatar, &hasMore));
+    pbResp.setHasMore(hasMore);
     QByteArray body = pbResp.serialize(&serializer);
 
     // 构造 HTTP 响应
@@ -848,6 +920,9 @@ QHttpServerResponse HttpServer::getSingleFile(const QHttpServerRequest &req)
     } else if (pbReq.fileId() == "testSpeech") {
         // 由于此处暂时还没有音频文件. 得后面写了 录音功能 才能生成.
         fileDownloadData.setFileContent(loadFileToByteArray(":/resource/file/speech.pcm"));
+    } else if (uploadedFiles.contains(pbReq.fileId())) {
+        // 通过分片上传的文件
+        fileDownloadData.setFileContent(uploadedFiles.value(pbReq.fileId()));
     } else {
         pbResp.setSuccess(false);
         pbResp.setErrmsg("fileId 不是预期的测试 fileId");
@@ -862,6 +937,43 @@ QHttpServerResponse HttpServer::getSingleFile(const QHttpServerRequest &req)
     return resp;
 }
 
+QHttpServerResponse HttpServer::putFileChunk(const QHttpServerRequest &req)
+{
+    // 解析请求
+    bite_im::PutFileChunkReq pbReq;
+    pbReq.deserialize(&serializer, req.body());
+    LOG() << "[REQ 分片上传文件] requestId=" << pbReq.requestId() << ", uploadId=" << pbReq.uploadId()
+          << ", offset=" << pbReq.offset() << ", size=" << pbReq.chunk().size() << ", last=" << pbReq.last();
+
+    // 构造响应
+    bite_im::PutFileChunkRsp pbResp;
+    pbResp.setRequestId(pbReq.requestId());
+    pbResp.setSuccess(true);
+    pbResp.setErrmsg("");
+
+    // 把分片写到对应的偏移上. 客户端是按顺序上传的, 偏移和已经收到的长度不一致说明中间丢了分片.
+    QByteArray& content = chunkUploads[pbReq.uploadId()];
+    if (pbReq.offset() != content.size()) {
+        pbResp.setSuccess(false);
+        pbResp.setErrmsg("分片的偏移不正确");
+        chunkUploads.remove(pbReq.uploadId());
+    } else {
+        content.append(pbReq.chunk());
+        if (pbReq.last()) {
+            QString fileId = "uploadedFile" + QString::number(uploadedFileIndex++);
+            uploadedFiles[fileId] = chunkUploads.take(pbReq.uploadId());
+            pbResp.setFileId(fileId);
+            LOG() << "分片上传完毕 fileId=" << fileId << ", size=" << uploadedFiles[fileId].size();
+        }
+    }
+    QByteArray body = pbResp.serialize(&serializer);
+
+    // 构造 HTTP 响应
+    QHttpServerResponse resp(body, QHttpServerResponse::StatusCode::Ok);
+    resp.setHeader("Content-Type", "application/x-protobuf");
+    return resp;
+}
+
 QHttpServerResponse HttpServer::recognition(const QHttpServerRequest &req)
 {
     // 解析请求 body
@@ -883,6 +995,58 @@ QHttpServerResponse HttpServer::recognition(const QHttpServerRequest &req)
     return resp;
 }
 
+QHttpServerResponse HttpServer::recognitionChunk(const QHttpServerRequest &req)
+{
+    // 解析请求 body
+    bite_im::SpeechRecognitionChunkReq pbReq;
+    pbReq.deserialize(&serializer, req.body());
+    LOG() << "[REQ 流式语音转文字] requestId=" << pbReq.requestId() << ", streamId=" << pbReq.streamId()
+          << ", offset=" << pbReq.offset() << ", size=" << pbReq.speechChunk().size() << ", last=" << pbReq.last()
+          << ", fileId=" << pbReq.fileId();
+
+    // 构造响应 body
+    bite_im::SpeechRecognitionChunkRsp pbResp;
+    pbResp.setRequestId(pbReq.requestId());
+    pbResp.setSuccess(true);
+    pbResp.setErrmsg("");
+
+    // 模拟边收边识别: 语音每 2000 字节 (压缩后的语音约 0.25 秒) 识别出一个字, 识别到语音末尾时返回完整的结果.
+    // 客户端会同时发送多个分片, 这里按分片的偏移计算, 不依赖分片到达的顺序.
+    const QString fullResult = "你好你好, 这是一段语音消息, 你好你好, 这是一段语音消息";
+    const QString fileId = pbReq.fileId();
+    qint64 received = 0;
+    bool isFinal = false;
+    if (fileId.isEmpty()) {
+        // 请求中直接带着语音分片
+        received = pbReq.offset() + pbReq.speechChunk().size();
+        isFinal = pbReq.last();
+    } else if (recognitionCache.contains(fileId)) {
+        // 识别过的文件, 第一次请求就直接返回缓存的结果
+        LOG() << "命中识别结果缓存 fileId=" << fileId;
+        isFinal = true;
+    } else if (fileId == "testSpeech" || uploadedFiles.contains(fileId)) {
+        // 服务器上保存的文件, 每次读取其中的一段进行识别
+        qint64 fileSize = fileId == "testSpeech" ? loadFileToByteArray(":/resource/file/speech.pcm").size()
+                                                 : uploadedFiles.value(fileId).size();
+        received = qMin(fileSize, pbReq.offset() + pbReq.chunkSize());
+        isFinal = received >= fileSize;
+        if (isFinal) {
+            recognitionCache[fileId] = fullResult;
+        }
+    } else {
+        pbResp.setSuccess(false);
+        pbResp.setErrmsg("语音文件不存在");
+    }
+    pbResp.setPartialResult(isFinal ? fullResult : fullResult.left(received / 2000));
+    pbResp.setIsFinal(isFinal);
+    QByteArray body = pbResp.serialize(&serializer);
+
+    // 构造 HTTP 响应
+    QHttpServerResponse resp(body, QHttpServerResponse::StatusCode::Ok);
+    resp.setHeader("Content-type", "application/x-protobuf");
+    return resp;
+}
+
 //////////////////////////////////////////////////////////////////
 /// Websocket 服务器
 //////////////////////////////////////////////////////////////////
@@ -9,6 +9,7 @@
 #include <QFile>
 #include <QPixmap>
 #include <QIcon>
+#include <QHash>
 
 //////////////////////////////////////////////////////
 /// 工具函数. 后续很多模块可能都要用到
@@ -89,12 +90,22 @@ private:
     QHttpServer httpServer;
     QProtobufSerializer serializer;
 
+    // 分片上传中的文件 (uploadId => 已经收到的内容), 以及上传完毕的文件 (fileId => 内容)
+    QHash<QString, QByteArray> chunkUploads;
+    QHash<QString, QByteArray> uploadedFiles;
+    int uploadedFileIndex = 0;
+
+    // 已经识别过的语音文件 (fileId => 识别结果). 同一个文件再次识别时直接返回
+    QHash<QString, QString> recognitionCache;
+
 public:
     static HttpServer* getInstance();
 
     // 通过这个函数, 针对 HTTP Server 进行初始化 (绑定端口, 配置路由....)
     bool init();
 
+    // 获取启动所需的全部数据 (聚合接口)
+    QHttpServerResponse syncBootstrap(const QHttpServerRequest& req);
     // 获取个人用户信息
     QHttpServerResponse getUserInfo(const QHttpServerRequest& req);
     // 获取好友列表
@@ -143,8 +154,12 @@ public:
     QHttpServerResponse phoneRegister(const QHttpServerRequest& req);
     // 获取单个文件
     QHttpServerResponse getSingleFile(const QHttpServerRequest& req);
+    // 分片上传文件
+    QHttpServerResponse putFileChunk(const QHttpServerRequest& req);
     // 语音转文字
     QHttpServerResponse recognition(const QHttpServerRequest& req);
+    // 流式语音转文字
+    QHttpServerResponse recognitionChunk(const QHttpServerRequest& req);
 };
 
 //////////////////////////////////////////////////////////////////